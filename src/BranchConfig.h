@@ -0,0 +1,35 @@
+#ifndef BRANCH_CONFIG_H
+#define BRANCH_CONFIG_H
+
+#include <inttypes.h>
+
+//How fetch guesses the direction of a conditional branch it finds in the BTB.
+enum PredictorType
+{
+    //Every branch falls through.
+    STATIC_NOT_TAKEN,
+    //A 2-bit counter per branch, indexed by its pc.
+    BIMODAL,
+    //2-bit counters indexed by the pc xor the global history of branch outcomes.
+    GSHARE,
+    //Bimodal and gshare side by side, a 2-bit counter per branch picks the one to follow.
+    TOURNAMENT
+};
+
+struct BranchPredictorConfig
+{
+    //Direction predictor for conditional branches.
+    PredictorType type;
+    //2-bit counters in each of the direction predictor's tables, a power of two.
+    uint32_t tableSize = 4096;
+    //Branch outcomes kept in the global history, only used by gshare and the tournament.
+    uint32_t historyBits = 12;
+    //Branch target buffer entries and ways per set, the sets are a power of two. A branch fetch doesn't
+    //find in the BTB falls through, whatever the direction predictor says.
+    uint32_t btbSize = 512;
+    uint32_t btbWays = 4;
+    //Return address stack entries, a jr $ra fetched with an empty stack uses the BTB target instead.
+    uint32_t rasDepth = 8;
+};
+
+#endif
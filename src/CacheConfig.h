@@ -1,9 +1,59 @@
+#ifndef CACHE_CONFIG_H
+#define CACHE_CONFIG_H
+
 #include <inttypes.h>
 
 enum CacheType
 {
     DIRECT_MAPPED,
-    TWO_WAY_SET_ASSOC
+    TWO_WAY_SET_ASSOC,
+    //Set-associative with CacheConfig::associativity ways per set.
+    SET_ASSOC,
+    //A single set holding every block.
+    FULLY_ASSOC
+};
+
+//Which block of a full set is evicted on a miss.
+enum ReplacementType
+{
+    LRU,
+    TREE_PLRU,
+    SRRIP,
+    BRRIP,
+    FIFO,
+    RANDOM
+};
+
+//How a shared cache's contents relate to the caches above it.
+enum InclusionPolicy
+{
+    //Fills like the caches above but never forces them to drop a block.
+    NON_INCLUSIVE,
+    //Holds every block held above, evicting a block also invalidates it above.
+    INCLUSIVE,
+    //Only holds blocks evicted from above, a hit moves the block up.
+    EXCLUSIVE
+};
+
+//Which blocks a cache fetches before they are asked for.
+enum PrefetcherType
+{
+    NO_PREFETCH,
+    //The blocks after one that missed or was prefetched and then used.
+    NEXT_LINE,
+    //The next addresses of a load or store whose accesses have a steady stride.
+    STRIDE,
+    //The blocks ahead of a detected run of misses, in either direction.
+    STREAM
+};
+
+//When a store reaches the level below.
+enum WritePolicy
+{
+    //Stores only update the cache, a dirty block is written below when it is evicted.
+    WRITE_BACK,
+    //Every store also goes below through the write buffer, blocks stay clean.
+    WRITE_THROUGH
 };
 
 struct CacheConfig
@@ -12,8 +62,34 @@ struct CacheConfig
     uint32_t cacheSize;
     //Cache block size in bytes.
     uint32_t blockSize;
-    //Type of cache - direct-mapped or two-way set-assoc?
+    //Type of cache - direct-mapped, two-way, N-way set-assoc or fully associative?
     CacheType type;
-    //Miss latency in cycles.
+    //Miss latency in cycles. Only used by the last cache before main memory, the
+    //caches above it pay the latency of the level below instead.
     uint32_t missLatency;
+    //Ways per set, only used by SET_ASSOC caches.
+    uint32_t associativity = 1;
+    //Replacement policy for caches with more than one way.
+    ReplacementType replacement = LRU;
+    //Extra cycles a hit takes, only used by the L2 and L3. L1 hits finish within their pipeline stage.
+    uint32_t hitLatency = 0;
+    //Inclusion policy towards the caches above, only used by the L2 and L3.
+    InclusionPolicy inclusion = NON_INCLUSIVE;
+    //Miss status holding registers, only used by the D-cache. 0 keeps it blocking, otherwise up to
+    //this many block fills can be outstanding while later instructions keep going.
+    uint32_t mshrs = 0;
+    //Prefetcher, and how many blocks it fetches at once and how far ahead of the accesses it runs.
+    PrefetcherType prefetcher = NO_PREFETCH;
+    uint32_t prefetchDegree = 1;
+    uint32_t prefetchDistance = 1;
+    //Write policy, and whether a store that misses fills its block first. A store that misses without
+    //allocating goes below through the write buffer. Only used by the D-cache, the L2 and L3 are
+    //always write-back and write-allocate.
+    WritePolicy writePolicy = WRITE_BACK;
+    bool writeAllocate = true;
+    //Blocks the write buffer holds. A store to a block already waiting there is merged into it, a
+    //store that needs a new entry while the buffer is full waits for the oldest one to be written.
+    uint32_t writeBufferDepth = 4;
 };
+
+#endif
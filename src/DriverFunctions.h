@@ -1,4 +1,10 @@
 #include "CacheConfig.h"
+#include "BranchConfig.h"
+#include "SuperscalarConfig.h"
+#include "OutOfOrderConfig.h"
+#include "SamplingConfig.h"
+
+class MemoryImage;
 
 struct PipeState
 {
@@ -17,6 +23,65 @@ struct SimulationStats
     uint32_t icMisses;
     uint32_t dcHits;
     uint32_t dcMisses;
+    //Shared levels, only printed when configured.
+    uint32_t l2Hits;
+    uint32_t l2Misses;
+    uint32_t l3Hits;
+    uint32_t l3Misses;
+    //Non-blocking D-cache, only printed when it has MSHRs.
+    uint32_t dcMergedMisses;
+    uint32_t mshrFullStalls;
+    //Cycles with at least one D-cache miss outstanding, and the outstanding misses summed over them.
+    uint32_t missCycles;
+    uint64_t outstandingMisses;
+    //Prefetches issued, and how many were first used after their fill (useful), while still
+    //in flight (late), or pushed out a block that missed again before the prefetch was used (polluting).
+    uint32_t icPrefetches;
+    uint32_t icUsefulPrefetches;
+    uint32_t icLatePrefetches;
+    uint32_t icPollutingPrefetches;
+    uint32_t dcPrefetches;
+    uint32_t dcUsefulPrefetches;
+    uint32_t dcLatePrefetches;
+    uint32_t dcPollutingPrefetches;
+    //D-cache stores that went into the write buffer, those merged into an entry already there,
+    //and the cycles stores waited for a free entry.
+    uint32_t bufferedWrites;
+    uint32_t coalescedWrites;
+    uint32_t writeBufferStalls;
+    //Conditional branches and jr resolved with a predictor, the ones fetch followed the wrong way,
+    //and the cycles lost to them, the ones the CPI stack charges to mispredicts.
+    uint32_t branches;
+    uint32_t mispredicts;
+    uint32_t mispredictCycles;
+    //Instructions written back, and the cycles the superscalar pipeline issued fewer than it had in ID
+    //because one depended on an older one of the same cycle, or because of an issue restriction.
+    uint32_t instructions;
+    uint32_t dependencySplits;
+    uint32_t structuralSplits;
+    //Cycles the out-of-order core's rename stopped because the reorder buffer, the issue queue or the
+    //load/store queue was full, and the instructions it squashed after mispredictions and exceptions.
+    uint32_t robFullStalls;
+    uint32_t iqFullStalls;
+    uint32_t lsqFullStalls;
+    uint32_t squashedInstructions;
+    //Sampled runs only: the sampling units measured, the mean of their CPIs and the half-width of its 95%
+    //confidence interval.
+    uint32_t sampleUnits;
+    double sampledCpi;
+    double sampledCpiError;
+    //The CPI stack: every cycle is charged to one cause, they add up to totalCycles. A cycle in which an
+    //instruction retired is a base cycle, nops and the halt aren't counted as instructions here either.
+    //Otherwise the pipeline charges the cause of the bubble in the oldest writeback slot, and the
+    //out-of-order core what holds up the head of its reorder buffer.
+    uint32_t baseCycles;
+    uint32_t icacheStallCycles;
+    uint32_t dcacheStallCycles;
+    uint32_t loadUseStallCycles;
+    uint32_t branchStallCycles;
+    uint32_t mispredictStallCycles;
+    uint32_t exceptionStallCycles;
+    uint32_t otherStallCycles;
 };
 
 //Implemented in UtilityFunctions.o
@@ -24,7 +89,54 @@ int dumpPipeState(PipeState & state);
 int printSimStats(SimulationStats & stats);
 
 //You must implement the following functions.
-int initSimulator(CacheConfig & icConfig, CacheConfig & dcConfig, MemoryStore *mainMem);
+//A driver whose store is also a MemoryImage (memory_image.h) passes it a second time as image, so the
+//simulator can use the whole address space of the store. Leave it NULL for any other store.
+int initSimulator(CacheConfig & icConfig, CacheConfig & dcConfig, MemoryStore *mainMem, MemoryImage *image = NULL);
+//Split L1s backed by a unified L2, and optionally an L3 below that. All levels need the same block size.
+int initSimulator(CacheConfig & icConfig, CacheConfig & dcConfig, CacheConfig & l2Config, MemoryStore *mainMem,
+                  MemoryImage *image = NULL);
+int initSimulator(CacheConfig & icConfig, CacheConfig & dcConfig, CacheConfig & l2Config, CacheConfig & l3Config,
+                  MemoryStore *mainMem, MemoryImage *image = NULL);
+//Profiles the I-cache and D-cache access streams of the run in one pass, for LRU caches of every
+//geometry with the configured block size, 1 to maxSets sets and 1 to maxWays ways (both powers of
+//two). Call after initSimulator, finalizeSimulator writes the hits and misses to stack_profile.out.
+int enableStackProfiling(uint32_t maxSets, uint32_t maxWays);
+//Writes every finished I-cache and D-cache access of the run to a binary trace at path, see trace.h.
+//Call after initSimulator, finalizeSimulator closes the trace. replayTrace runs it through caches again.
+int enableTraceCapture(const char *path);
+//Fetch follows a branch predictor, BTB and return address stack, and conditional branches and jr resolve
+//in EX instead of stalling ID for their operands. Fetch goes back after the delay slot of one it guessed
+//wrong. Call after initSimulator.
+int enableBranchPrediction(BranchPredictorConfig & config);
+//Replaces the pipeline with an in-order superscalar one that moves up to config.width instructions through
+//each stage per cycle. Branches resolve in ID as before, a taken one drops what was fetched past its delay
+//slot. Call after initSimulator and before the first cycle, not together with enableBranchPrediction.
+int enableSuperscalar(SuperscalarConfig & config);
+//Replaces the pipeline with an out-of-order core: registers renamed onto a reorder buffer, an issue queue
+//that sends instructions off as their operands are ready, and a load/store queue. Stores write the D-cache
+//and exceptions are taken as they commit. Fetch follows the predictor of enableBranchPrediction when there
+//is one, and falls through every branch otherwise. Call after initSimulator and before the first cycle,
+//not together with enableSuperscalar.
+int enableOutOfOrder(OutOfOrderConfig & config);
+//Samples the run instead of simulating all of it in detail, see SamplingConfig. The fast-forward between
+//sampling units moves the cycle count on by one per instruction plus the latency of its misses, the
+//extended stats report the CPI the units measured and the cycles it works out to. Call after initSimulator
+//and the other enable functions, before the first cycle.
+int enableSampling(SamplingConfig & config);
+//Writes the whole state of the simulator to path: the registers and pipeline, the caches with their contents
+//and everything in flight, the predictor, the stats and the memory image. Call between cycles, before
+//finalizeSimulator. Returns -EBADF if the file can't be created and -EIO if a write failed.
+int saveCheckpoint(const char *path);
+//Loads a checkpoint into a simulator set up with the same configs and enable functions as the one that
+//saved it, which then runs on exactly as that one would have. Stack profiles and traces aren't part of
+//a checkpoint, the ones enabled go on counting from where they are. Returns -EBADF if the file isn't a
+//checkpoint and -EINVAL if it was saved with other configs, both leave the simulator as it was. -EIO means
+//the file was cut short and the simulator has to be initialized again.
+int restoreCheckpoint(const char *path);
 int runCycles(uint32_t cycles);
 int runTillHalt();
+//Fills stats with the counters of the run so far, the ones finalizeSimulator prints. Returns -EINVAL
+//when the simulator isn't initialized.
+int getSimulationStats(SimulationStats & stats);
+//Prints the stats, writes the CPI stack to cpi_stack.out and the final register and memory state.
 int finalizeSimulator();
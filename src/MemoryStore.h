@@ -21,6 +21,66 @@ class MemoryStore
         virtual int setMemValue(uint32_t address, uint32_t value, MemEntrySize size) = 0;
         virtual int printMemory(uint32_t startAddress, uint32_t endAddress) = 0;
         virtual ~MemoryStore() {}
+
+        //Bulk transfers of size bytes starting at address, kept in memory (big endian) byte
+        //order in data. The aligned middle of the range is moved a word per access, so a
+        //block costs a quarter of the accesses of a byte by byte copy. Return the first
+        //nonzero value returned by an underlying access.
+        int readBlock(uint32_t address, uint8_t *data, uint32_t size)
+        {
+            uint32_t value = 0;
+            int ret = 0;
+
+            while(size > 0 && !ret)
+            {
+                if(size >= WORD_SIZE && (address & (WORD_SIZE - 1)) == 0)
+                {
+                    ret = getMemValue(address, value, WORD_SIZE);
+                    data[0] = (uint8_t)(value >> 24);
+                    data[1] = (uint8_t)(value >> 16);
+                    data[2] = (uint8_t)(value >> 8);
+                    data[3] = (uint8_t)value;
+                    address += WORD_SIZE;
+                    data += WORD_SIZE;
+                    size -= WORD_SIZE;
+                }
+                else
+                {
+                    ret = getMemValue(address, value, BYTE_SIZE);
+                    *data++ = (uint8_t)value;
+                    address++;
+                    size--;
+                }
+            }
+
+            return ret;
+        }
+
+        int writeBlock(uint32_t address, const uint8_t *data, uint32_t size)
+        {
+            int ret = 0;
+
+            while(size > 0 && !ret)
+            {
+                if(size >= WORD_SIZE && (address & (WORD_SIZE - 1)) == 0)
+                {
+                    uint32_t value = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                                     ((uint32_t)data[2] << 8) | data[3];
+                    ret = setMemValue(address, value, WORD_SIZE);
+                    address += WORD_SIZE;
+                    data += WORD_SIZE;
+                    size -= WORD_SIZE;
+                }
+                else
+                {
+                    ret = setMemValue(address, *data++, BYTE_SIZE);
+                    address++;
+                    size--;
+                }
+            }
+
+            return ret;
+        }
 };
 
 //Creates a memory store.
@@ -0,0 +1,25 @@
+#ifndef OUT_OF_ORDER_CONFIG_H
+#define OUT_OF_ORDER_CONFIG_H
+
+#include <inttypes.h>
+
+struct OutOfOrderConfig
+{
+    //Instructions fetched, and renamed into the reorder buffer, per cycle. Fetch doesn't go past the end of
+    //an I-cache block in a cycle.
+    uint32_t width = 4;
+    //Instructions the issue queue sends to execute per cycle, oldest first.
+    uint32_t issueWidth = 4;
+    //D-cache accesses per cycle, 1 to issueWidth. Loads take them when they issue, stores when they commit.
+    uint32_t memOpsPerCycle = 1;
+    //Instructions retired from the reorder buffer per cycle, in program order.
+    uint32_t commitWidth = 4;
+    //Entries of the fetch queue between fetch and rename, of the reorder buffer, of the issue queue and of
+    //the load/store queue. Rename stops when one it needs is full.
+    uint32_t fetchQueueSize = 16;
+    uint32_t robSize = 64;
+    uint32_t iqSize = 32;
+    uint32_t lsqSize = 16;
+};
+
+#endif
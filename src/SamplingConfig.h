@@ -0,0 +1,21 @@
+#ifndef SAMPLING_CONFIG_H
+#define SAMPLING_CONFIG_H
+
+#include <inttypes.h>
+
+//Systematic sampling in the style of SMARTS (Wunderlich et al., 2003). Every period instructions the pipeline
+//runs one sampling unit in detail, the instructions in between run functionally. The fast-forward still goes
+//through the caches and trains the branch predictor, so that a unit starts with them warm.
+struct SamplingConfig
+{
+    //Instructions from the start of one sampling unit to the start of the next, at least warming + unitSize.
+    //The run starts with the fast-forward.
+    uint32_t period = 100000;
+    //Instructions a unit runs in detail before it measures, which fills the pipeline and whatever the
+    //fast-forward doesn't keep warm.
+    uint32_t warming = 2000;
+    //Instructions a unit measures the CPI of, at least 1.
+    uint32_t unitSize = 1000;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SUPERSCALAR_CONFIG_H
+#define SUPERSCALAR_CONFIG_H
+
+#include <inttypes.h>
+
+//The widest superscalar pipeline, in instructions per stage.
+#define MAX_ISSUE_WIDTH 8
+
+struct SuperscalarConfig
+{
+    //Instructions fetched, issued and written back per cycle, 1 to MAX_ISSUE_WIDTH. A width of 1 runs the
+    //same model one instruction at a time, a baseline to compare wider ones against.
+    uint32_t width = 2;
+    //Loads and stores issued per cycle, 1 to width. The D-cache takes that many accesses a cycle, a
+    //blocking one still serves the misses among them one after the other.
+    uint32_t memOpsPerCycle = 1;
+    //Branches, jumps and jr only issue as the oldest instruction of a cycle, otherwise in any slot.
+    //Either way no more than one of them issues per cycle.
+    bool branchInSlot0 = true;
+};
+
+#endif
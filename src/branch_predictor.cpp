@@ -0,0 +1,210 @@
+#include <stddef.h>
+#include "branch_predictor.h"
+#include "checkpoint.h"
+
+// 2-bit counters predict taken from this value up
+#define COUNTER_TAKEN 2
+#define COUNTER_MAX 3
+// counters start weakly not taken, the tournament's choosers weakly on the bimodal side
+#define COUNTER_INIT 1
+
+static bool isPowerOfTwo(uint32_t value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static void train(uint8_t &counter, bool taken)
+{
+    if (taken) {
+        if (counter < COUNTER_MAX) counter++;
+    } else if (counter > 0) {
+        counter--;
+    }
+}
+
+// NOT TAKEN
+
+bool NotTakenPredictor::predict(uint32_t pc) {
+    return false;
+}
+
+void NotTakenPredictor::update(uint32_t pc, bool taken) {}
+
+// BIMODAL
+
+BimodalPredictor::BimodalPredictor(uint32_t tableSize) : counters(tableSize, COUNTER_INIT) {}
+
+bool BimodalPredictor::predict(uint32_t pc) {
+    return counters[(pc >> 2) & (counters.size() - 1)] >= COUNTER_TAKEN;
+}
+
+void BimodalPredictor::update(uint32_t pc, bool taken) {
+    train(counters[(pc >> 2) & (counters.size() - 1)], taken);
+}
+
+void BimodalPredictor::save(CheckpointWriter &out) {
+    out.putVector(counters);
+}
+
+void BimodalPredictor::load(CheckpointReader &in) {
+    in.getVector(counters);
+}
+
+// GSHARE
+
+GsharePredictor::GsharePredictor(uint32_t tableSize, uint32_t historyBits) : counters(tableSize, COUNTER_INIT), history(0), historyMask(historyBits >= 32 ? UINT32_MAX : (1u << historyBits) - 1) {}
+
+uint32_t GsharePredictor::index(uint32_t pc) {
+    return ((pc >> 2) ^ history) & (counters.size() - 1);
+}
+
+bool GsharePredictor::predict(uint32_t pc) {
+    return counters[index(pc)] >= COUNTER_TAKEN;
+}
+
+void GsharePredictor::update(uint32_t pc, bool taken) {
+    train(counters[index(pc)], taken);
+    history = ((history << 1) | taken) & historyMask;
+}
+
+void GsharePredictor::save(CheckpointWriter &out) {
+    out.putVector(counters);
+    out.put(history);
+}
+
+void GsharePredictor::load(CheckpointReader &in) {
+    in.getVector(counters);
+    in.get(history);
+}
+
+// TOURNAMENT
+
+TournamentPredictor::TournamentPredictor(uint32_t tableSize, uint32_t historyBits) : bimodal(tableSize), gshare(tableSize, historyBits), choosers(tableSize, COUNTER_INIT) {}
+
+bool TournamentPredictor::predict(uint32_t pc) {
+    uint8_t chooser = choosers[(pc >> 2) & (choosers.size() - 1)];
+    return chooser >= COUNTER_TAKEN ? gshare.predict(pc) : bimodal.predict(pc);
+}
+
+void TournamentPredictor::update(uint32_t pc, bool taken) {
+    bool bimodalRight = bimodal.predict(pc) == taken;
+    bool gshareRight = gshare.predict(pc) == taken;
+    if (bimodalRight != gshareRight) {
+        train(choosers[(pc >> 2) & (choosers.size() - 1)], gshareRight);
+    }
+    bimodal.update(pc, taken);
+    gshare.update(pc, taken);
+}
+
+void TournamentPredictor::save(CheckpointWriter &out) {
+    bimodal.save(out);
+    gshare.save(out);
+    out.putVector(choosers);
+}
+
+void TournamentPredictor::load(CheckpointReader &in) {
+    bimodal.load(in);
+    gshare.load(in);
+    in.getVector(choosers);
+}
+
+DirectionPredictor *createDirectionPredictor(BranchPredictorConfig &config) {
+    switch (config.type) {
+    case BIMODAL:
+        return new BimodalPredictor(config.tableSize);
+    case GSHARE:
+        return new GsharePredictor(config.tableSize, config.historyBits);
+    case TOURNAMENT:
+        return new TournamentPredictor(config.tableSize, config.historyBits);
+    case STATIC_NOT_TAKEN:
+        break;
+    }
+    return new NotTakenPredictor();
+}
+
+// BTB AND RETURN ADDRESS STACK
+
+BranchPredictor::BranchPredictor(BranchPredictorConfig &config) : direction(createDirectionPredictor(config)), btb(config.btbSize, BtbEntry{0, 0, BRANCH_CONDITIONAL, 0, false}), btbSets(config.btbSize / config.btbWays), btbWays(config.btbWays), clock(0), ras(config.rasDepth), rasTop(0), rasCount(0) {}
+
+BranchPredictor::~BranchPredictor() {
+    delete direction;
+}
+
+bool BranchPredictor::isValidConfig(BranchPredictorConfig &config) {
+    if (!isPowerOfTwo(config.tableSize) || config.btbWays == 0 || config.btbSize % config.btbWays != 0) return false;
+    return isPowerOfTwo(config.btbSize / config.btbWays);
+}
+
+BranchPredictor::BtbEntry *BranchPredictor::findBtbEntry(uint32_t pc) {
+    BtbEntry *set = &btb[((pc >> 2) & (btbSets - 1)) * btbWays];
+    for (uint32_t way = 0; way < btbWays; way++) {
+        if (set[way].valid && set[way].pc == pc) return &set[way];
+    }
+    return NULL;
+}
+
+uint32_t BranchPredictor::predict(uint32_t pc, bool &popsReturn) {
+    popsReturn = false;
+    BtbEntry *entry = findBtbEntry(pc);
+    if (!entry) return pc + 8;
+    switch (entry->kind) {
+    case BRANCH_CONDITIONAL:
+        return direction->predict(pc) ? entry->target : pc + 8;
+    case BRANCH_RETURN:
+        if (rasCount == 0) break;
+        popsReturn = true;
+        return ras[rasTop];
+    case BRANCH_INDIRECT:
+        break;
+    }
+    return entry->target;
+}
+
+void BranchPredictor::popReturn() {
+    if (rasCount == 0) return;
+    rasTop = (rasTop + ras.size() - 1) % ras.size();
+    rasCount--;
+}
+
+void BranchPredictor::pushReturn(uint32_t address) {
+    if (ras.empty()) return;
+    rasTop = (rasTop + 1) % ras.size();
+    ras[rasTop] = address;
+    if (rasCount < ras.size()) rasCount++;
+}
+
+void BranchPredictor::update(uint32_t pc, BranchKind kind, bool taken, uint32_t target) {
+    if (kind == BRANCH_CONDITIONAL) direction->update(pc, taken);
+    BtbEntry *entry = findBtbEntry(pc);
+    if (!entry) {
+        // a branch that falls through is predicted right without an entry
+        if (!taken) return;
+        BtbEntry *set = &btb[((pc >> 2) & (btbSets - 1)) * btbWays];
+        entry = &set[0];
+        for (uint32_t way = 0; way < btbWays && entry->valid; way++) {
+            if (!set[way].valid || set[way].lastUsed < entry->lastUsed) entry = &set[way];
+        }
+        *entry = BtbEntry{pc, target, kind, 0, true};
+    }
+    entry->kind = kind;
+    if (taken) entry->target = target;
+    entry->lastUsed = ++clock;
+}
+
+void BranchPredictor::save(CheckpointWriter &out) {
+    direction->save(out);
+    out.putVector(btb);
+    out.put(clock);
+    out.putVector(ras);
+    out.put(rasTop);
+    out.put(rasCount);
+}
+
+void BranchPredictor::load(CheckpointReader &in) {
+    direction->load(in);
+    in.getVector(btb);
+    in.get(clock);
+    in.getVector(ras);
+    in.get(rasTop);
+    in.get(rasCount);
+}
@@ -0,0 +1,125 @@
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <inttypes.h>
+#include <vector>
+#include "BranchConfig.h"
+
+using std::vector;
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// guesses whether a conditional branch is taken
+class DirectionPredictor {
+    public:
+        virtual ~DirectionPredictor() {}
+        virtual bool predict(uint32_t pc) = 0;
+        // the outcome of the branch at pc, once it is resolved
+        virtual void update(uint32_t pc, bool taken) = 0;
+        // the counters and history, for a checkpoint
+        virtual void save(CheckpointWriter &out) {}
+        virtual void load(CheckpointReader &in) {}
+};
+
+class NotTakenPredictor : public DirectionPredictor {
+    public:
+        bool predict(uint32_t pc);
+        void update(uint32_t pc, bool taken);
+};
+
+// a table of saturating 2-bit counters indexed by pc (Smith, 1981)
+class BimodalPredictor : public DirectionPredictor {
+    private:
+        vector<uint8_t> counters;
+    public:
+        BimodalPredictor(uint32_t tableSize);
+        bool predict(uint32_t pc);
+        void update(uint32_t pc, bool taken);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// 2-bit counters indexed by the pc xor the outcomes of the last branches (McFarling, 1993).
+// the history only takes in outcomes as branches resolve, not the predictions
+class GsharePredictor : public DirectionPredictor {
+    private:
+        vector<uint8_t> counters;
+        uint32_t history, historyMask;
+        uint32_t index(uint32_t pc);
+    public:
+        GsharePredictor(uint32_t tableSize, uint32_t historyBits);
+        bool predict(uint32_t pc);
+        void update(uint32_t pc, bool taken);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// bimodal and gshare both predict every branch, a table of 2-bit counters indexed by pc learns which
+// of them to follow for it, moving only when they disagree (McFarling, 1993)
+class TournamentPredictor : public DirectionPredictor {
+    private:
+        BimodalPredictor bimodal;
+        GsharePredictor gshare;
+        vector<uint8_t> choosers;
+    public:
+        TournamentPredictor(uint32_t tableSize, uint32_t historyBits);
+        bool predict(uint32_t pc);
+        void update(uint32_t pc, bool taken);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+DirectionPredictor *createDirectionPredictor(BranchPredictorConfig &config);
+
+// the control transfer a BTB entry was made for
+enum BranchKind {
+    BRANCH_CONDITIONAL,
+    // jr $ra, its target comes from the return address stack
+    BRANCH_RETURN,
+    // any other jr
+    BRANCH_INDIRECT
+};
+
+// what fetch knows about the instructions it hasn't decoded yet: the direction predictor, a set-associative
+// LRU branch target buffer and a return address stack. fetch asks for every instruction, branches are
+// only trained once they resolve
+class BranchPredictor {
+    private:
+        struct BtbEntry {
+            uint32_t pc;
+            uint32_t target;
+            BranchKind kind;
+            uint64_t lastUsed;
+            bool valid;
+        };
+        DirectionPredictor *direction;
+        vector<BtbEntry> btb;
+        uint32_t btbSets, btbWays;
+        uint64_t clock;
+        // a circular stack, a call that finds it full overwrites the oldest return address
+        vector<uint32_t> ras;
+        uint32_t rasTop, rasCount;
+        BtbEntry *findBtbEntry(uint32_t pc);
+    public:
+        // the config has to pass isValidConfig
+        BranchPredictor(BranchPredictorConfig &config);
+        ~BranchPredictor();
+        BranchPredictor(const BranchPredictor &) = delete;
+        BranchPredictor &operator=(const BranchPredictor &) = delete;
+        static bool isValidConfig(BranchPredictorConfig &config);
+        // where fetch goes after the delay slot of the instruction at pc, pc + 8 unless the BTB holds it
+        // and it is predicted taken. Changes nothing, popsReturn is set when the target is the top of the
+        // return address stack and the caller has to popReturn once the instruction is really fetched
+        uint32_t predict(uint32_t pc, bool &popsReturn);
+        void popReturn();
+        // a jal went through decode
+        void pushReturn(uint32_t address);
+        // a resolved conditional branch or jr, target is where it went after its delay slot
+        void update(uint32_t pc, BranchKind kind, bool taken, uint32_t target);
+        // everything the predictor has learned, for a checkpoint
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+#endif
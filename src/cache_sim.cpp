@@ -2,229 +2,809 @@
 #include <iomanip>
 #include <fstream>
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
-#include <math.h> 
+#include <math.h>
+#include <algorithm>
+#include <new>
 #include "MemoryStore.h"
 #include "RegisterInfo.h"
 #include "EndianHelpers.h"
 #include "DriverFunctions.h"
 
 #include "cache_sim.h"
+#include "checkpoint.h"
+#include "memory_image.h"
 
-#define ADDRESS_LEN 32 
+// alignment of the block buffer, one host cache line
+#define CACHE_DATA_ALIGN 64
 
 using std::vector;
 
+// ways per set of a cache built from config
+static uint32_t configAssociativity(const CacheConfig &config) {
+    switch (config.type) {
+    case TWO_WAY_SET_ASSOC:
+        return 2;
+    case SET_ASSOC:
+        return config.associativity;
+    case FULLY_ASSOC:
+        return config.blockSize ? config.cacheSize / config.blockSize : 0;
+    default:
+        return 1;
+    }
+}
+
+static bool isPowerOfTwo(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+int Cache::checkConfig(const CacheConfig &config) {
+    // offsets and indices are masked off the address, so block size and number of sets are powers of two
+    if (!isPowerOfTwo(config.blockSize)) {
+        std::cerr << "Invalid cache configuration: block size " << config.blockSize << " isn't a power of two" << std::endl;
+        return -EINVAL;
+    }
+    uint32_t numBlocks = config.cacheSize / config.blockSize;
+    uint32_t assoc = configAssociativity(config);
+    if (assoc == 0 || numBlocks < assoc || numBlocks % assoc != 0) {
+        std::cerr << "Invalid cache configuration: " << numBlocks << " blocks can't be split into "
+                  << assoc << " way sets" << std::endl;
+        return -EINVAL;
+    }
+    if (!isPowerOfTwo(numBlocks / assoc)) {
+        std::cerr << "Invalid cache configuration: the number of sets, " << numBlocks / assoc
+                  << ", isn't a power of two" << std::endl;
+        return -EINVAL;
+    }
+    if (!replacementPolicySupports(config.replacement, assoc)) {
+        std::cerr << "Invalid cache configuration: replacement policy " << config.replacement << " does not support "
+                  << assoc << " way sets" << std::endl;
+        return -EINVAL;
+    }
+    if ((config.writePolicy == WRITE_THROUGH || !config.writeAllocate) && config.writeBufferDepth == 0) {
+        std::cerr << "Invalid cache configuration: write-through and no-write-allocate need a write buffer" << std::endl;
+        return -EINVAL;
+    }
+    return 0;
+}
+
 // initialize once for I cache and D cache
-Cache::Cache(CacheConfig &config, MemoryStore *mem) {
+Cache::Cache(CacheConfig &config, MemoryStore *mem, MemoryImage *image) {
     hits = 0;
     misses = 0;
+    mergedMisses = 0;
+    mshrFullStalls = 0;
+    prefetchesIssued = 0;
+    usefulPrefetches = 0;
+    latePrefetches = 0;
+    pollutingPrefetches = 0;
+    bufferedWrites = 0;
+    coalescedWrites = 0;
+    writeBufferStalls = 0;
     blockSize = config.blockSize;
     cacheSize= config.cacheSize;
     missLatency = config.missLatency;
     cacheType = config.type;
+    hitLatency = config.hitLatency;
+    inclusion = config.inclusion;
+    nextLevel = NULL;
     mainMem = mem;
+    memoryImage = image;
+    memoryEnd = image ? image->addressSpaceEnd() : MEMORY_SIZE;
     numBlocks = cacheSize/blockSize;
-    if(cacheType == TWO_WAY_SET_ASSOC) {
-        assoc = 2;
-    } else {
-        assoc = 1;
+    assoc = configAssociativity(config);
+    numSets = numBlocks/assoc;
+    policy = createReplacementPolicy(config.replacement, numSets, assoc);
+
+    // metadata, one entry per line
+    tags.assign(numSets * assoc, 0);
+    stateBits.assign(numSets * assoc, 0);
+    cycleReady.assign(numSets * assoc, 0);
+    fillBuffer.assign(blockSize, 0);
+    mshrs.assign(config.mshrs, MSHR{0, 0});
+    prefetcher = createPrefetcher(config.prefetcher, blockSize, config.prefetchDegree, config.prefetchDistance);
+    pollutionFilter.assign(prefetcher ? numBlocks : 0, 0);
+    writePolicy = config.writePolicy;
+    writeAllocate = config.writeAllocate;
+    writeBufferDepth = 0;
+    writePortFree = 0;
+    if (writePolicy == WRITE_THROUGH || !writeAllocate) {
+        writeBufferDepth = config.writeBufferDepth;
+    }
+
+    // block data, one contiguous buffer for all lines
+    size_t dataSize = (size_t)numSets * assoc * blockSize;
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, CACHE_DATA_ALIGN, dataSize ? dataSize : CACHE_DATA_ALIGN)) {
+        throw std::bad_alloc();
     }
-    if(cacheType == TWO_WAY_SET_ASSOC) {
-        numSets = numBlocks/2;
+    cacheData = (uint8_t *) buffer;
+    memset(cacheData, 0, dataSize);
+
+    offsetMask  = blockSize - 1;
+    indexMask   = numSets - 1;
+    indexStart  = log2(blockSize);
+    tagStart    = indexStart + log2(numSets);
+
+}
+
+// block transfers to and from main memory, through the image when there is one
+int Cache::readMemory(uint32_t address, uint8_t *data, uint32_t size) {
+    return memoryImage ? memoryImage->readRange(address, data, size) : mainMem->readBlock(address, data, size);
+}
+
+int Cache::writeMemory(uint32_t address, const uint8_t *data, uint32_t size) {
+    return memoryImage ? memoryImage->writeRange(address, data, size) : mainMem->writeBlock(address, data, size);
+}
+
+// writes each run of bytes set in mask to memory
+void Cache::writeMaskedToMemory(uint32_t address, const uint8_t *data, const uint8_t *mask) {
+    for (uint32_t i = 0; i < blockSize; ) {
+        if (!mask[i]) {
+            i++;
+            continue;
+        }
+        uint32_t end = i;
+        while (end < blockSize && mask[end]) end++;
+        writeMemory(address + i, data + i, end - i);
+        i = end;
+    }
+}
+
+// assembles a big endian value of the given size from the bytes at data
+static inline uint32_t loadBigEndian(const uint8_t *data, MemEntrySize size) {
+    switch (size) {
+    case BYTE_SIZE:
+        return data[0];
+    case HALF_SIZE:
+        return ((uint32_t) data[0] << 8) | data[1];
+    default:
+        return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+    }
+}
+
+// splits value into the given number of big endian bytes at data
+static inline void storeBigEndian(uint8_t *data, uint32_t value, MemEntrySize size) {
+    for (uint32_t i = 0; i < size; i++) {
+        data[i] = (uint8_t) (value >> ((size-1-i)*8));
+    }
+}
+
+// a miss decrements hits because the stalled access is retried once the block is ready,
+// and that retry counts as the hit
+void Cache::recordAccess(int result) {
+    if(result == 0) {
+        hits++;
     } else {
-        numSets = numBlocks;
-    }
-    for (uint32_t i = 0; i < numSets; i++) {
-        metaDataBits.emplace_back();
-        for (uint32_t j = 0; j < assoc; j++) {
-            metaDataBits[i].emplace_back();
-            // metaDataBits[i][j].tag = 0;
-            // metaDataBits[i][j].dirty  = 0;
-            // metaDataBits[i][j].lru = 0;
+        misses++;
+        hits--;
+    }
+}
+
+ // address given is the address of the first byte
+int Cache::getCacheValue(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle, uint32_t pc){
+    uint8_t bytes[WORD_SIZE] = {0};
+    int result = accessBytes(address, bytes, size, cycle, false, pc);
+    recordAccess(result);
+    value = loadBigEndian(bytes, size);
+    return result;
+}
+
+int Cache::setCacheValue(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle, uint32_t pc) {
+    // waiting for the write buffer is neither a hit nor a miss, the store is retried as if it never happened
+    int wait = writeBufferWait(address, size, cycle, true);
+    if (wait) {
+        writeBufferStalls += wait;
+        return wait;
+    }
+    uint8_t bytes[WORD_SIZE];
+    storeBigEndian(bytes, value, size);
+    int result = accessBytes(address, bytes, size, cycle, true, pc);
+    recordAccess(result);
+    return result;
+}
+
+// copies count bytes between the cache and data, one tag check per block touched.
+// an access that crosses a block boundary is split per block and takes as long as its slowest part
+int Cache::accessBytes(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc) {
+    int result = 0;
+    while (count > 0) {
+        uint32_t blockOffset = address & offsetMask;
+        uint32_t chunk = std::min(count, blockSize - blockOffset);
+        int delay = accessBlock(address, data, chunk, cycle, isWrite, pc);
+        result = std::max(result, delay);
+        address += chunk;
+        data += chunk;
+        count -= chunk;
+    }
+    return result;
+}
+
+// reads or writes count bytes that all live in the block holding address
+int Cache::accessBlock(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc) {
+    uint32_t addrTag = address >> tagStart;
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t blockOffset = address & offsetMask;
+    uint32_t way = findWay(addrTag, addrIndex);
+    uint32_t line = lineIndex(addrIndex, way);
+    int result = 0;
+    bool trigger = true;
+
+    if (way < assoc) {
+        trigger = firstPrefetchUse(line, cycle);
+        // we've hit before, but are emulating latency
+        if (cycleReady[line] > cycle) {
+            trainPrefetcher(pc, address, trigger, cycle);
+            return cycleReady[line] - cycle;
         }
+        policy->touch(addrIndex, way);
+    } else if (isWrite && !writeAllocate) {
+        // the store goes around the cache and is done once it is in the write buffer. it is still a
+        // miss, which recordAccess would otherwise count as a hit
+        misses++;
+        hits--;
+        checkPollution(address);
+        bufferWrite(address, data, count, cycle);
+        trainPrefetcher(pc, address, true, cycle);
+        return 0;
+    } else {
+        // gets data from the next level after a cache miss.
+        // a miss takes at least a cycle, even when the level below answers at once
+        checkPollution(address);
+        way = cacheMiss(address, addrTag, addrIndex, cycle, result);
+        result = std::max(result, 1);
+        line = lineIndex(addrIndex, way);
+        cycleReady[line] = cycle + result;
     }
 
-    for (uint32_t i = 0; i < numSets; i++) {
-        cacheData.emplace_back();        
-        for (uint32_t j = 0; j < assoc; j++) {
-            cacheData[i].emplace_back();
-            for (uint32_t k = 0; k<blockSize; k++) {
-                cacheData[i][j].emplace_back();
-            }
+    // a read that misses returns no data, the caller retries once the block is ready.
+    // a write-through store is only sent below by the retry, so it goes once
+    uint8_t *block = blockPtr(addrIndex, way) + blockOffset;
+    if (isWrite && writePolicy == WRITE_THROUGH) {
+        if (result == 0) {
+            memcpy(block, data, count);
+            bufferWrite(address, data, count, cycle);
         }
+    } else if (isWrite) {
+        memcpy(block, data, count);
+        stateBits[line] |= DIRTY_BIT;
+    } else if (result == 0) {
+        memcpy(data, block, count);
     }
+    // prefetches can replace lines, so they go out once this access is done with its own
+    trainPrefetcher(pc, address, trigger, cycle);
+    return result;
+}
 
+int Cache::issueLoad(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle, uint32_t pc) {
+    uint8_t bytes[WORD_SIZE] = {0};
+    int result = issueAccess(address, bytes, size, cycle, false, pc);
+    value = loadBigEndian(bytes, size);
+    return result;
+}
 
-    offsetStart = 0;
-    offsetEnd   = log2(blockSize);
-    indexStart  = log2(blockSize);
-    indexEnd    = indexStart + log2(numSets);
-    tagStart    = indexStart + log2(numSets);
-    tagEnd      = ADDRESS_LEN;
-    
+int Cache::issueStore(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle, uint32_t pc) {
+    uint8_t bytes[WORD_SIZE];
+    storeBigEndian(bytes, value, size);
+    return issueAccess(address, bytes, size, cycle, true, pc);
 }
 
- // address given is the address of the first byte
-int Cache::getCacheValue(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle){
-    int result;
-    value = 0;
-
-    // look at each byte  
-    for(uint32_t i = 0; i< size; i++){
-        uint32_t byteAddr = address+i;
-        uint32_t byte;
-        result = getCacheByte(byteAddr, byte, cycle);
-        if(i ==0){
-            if(result == 0) {
-                hits++;
-            } else {
-                misses++;
-                hits--;
+// non-blocking version of accessBytes. nothing is retried, so hits and misses are counted here
+int Cache::issueAccess(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc) {
+    // every block the access touches gets its MSHR or none does, so count the new misses first
+    uint32_t firstBlock = address & ~offsetMask;
+    uint32_t lastBlock = (address + count - 1) & ~offsetMask;
+    uint32_t needed = 0;
+    for (uint32_t block = firstBlock; ; block += blockSize) {
+        bool missing = !findMSHR(block, cycle) && findWay(block >> tagStart, (block >> indexStart) & indexMask) == assoc;
+        // a store that doesn't allocate uses the write buffer instead
+        if (missing && (!isWrite || writeAllocate)) needed++;
+        if (block == lastBlock) break;
+    }
+    uint32_t free = mshrs.size() - getOutstandingMisses(cycle);
+    if (needed > free) {
+        mshrFullStalls++;
+        return MSHR_FULL;
+    }
+    if (isWrite && writeBufferWait(address, count, cycle, false)) {
+        writeBufferStalls++;
+        return WRITE_BUFFER_FULL;
+    }
+
+    int result = 0;
+    while (count > 0) {
+        uint32_t blockOffset = address & offsetMask;
+        uint32_t chunk = std::min(count, blockSize - blockOffset);
+        int delay = issueBlock(address, data, chunk, cycle, isWrite, pc);
+        result = std::max(result, delay);
+        address += chunk;
+        data += chunk;
+        count -= chunk;
+    }
+    return result;
+}
+
+// reads or writes count bytes that all live in the block holding address, without waiting for a miss
+int Cache::issueBlock(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc) {
+    uint32_t addrTag = address >> tagStart;
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t blockOffset = address & offsetMask;
+    uint32_t way = findWay(addrTag, addrIndex);
+    MSHR *mshr = findMSHR(address & ~offsetMask, cycle);
+    int result = 0;
+    int latency;
+    bool trigger = true;
+
+    if (mshr) {
+        // a secondary miss, it waits for the fill that is already on its way
+        misses++;
+        mergedMisses++;
+        result = mshr->readyCycle - cycle;
+        if (way == assoc) {
+            // the line was replaced before its fill even finished, bring the data back
+            way = cacheMiss(address, addrTag, addrIndex, cycle, latency);
+            cycleReady[lineIndex(addrIndex, way)] = mshr->readyCycle;
+        } else {
+            policy->touch(addrIndex, way);
+        }
+        trigger = false;
+    } else if (way < assoc) {
+        uint32_t line = lineIndex(addrIndex, way);
+        trigger = firstPrefetchUse(line, cycle);
+        // a prefetch that hasn't arrived yet makes the access wait like a miss
+        if (cycleReady[line] > cycle) {
+            result = cycleReady[line] - cycle;
+            misses++;
+        } else {
+            hits++;
+        }
+        policy->touch(addrIndex, way);
+    } else if (isWrite && !writeAllocate) {
+        // goes around the cache, issueAccess made sure the write buffer has room
+        misses++;
+        checkPollution(address);
+        bufferWrite(address, data, count, cycle);
+        trainPrefetcher(pc, address, true, cycle);
+        return 0;
+    } else {
+        // a primary miss, issueAccess made sure an MSHR is free
+        misses++;
+        checkPollution(address);
+        way = cacheMiss(address, addrTag, addrIndex, cycle, latency);
+        result = std::max(latency, 1);
+        cycleReady[lineIndex(addrIndex, way)] = cycle + result;
+        for (MSHR &entry : mshrs) {
+            if (entry.readyCycle <= cycle) {
+                entry.blockAddress = address & ~offsetMask;
+                entry.readyCycle = cycle + result;
+                break;
             }
         }
-        value = value | (byte << ((size-1-i)*8));
     }
+
+    // the block is already filled, only the timing waits for it
+    uint8_t *block = blockPtr(addrIndex, way) + blockOffset;
+    if (isWrite && writePolicy == WRITE_THROUGH) {
+        memcpy(block, data, count);
+        bufferWrite(address, data, count, cycle);
+    } else if (isWrite) {
+        memcpy(block, data, count);
+        stateBits[lineIndex(addrIndex, way)] |= DIRTY_BIT;
+    } else {
+        memcpy(data, block, count);
+    }
+    trainPrefetcher(pc, address, trigger, cycle);
     return result;
 }
 
-    // cache read miss procedure:
-    // check the dirty bit if its 1 we write back, if its 0 we dont write back
-    // overwrite contents of cache block by grabbing data from memory
-    // overwrite the tag in our metadata 
-    // when replacing :  make valid bit 1,  dirty bit 0,  update lru 
-    // make a helper function to run the cache miss procedure (use for both getCacheValue and setCacheValue)
-    // write miss
-    // set dirty to 1 every time you write the cache line
-    
-    // do we count the hits for each byte or for each word?
-    // what should we be returning for the getCache function? the value of the word?
-    
-
-int Cache::setCacheValue(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle) {
-    uint32_t mask = 0xFF;
-    int result;
-    for (uint32_t i = 0; i < size; i++) {
-        uint32_t byte = (value & (mask << ((size-1-i)*8))) >> ((size-1-i)*8);
-        //uint32_t byte;
-        result = setCacheByte(address + i, byte, cycle);
-        if(i ==0){
-            if(result == 0) {
-                hits++;
-            } else {
-                misses++;
-                hits--;
+// counts the first demand use of a prefetched line, returns true if this was it
+bool Cache::firstPrefetchUse(uint32_t line, uint32_t cycle) {
+    if (!(stateBits[line] & PREFETCHED_BIT)) return false;
+    stateBits[line] &= ~PREFETCHED_BIT;
+    if (cycleReady[line] > cycle) {
+        latePrefetches++;
+    } else {
+        usefulPrefetches++;
+    }
+    return true;
+}
+
+// a demand miss on a block a prefetch pushed out
+void Cache::checkPollution(uint32_t address) {
+    if (!prefetcher) return;
+    uint32_t blockNumber = address / blockSize;
+    uint32_t &entry = pollutionFilter[blockNumber % pollutionFilter.size()];
+    if (entry == blockNumber + 1) {
+        pollutingPrefetches++;
+        entry = 0;
+    }
+}
+
+// shows a demand access to the prefetcher and fetches whatever it asks for
+void Cache::trainPrefetcher(uint32_t pc, uint32_t address, bool trigger, uint32_t cycle) {
+    if (!prefetcher) return;
+    prefetchRequests.clear();
+    prefetcher->observe(pc, address, trigger, prefetchRequests);
+    for (uint32_t request : prefetchRequests) {
+        prefetchBlock(request, cycle);
+    }
+}
+
+// fills the block holding address ahead of demand. a prefetch never replaces a line that is still being
+// filled, which keeps it from undoing a miss whose access hasn't been retried yet
+void Cache::prefetchBlock(uint32_t address, uint32_t cycle) {
+    uint32_t blockAddress = address & ~offsetMask;
+    uint32_t addrTag = blockAddress >> tagStart;
+    uint32_t addrIndex = (blockAddress >> indexStart) & indexMask;
+    if (blockAddress >= memoryEnd || findWay(addrTag, addrIndex) < assoc) return;
+
+    uint32_t way0 = lineIndex(addrIndex, 0);
+    uint32_t way;
+    for (way = 0; way < assoc; way++) {
+        if (!(stateBits[way0 + way] & VALID_BIT)) break;
+    }
+    if (way == assoc) {
+        way = policy->victim(addrIndex);
+        if (cycleReady[way0 + way] > cycle) return;
+    }
+
+    prefetchesIssued++;
+    int latency = fetchFromBelow(blockAddress, fillBuffer.data(), cycle);
+    uint32_t line = way0 + way;
+    if (stateBits[line] & VALID_BIT) {
+        uint32_t victim = lineAddress(addrIndex, way) / blockSize;
+        pollutionFilter[victim % pollutionFilter.size()] = victim + 1;
+        evictLine(addrIndex, way, cycle);
+    }
+    installBlock(addrIndex, way, addrTag, fillBuffer.data(), false);
+    stateBits[line] |= PREFETCHED_BIT;
+    cycleReady[line] = cycle + std::max(latency, 1);
+}
+
+// true if a store to the block holding address would go into the write buffer now. a blocking
+// cache only sends a write-through store below once its block is in
+bool Cache::buffersWrite(uint32_t address, uint32_t cycle, bool blocking) {
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t way = findWay(address >> tagStart, addrIndex);
+    if (way == assoc) {
+        return !writeAllocate || (writePolicy == WRITE_THROUGH && !blocking);
+    }
+    return writePolicy == WRITE_THROUGH && (!blocking || cycleReady[lineIndex(addrIndex, way)] <= cycle);
+}
+
+// cycles until the write buffer has an entry for every block of a store that needs a new one, 0 if it has now
+int Cache::writeBufferWait(uint32_t address, uint32_t count, uint32_t cycle, bool blocking) {
+    if (!writeBufferDepth) return 0;
+    retireWrites(cycle);
+    uint32_t firstBlock = address & ~offsetMask;
+    uint32_t lastBlock = (address + count - 1) & ~offsetMask;
+    uint32_t needed = 0;
+    for (uint32_t block = firstBlock; ; block += blockSize) {
+        if (buffersWrite(block, cycle, blocking)) {
+            bool merges = false;
+            for (WriteBufferEntry &entry : writeBuffer) {
+                if (entry.blockAddress == block && !entry.draining) merges = true;
             }
+            if (!merges) needed++;
         }
+        if (block == lastBlock) break;
     }
-    return result;
+    // a store needing more entries than the buffer has goes in one entry at a time once it is empty
+    if (needed > writeBufferDepth) needed = writeBufferDepth;
+    if (needed <= writeBufferDepth - writeBuffer.size()) return 0;
+    // the oldest entry is always draining by now, the store tries again once it is gone
+    return writeBuffer.front().doneCycle - cycle;
 }
 
-int Cache::getCacheByte(uint32_t address, uint32_t & value, uint32_t cycle){
-    uint32_t addressCopy = address;
-    uint32_t addrTag = addressCopy << (ADDRESS_LEN - tagEnd) >> (ADDRESS_LEN-tagEnd) >> (tagStart);
-    addressCopy = address;
-    uint32_t addrIndex = addressCopy << (ADDRESS_LEN - indexEnd) >> (ADDRESS_LEN - indexEnd) >> indexStart;
-    addressCopy = address;
-    uint32_t blockOffset = addressCopy << (ADDRESS_LEN - offsetEnd) >> (ADDRESS_LEN - offsetEnd) >> offsetStart;
-
-        // iterate through each block in a set
-       for (uint32_t i = 0; i< assoc; i++) {
-        // read Hit
-        if(metaDataBits[addrIndex][i].valid  && metaDataBits[addrIndex][i].tag == addrTag) {
-            if (metaDataBits[addrIndex][i].cycleReady > cycle) return missLatency;
-            value = cacheData[addrIndex][i][blockOffset];
-            updateLRU(addrIndex, i);
-            // helper function to keep track of LRU block for each set in cache
-           // updateLRU();
-            return 0;
-        } 
-    }
-    // gets data from memory after a cache miss 
-    uint32_t newBlock = cacheMiss(addressCopy, addrTag, addrIndex, blockOffset);
-    value = cacheData[addrIndex][newBlock][blockOffset];
-    metaDataBits[addrIndex][newBlock].cycleReady = cycle + missLatency;
+// puts count bytes of a store, all in one block, into the write buffer
+void Cache::bufferWrite(uint32_t address, const uint8_t *data, uint32_t count, uint32_t cycle) {
+    retireWrites(cycle);
+    uint32_t blockAddress = address & ~offsetMask;
+    uint32_t blockOffset = address & offsetMask;
+    bufferedWrites++;
+
+    WriteBufferEntry *target = NULL;
+    for (WriteBufferEntry &entry : writeBuffer) {
+        if (entry.blockAddress == blockAddress && !entry.draining) target = &entry;
+    }
+    if (target) {
+        coalescedWrites++;
+    } else {
+        if (writeBuffer.size() == writeBufferDepth) {
+            // the callers check for room first, this only keeps the buffer from growing if they didn't
+            flushWrites(writeBuffer.front().blockAddress, cycle);
+        }
+        writeBuffer.push_back(WriteBufferEntry{blockAddress, cycle, false, 0, vector<uint8_t>(blockSize, 0), vector<uint8_t>(blockSize, 0)});
+        target = &writeBuffer.back();
+    }
+    memcpy(target->data.data() + blockOffset, data, count);
+    memset(target->mask.data() + blockOffset, 1, count);
+}
+
+// sends an entry below once the one before it is done
+void Cache::startWrite(WriteBufferEntry &entry) {
+    uint32_t start = std::max(entry.addedCycle, writePortFree);
+    int latency = writeMaskedBelow(entry.blockAddress, entry.data.data(), entry.mask.data(), start);
+    entry.draining = true;
+    entry.doneCycle = start + std::max(latency, 1);
+    writePortFree = entry.doneCycle;
+}
+
+// starts and removes the entries whose turn has come by cycle
+void Cache::retireWrites(uint32_t cycle) {
+    while (!writeBuffer.empty()) {
+        WriteBufferEntry &head = writeBuffer.front();
+        if (!head.draining) {
+            if (std::max(head.addedCycle, writePortFree) > cycle) break;
+            startWrite(head);
+        }
+        if (head.doneCycle > cycle) break;
+        writeBuffer.erase(writeBuffer.begin());
+    }
+}
+
+// drains the buffer up to the last entry for blockAddress right away, and returns the cycle that entry is
+// done. cycle if the block has nothing in the buffer
+uint32_t Cache::flushWrites(uint32_t blockAddress, uint32_t cycle) {
+    size_t last = writeBuffer.size();
+    for (size_t i = 0; i < writeBuffer.size(); i++) {
+        if (writeBuffer[i].blockAddress == blockAddress) last = i;
+    }
+    if (last == writeBuffer.size()) return cycle;
+    for (size_t i = 0; i <= last; i++) {
+        if (!writeBuffer[i].draining) startWrite(writeBuffer[i]);
+    }
+    uint32_t done = std::max(writeBuffer[last].doneCycle, cycle);
+    writeBuffer.erase(writeBuffer.begin(), writeBuffer.begin() + last + 1);
+    return done;
+}
+
+// writes the bytes of a block set in mask to the level below, returns how long that took
+int Cache::writeMaskedBelow(uint32_t address, const uint8_t *data, const uint8_t *mask, uint32_t cycle) {
+    if (nextLevel) {
+        return nextLevel->acceptWrite(address, data, mask, cycle, this);
+    }
+    writeMaskedToMemory(address, data, mask);
     return missLatency;
 }
 
-int Cache::setCacheByte(uint32_t address, uint32_t value, uint32_t cycle) {
-    uint32_t addressCopy = address;
-    uint32_t addrTag = (ADDRESS_LEN - tagEnd) >> (ADDRESS_LEN-tagEnd) >> (tagStart);
-    addressCopy = address;
-    uint32_t addrIndex = (addressCopy << (ADDRESS_LEN - indexEnd)) >> (ADDRESS_LEN - indexEnd) >> indexStart;
-    addressCopy = address;
-    uint32_t blockOffset = addressCopy << (ADDRESS_LEN - offsetEnd) >> (ADDRESS_LEN - offsetEnd) >> offsetStart;
+// the MSHR still filling the block at blockAddress, NULL if there is none
+Cache::MSHR *Cache::findMSHR(uint32_t blockAddress, uint32_t cycle) {
+    for (MSHR &entry : mshrs) {
+        if (entry.readyCycle > cycle && entry.blockAddress == blockAddress) return &entry;
+    }
+    return NULL;
+}
+
+uint32_t Cache::getOutstandingMisses(uint32_t cycle) {
+    uint32_t outstanding = 0;
+    for (MSHR &entry : mshrs) {
+        if (entry.readyCycle > cycle) outstanding++;
+    }
+    return outstanding;
+}
 
-    // loop through blocks in the set, starting at startBlock
+uint64_t Cache::getOutstandingMisses(uint32_t cycle, uint32_t cycles, uint32_t &missCycles) {
+    // a miss is outstanding from now until its ready cycle, so it counts once per cycle of that stretch
+    uint64_t outstanding = 0;
+    missCycles = 0;
+    for (MSHR &entry : mshrs) {
+        if (entry.readyCycle <= cycle) continue;
+        uint32_t busy = std::min(entry.readyCycle - cycle, cycles);
+        outstanding += busy;
+        missCycles = std::max(missCycles, busy);
+    }
+    return outstanding;
+}
+
+uint32_t Cache::findWay(uint32_t tag, uint32_t addrIndex) {
+    uint32_t line = lineIndex(addrIndex, 0);
+    // iterate through each block in a set
+    for (uint32_t way = 0; way < assoc; way++, line++) {
+        if ((stateBits[line] & VALID_BIT) && tags[line] == tag) return way;
+    }
+    return assoc;
+}
+
+uint32_t Cache::cacheMiss(uint32_t address, uint32_t tag, uint32_t addrIndex, uint32_t cycle, int &latency) {
+    // 1. fetch the block from the level below, an inclusive level may invalidate lines here while doing so
+    // 2. fill an invalid line, or evict the one the replacement policy picks
+    // 3. write back the evicted block if it is dirty
+    // 4. overwrite data in cache
+    latency = fetchFromBelow(address & ~offsetMask, fillBuffer.data(), cycle);
+    uint32_t way = freeLine(addrIndex, cycle);
+    installBlock(addrIndex, way, tag, fillBuffer.data(), false);
+    return way;
+}
+
+// returns an invalid way of the set, evicting a block first if the set is full
+uint32_t Cache::freeLine(uint32_t addrIndex, uint32_t cycle) {
+    uint32_t way0 = lineIndex(addrIndex, 0);
     for (uint32_t i = 0; i < assoc; i++) {
-        if (metaDataBits[addrIndex][i].valid  && metaDataBits[addrIndex][i].tag == addrTag) { // WRITE HIT
-            if (metaDataBits[addrIndex][i].cycleReady > cycle) {
-                return missLatency; // we've hit before, but are emulating latency 
-            }
-            cacheData[addrIndex][i][blockOffset] = (uint8_t) value;
-            metaDataBits[addrIndex][i].dirty = 1;
-            updateLRU(addrIndex, i);
-            return 0;
+        if (!(stateBits[way0 + i] & VALID_BIT)) return i;
+    }
+    uint32_t way = policy->victim(addrIndex);
+    evictLine(addrIndex, way, cycle);
+    return way;
+}
+
+void Cache::evictLine(uint32_t addrIndex, uint32_t way, uint32_t cycle) {
+    uint32_t line = lineIndex(addrIndex, way);
+    uint8_t *block = blockPtr(addrIndex, way);
+    uint32_t address = lineAddress(addrIndex, way);
+    bool dirty = stateBits[line] & DIRTY_BIT;
+
+    // drop the line before passing the block on, so nothing that happens below can find it here
+    stateBits[line] = 0;
+    policy->invalidate(addrIndex, way);
+
+    if (inclusion == INCLUSIVE) {
+        // the block has to leave the levels above too, and a dirty copy there is newer than ours
+        for (Cache *upper : upperLevels) {
+            dirty |= upper->invalidateBlock(address, block);
         }
     }
 
-    // WRITE MISS
-    int newBlock = cacheMiss(address, addrTag, addrIndex, blockOffset);
-    cacheData[addrIndex][newBlock][blockOffset] = (uint8_t) value;
-    metaDataBits[addrIndex][newBlock].dirty = 1;
-    metaDataBits[addrIndex][newBlock].cycleReady = cycle + missLatency;
-    return missLatency;
+    if (nextLevel) {
+        // an exclusive level below keeps clean victims too
+        nextLevel->acceptEviction(address, block, dirty, cycle);
+    } else if (dirty) {
+        writeMemory(address, block, blockSize);
+    }
 }
 
-uint32_t Cache::cacheMiss(uint32_t address, uint32_t tag, uint32_t addrIndex, uint32_t blockOffset) {
-    // 1. replace appropriate block based on lru
-    // 2. check the dirty bit to see if we need to do write back)
-    // 3. execute write back
-    // 4. overwrite data in cache 
-    
-    uint32_t setBlock;
-    // compare each block in a set to see which one is LRU
-    if((metaDataBits[addrIndex][0].lru > metaDataBits[addrIndex][1].lru) || (cacheType == TWO_WAY_SET_ASSOC && !metaDataBits[addrIndex][1].valid)) {
-        setBlock = 1;
+// writes a dirty block back to the next level, or to main memory if this is the last level
+void Cache::writeBelow(uint32_t address, const uint8_t *data, uint32_t cycle) {
+    if (nextLevel) {
+        nextLevel->acceptEviction(address, data, true, cycle);
     } else {
-        setBlock = 0;
+        writeMemory(address, data, blockSize);
+    }
+}
+
+void Cache::installBlock(uint32_t addrIndex, uint32_t way, uint32_t tag, const uint8_t *data, bool dirty) {
+    uint32_t line = lineIndex(addrIndex, way);
+    memcpy(blockPtr(addrIndex, way), data, blockSize);
+    tags[line] = tag;
+    stateBits[line] = dirty ? (VALID_BIT | DIRTY_BIT) : VALID_BIT;
+    policy->insert(addrIndex, way);
+}
+
+// reads a whole block from the next level, or from main memory if this is the last level
+int Cache::fetchFromBelow(uint32_t address, uint8_t *data, uint32_t cycle) {
+    // stores to the block still in the write buffer have to get below before it is read from there
+    int wait = 0;
+    if (!writeBuffer.empty()) {
+        wait = flushWrites(address, cycle) - cycle;
+    }
+    if (nextLevel) {
+        return wait + nextLevel->fetchBlock(address, data, cycle + wait);
+    }
+    readMemory(address, data, blockSize);
+    return wait + missLatency;
+}
+
+void Cache::setNextLevel(Cache *next) {
+    nextLevel = next;
+    next->upperLevels.push_back(this);
+}
+
+// hands a clean copy of the block holding address to the level above and returns how many cycles that took.
+// shared levels aren't retried like the L1s, so each call counts exactly one hit or miss
+int Cache::fetchBlock(uint32_t address, uint8_t *data, uint32_t cycle) {
+    uint32_t addrTag = address >> tagStart;
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t way = findWay(addrTag, addrIndex);
+
+    if (way < assoc) {
+        hits++;
+        uint32_t line = lineIndex(addrIndex, way);
+        memcpy(data, blockPtr(addrIndex, way), blockSize);
+        if (inclusion == EXCLUSIVE) {
+            // the block moves up and its line is freed. the L1s aren't coherent with each other, so a
+            // dirty block is written back first rather than handed to whichever L1 asked for it
+            bool dirty = stateBits[line] & DIRTY_BIT;
+            stateBits[line] = 0;
+            policy->invalidate(addrIndex, way);
+            if (dirty) {
+                writeBelow(address, blockPtr(addrIndex, way), cycle);
+            }
+        } else {
+            policy->touch(addrIndex, way);
+        }
+        return hitLatency;
     }
 
-    // check if dirty, if so then write-back
-    if (metaDataBits[addrIndex][setBlock].dirty) {
-        uint32_t memAddr = (metaDataBits[addrIndex][setBlock].tag << tagStart) | (addrIndex << indexStart);
-        // is this correct?????
-        // loop by each byte and set memory based on whats written in cache data 
-        for(uint32_t byteOffset = 0; byteOffset < blockSize; byteOffset++){
-            mainMem->setMemValue(memAddr + byteOffset, (uint32_t) cacheData[addrIndex][setBlock][byteOffset], BYTE_SIZE);
+    misses++;
+    if (inclusion == EXCLUSIVE) {
+        // blocks only come in as victims from above, so a fill passes straight through
+        return hitLatency + fetchFromBelow(address, data, cycle);
+    }
+    int latency;
+    way = cacheMiss(address, addrTag, addrIndex, cycle, latency);
+    memcpy(data, blockPtr(addrIndex, way), blockSize);
+    return hitLatency + latency;
+}
+
+// takes a block evicted from the level above. a clean block is only kept by an exclusive cache,
+// otherwise this level or memory already holds the same data
+void Cache::acceptEviction(uint32_t address, const uint8_t *data, bool dirty, uint32_t cycle) {
+    uint32_t addrTag = address >> tagStart;
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t way = findWay(addrTag, addrIndex);
+
+    if (way < assoc) {
+        if (dirty) {
+            memcpy(blockPtr(addrIndex, way), data, blockSize);
+            stateBits[lineIndex(addrIndex, way)] |= DIRTY_BIT;
         }
+        return;
+    }
+    if (!dirty && inclusion != EXCLUSIVE) return;
+
+    way = freeLine(addrIndex, cycle);
+    installBlock(addrIndex, way, addrTag, data, dirty);
+}
+
+// takes the bytes set in mask from the write buffer of source. the block is filled first on a miss, except
+// in an exclusive cache, where the block may be held above and the write goes on below instead
+int Cache::acceptWrite(uint32_t address, const uint8_t *data, const uint8_t *mask, uint32_t cycle, Cache *source) {
+    uint32_t addrTag = address >> tagStart;
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t way = findWay(addrTag, addrIndex);
+    int latency = hitLatency;
 
-        // mainMem->setMemValue(address, cacheData[addrIndex][setBlock][blockOffset], BYTE_SIZE);
-    }
-  
-    uint32_t blockStartMemAddr = (address >> offsetEnd) << offsetEnd; // removing byte offset from address
-    // loop by each byte read from memory and write it into cache to over write data
-     for (uint32_t byteOffset = 0; byteOffset < blockSize; byteOffset++) {
-        uint32_t temp;
-        mainMem->getMemValue(blockStartMemAddr + byteOffset, temp, BYTE_SIZE);
-        cacheData[addrIndex][setBlock][byteOffset] = (uint8_t) temp;
-    }
-    // cacheData[addrIndex][setBlock][blockOffset] = mainMem->getMemValue(address, value, BYTE_SIZE);
-    metaDataBits[addrIndex][setBlock].dirty = 0;
-    metaDataBits[addrIndex][setBlock].valid = 1;
-    updateLRU(addrIndex, setBlock);
-    metaDataBits[addrIndex][setBlock].tag = tag;
-    return setBlock;
-    
-}
-
-void Cache::updateLRU(int addrIndex, int recentlyUsed){
-    for(uint32_t i = 0; i < assoc; i++) {
-        if(metaDataBits[addrIndex][recentlyUsed].lru > metaDataBits[addrIndex][recentlyUsed].lru) {
-            metaDataBits[addrIndex][i].lru -= 1;
+    if (way < assoc) {
+        hits++;
+        policy->touch(addrIndex, way);
+    } else if (inclusion == EXCLUSIVE) {
+        // the write leaves a copy in another cache above out of date, and evicting that copy would put it
+        // back here as if it were current. source's own copy has the write in it already
+        misses++;
+        for (Cache *upper : upperLevels) {
+            if (upper != source && upper->invalidateBlock(address, fillBuffer.data())) {
+                writeBelow(address, fillBuffer.data(), cycle);
+            }
+        }
+        return hitLatency + writeMaskedBelow(address, data, mask, cycle);
+    } else {
+        misses++;
+        int fill;
+        way = cacheMiss(address, addrTag, addrIndex, cycle, fill);
+        latency += fill;
+    }
+
+    uint8_t *block = blockPtr(addrIndex, way);
+    for (uint32_t i = 0; i < blockSize; i++) {
+        if (mask[i]) block[i] = data[i];
+    }
+    stateBits[lineIndex(addrIndex, way)] |= DIRTY_BIT;
+    return latency;
+}
+
+// drops the block holding address from this cache and every cache above it.
+// returns true if any of them had it dirty, with the newest copy left in data
+bool Cache::invalidateBlock(uint32_t address, uint8_t *data) {
+    uint32_t addrTag = address >> tagStart;
+    uint32_t addrIndex = (address >> indexStart) & indexMask;
+    uint32_t way = findWay(addrTag, addrIndex);
+    bool dirty = false;
+
+    if (way < assoc) {
+        uint32_t line = lineIndex(addrIndex, way);
+        if (stateBits[line] & DIRTY_BIT) {
+            memcpy(data, blockPtr(addrIndex, way), blockSize);
+            dirty = true;
         }
+        stateBits[line] = 0;
+        policy->invalidate(addrIndex, way);
     }
-    metaDataBits[addrIndex][recentlyUsed].lru = assoc - 1; 
+    // copies further up are newer than this one, so they are merged last
+    for (Cache *upper : upperLevels) {
+        dirty |= upper->invalidateBlock(address, data);
+    }
+    return dirty;
 }
 
 uint32_t Cache::getHits() {
@@ -235,28 +815,129 @@ uint32_t Cache::getMisses() {
     return misses;
 }
 
+uint32_t Cache::getMergedMisses() {
+    return mergedMisses;
+}
+
+uint32_t Cache::getMshrFullStalls() {
+    return mshrFullStalls;
+}
+
+uint32_t Cache::getPrefetchesIssued() {
+    return prefetchesIssued;
+}
+
+uint32_t Cache::getUsefulPrefetches() {
+    return usefulPrefetches;
+}
+
+uint32_t Cache::getLatePrefetches() {
+    return latePrefetches;
+}
+
+uint32_t Cache::getPollutingPrefetches() {
+    return pollutingPrefetches;
+}
+
+uint32_t Cache::getBufferedWrites() {
+    return bufferedWrites;
+}
+
+uint32_t Cache::getCoalescedWrites() {
+    return coalescedWrites;
+}
+
+uint32_t Cache::getWriteBufferStalls() {
+    return writeBufferStalls;
+}
+
+// writeback to memory all cache blocks that have a set valid/dirty bit.
+// this bypasses the levels below, so a hierarchy has to be drained from the bottom up
 void Cache::drain() {
+    // the levels below are drained first, so stores still in the write buffer go straight to memory.
+    // an entry that is already draining has reached the level below
+    for (WriteBufferEntry &entry : writeBuffer) {
+        if (!entry.draining) {
+            writeMaskedToMemory(entry.blockAddress, entry.data.data(), entry.mask.data());
+        }
+    }
+    writeBuffer.clear();
     for (uint32_t setNum = 0; setNum < numSets; setNum++) {
         for(uint32_t i = 0; i< assoc; i++){
-            if (metaDataBits[setNum][i].valid && metaDataBits[setNum][i].dirty) {
-                uint32_t memAddr = (metaDataBits[setNum][i].tag << tagStart) | (setNum << indexStart);
-                for (uint32_t byte_offset = 0; byte_offset < blockSize; byte_offset++) {
-                    mainMem->setMemValue(memAddr + byte_offset, (uint32_t) cacheData[setNum][i][byte_offset], BYTE_SIZE);
-                }   
+            uint32_t line = lineIndex(setNum, i);
+            if ((stateBits[line] & VALID_BIT) && (stateBits[line] & DIRTY_BIT)) {
+                writeMemory(lineAddress(setNum, i), blockPtr(setNum, i), blockSize);
             }
         }
     }
 }
 
-Cache::~Cache(){
-    metaDataBits.clear();
-    cacheData.clear();   
+void Cache::save(CheckpointWriter &out) {
+    out.write(cacheData, (size_t)numSets * assoc * blockSize);
+    out.putVector(tags);
+    out.putVector(stateBits);
+    out.putVector(cycleReady);
+    out.put(hits);
+    out.put(misses);
+    out.putVector(mshrs);
+    out.put(mergedMisses);
+    out.put(mshrFullStalls);
+    if (prefetcher) prefetcher->save(out);
+    out.putVector(pollutionFilter);
+    out.put(prefetchesIssued);
+    out.put(usefulPrefetches);
+    out.put(latePrefetches);
+    out.put(pollutingPrefetches);
+    out.put<uint64_t>(writeBuffer.size());
+    for (WriteBufferEntry &entry : writeBuffer) {
+        out.put(entry.blockAddress);
+        out.put(entry.addedCycle);
+        out.put(entry.draining);
+        out.put(entry.doneCycle);
+        out.putVector(entry.data);
+        out.putVector(entry.mask);
+    }
+    out.put(writePortFree);
+    out.put(bufferedWrites);
+    out.put(coalescedWrites);
+    out.put(writeBufferStalls);
+    policy->save(out);
 }
 
-// Cache *createCache(CacheConfig config, MemoryStore *mem) {
-//     return new Cache(config, mem);
-// }
+void Cache::load(CheckpointReader &in) {
+    in.read(cacheData, (size_t)numSets * assoc * blockSize);
+    in.getVector(tags);
+    in.getVector(stateBits);
+    in.getVector(cycleReady);
+    in.get(hits);
+    in.get(misses);
+    in.getVector(mshrs);
+    in.get(mergedMisses);
+    in.get(mshrFullStalls);
+    if (prefetcher) prefetcher->load(in);
+    in.getVector(pollutionFilter);
+    in.get(prefetchesIssued);
+    in.get(usefulPrefetches);
+    in.get(latePrefetches);
+    in.get(pollutingPrefetches);
+    writeBuffer.resize(in.readSize());
+    for (WriteBufferEntry &entry : writeBuffer) {
+        in.get(entry.blockAddress);
+        in.get(entry.addedCycle);
+        in.get(entry.draining);
+        in.get(entry.doneCycle);
+        in.getVector(entry.data);
+        in.getVector(entry.mask);
+    }
+    in.get(writePortFree);
+    in.get(bufferedWrites);
+    in.get(coalescedWrites);
+    in.get(writeBufferStalls);
+    policy->load(in);
+}
 
-// void deleteCache(Cache *cache) {
-//     delete cache;
-// }
+Cache::~Cache(){
+    delete policy;
+    delete prefetcher;
+    free(cacheData);
+}
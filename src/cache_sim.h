@@ -1,49 +1,173 @@
 #include <vector>
+#include "replacement_policy.h"
+#include "prefetcher.h"
 
 using std::vector;
 
+class CheckpointWriter;
+class CheckpointReader;
+class MemoryImage;
 
-struct metaData {
-    bool valid;
-    bool dirty; 
-    uint32_t tag;
-    uint32_t lru;
-    uint32_t cycleReady;
-};
+// bits kept per cache line in stateBits
+#define VALID_BIT 0x1
+#define DIRTY_BIT 0x2
+// filled by a prefetch and not used by a demand access yet
+#define PREFETCHED_BIT 0x4
+
+// returned by issueLoad and issueStore when the access needs an MSHR and none is free
+#define MSHR_FULL -1
+// returned by issueStore when the store needs a write buffer entry and none is free
+#define WRITE_BUFFER_FULL -2
 
 class Cache {
     private:
-        //vector<uint32_t> tags;
-        //vector<uint32_t> valid;
-        // cacheBlock is uint8_t array
-        // index is brings us to right block and block offset brings us to the right byte 
-        vector<vector<vector<uint8_t>>> cacheData;
-        // metadata unique block, struct of tag, valid , dirty bits
-        // dimensions of 2d array is numSet x 2 blocks for 2 way
-        // dimensions fof 2d array is just index and 1 block for direct map
-        vector<vector<metaData>> metaDataBits;
+        // block bytes for every line, one aligned buffer laid out as [set][way][offset]
+        uint8_t *cacheData;
+        // per line metadata, each indexed by set * assoc + way
+        vector<uint32_t> tags;
+        vector<uint8_t> stateBits;
+        vector<uint32_t> cycleReady;
         uint32_t hits;
         uint32_t misses;
-        uint32_t address;
         CacheType cacheType;
-        // write back cache 
-        // dirty bit set everytime write into cache line 
-        // if dirty bit is set + valid bit, throw out block and update block in memory 
-        uint8_t lru;
+        // write back cache
+        // dirty bit set everytime write into cache line
+        // if dirty bit is set + valid bit, throw out block and update block in memory
         uint32_t numBlocks, numSets, blockSize, cacheSize, missLatency, assoc;
-        int offsetStart, offsetEnd, indexStart, indexEnd, tagStart, tagEnd;
-        // funcitons to set valid bit, lru, dirty, 
-        int setCacheByte(uint32_t address, uint32_t value, uint32_t cycle);
-        int getCacheByte(uint32_t address, uint32_t & value, uint32_t cycle);
-        void updateLRU(int addrIndex, int recentlyUsed);
+        // only used when this cache sits below another one
+        uint32_t hitLatency;
+        InclusionPolicy inclusion;
+        // the level below, NULL when this cache talks to main memory directly
+        Cache *nextLevel;
+        // the levels directly above, an inclusive cache invalidates its victims there
+        vector<Cache *> upperLevels;
+        // a block on its way in, held until a line has been freed for it
+        vector<uint8_t> fillBuffer;
+        // miss status holding registers of a non-blocking cache, one per block fill in flight.
+        // an entry is free once its fill is done
+        struct MSHR {
+            uint32_t blockAddress;
+            uint32_t readyCycle;
+        };
+        vector<MSHR> mshrs;
+        uint32_t mergedMisses, mshrFullStalls;
+        // NULL without prefetching
+        Prefetcher *prefetcher;
+        vector<uint32_t> prefetchRequests;
+        // recent victims of prefetches as block numbers + 1, indexed by block number. a demand miss
+        // on one of them means the prefetch that evicted it polluted the cache
+        vector<uint32_t> pollutionFilter;
+        uint32_t prefetchesIssued, usefulPrefetches, latePrefetches, pollutingPrefetches;
+        WritePolicy writePolicy;
+        bool writeAllocate;
+        // stores on their way below, oldest first. an entry holds the bytes written to one block and takes
+        // in later stores to it until it starts draining. its data goes below when it starts
+        struct WriteBufferEntry {
+            uint32_t blockAddress;
+            uint32_t addedCycle;
+            bool draining;
+            uint32_t doneCycle;
+            vector<uint8_t> data;
+            vector<uint8_t> mask;
+        };
+        vector<WriteBufferEntry> writeBuffer;
+        // 0 when neither write-through nor no-write-allocate needs a buffer
+        uint32_t writeBufferDepth;
+        // the buffer drains one entry at a time, this is when the one draining now is done
+        uint32_t writePortFree;
+        uint32_t bufferedWrites, coalescedWrites, writeBufferStalls;
+        // address = | tag | index | offset |, tag starts at bit tagStart and index at bit indexStart
+        uint32_t offsetMask, indexMask;
+        int indexStart, tagStart;
+        // position of a line in the metadata arrays
+        uint32_t lineIndex(uint32_t addrIndex, uint32_t way) { return addrIndex * assoc + way; }
+        // first byte of a line's block in cacheData
+        uint8_t *blockPtr(uint32_t addrIndex, uint32_t way) { return cacheData + (size_t)lineIndex(addrIndex, way) * blockSize; }
+        int accessBytes(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc);
+        int accessBlock(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc);
+        void recordAccess(int result);
+        uint32_t cacheMiss(uint32_t address, uint32_t tag, uint32_t addrIndex, uint32_t cycle, int &latency);
+        // the way holding tag in a set, assoc if it isn't cached
+        uint32_t findWay(uint32_t tag, uint32_t addrIndex);
+        // address of the first byte of a line's block
+        uint32_t lineAddress(uint32_t addrIndex, uint32_t way) { return (tags[lineIndex(addrIndex, way)] << tagStart) | (addrIndex << indexStart); }
+        uint32_t freeLine(uint32_t addrIndex, uint32_t cycle);
+        void evictLine(uint32_t addrIndex, uint32_t way, uint32_t cycle);
+        void installBlock(uint32_t addrIndex, uint32_t way, uint32_t tag, const uint8_t *data, bool dirty);
+        int fetchFromBelow(uint32_t address, uint8_t *data, uint32_t cycle);
+        void writeBelow(uint32_t address, const uint8_t *data, uint32_t cycle);
+        MSHR *findMSHR(uint32_t blockAddress, uint32_t cycle);
+        int issueAccess(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc);
+        int issueBlock(uint32_t address, uint8_t *data, uint32_t count, uint32_t cycle, bool isWrite, uint32_t pc);
+        bool firstPrefetchUse(uint32_t line, uint32_t cycle);
+        void checkPollution(uint32_t address);
+        void trainPrefetcher(uint32_t pc, uint32_t address, bool trigger, uint32_t cycle);
+        void prefetchBlock(uint32_t address, uint32_t cycle);
+        bool buffersWrite(uint32_t address, uint32_t cycle, bool blocking);
+        int writeBufferWait(uint32_t address, uint32_t count, uint32_t cycle, bool blocking);
+        void bufferWrite(uint32_t address, const uint8_t *data, uint32_t count, uint32_t cycle);
+        void startWrite(WriteBufferEntry &entry);
+        void retireWrites(uint32_t cycle);
+        uint32_t flushWrites(uint32_t blockAddress, uint32_t cycle);
+        int writeMaskedBelow(uint32_t address, const uint8_t *data, const uint8_t *mask, uint32_t cycle);
+        int readMemory(uint32_t address, uint8_t *data, uint32_t size);
+        int writeMemory(uint32_t address, const uint8_t *data, uint32_t size);
+        void writeMaskedToMemory(uint32_t address, const uint8_t *data, const uint8_t *mask);
+        // picks the line to evict when a set is full
+        ReplacementPolicy *policy;
         MemoryStore *mainMem;
+        // mainMem as a MemoryImage, NULL when the driver didn't pass one
+        MemoryImage *memoryImage;
+        // prefetches stop short of here, the end of the address space mainMem holds
+        uint64_t memoryEnd;
     public:
-        Cache(CacheConfig &cache, MemoryStore *mem);
-        int getCacheValue(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle);
-        int setCacheValue(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle);
+        // 0 if a cache can be built from config, otherwise prints why and returns -EINVAL
+        static int checkConfig(const CacheConfig &config);
+        // config has to pass checkConfig. image is mem seen as a MemoryImage, NULL for a store that is only a MemoryStore
+        Cache(CacheConfig &cache, MemoryStore *mem, MemoryImage *image = NULL);
+        Cache(const Cache &) = delete;
+        Cache &operator=(const Cache &) = delete;
+        // pc is the instruction making the access, for the prefetcher
+        int getCacheValue(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle, uint32_t pc = 0);
+        int setCacheValue(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle, uint32_t pc = 0);
+        // non-blocking accesses, see CacheConfig::mshrs. the data moves right away and the return value is
+        // how many cycles it takes to really get there, or MSHR_FULL if the access has to wait for an MSHR
+        int issueLoad(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle, uint32_t pc = 0);
+        int issueStore(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle, uint32_t pc = 0);
+        bool isNonBlocking() { return !mshrs.empty(); }
+        uint32_t getOutstandingMisses(uint32_t cycle);
+        // getOutstandingMisses summed over the cycles starting at cycle, with no new misses issued in them.
+        // missCycles is how many of them had any miss outstanding
+        uint64_t getOutstandingMisses(uint32_t cycle, uint32_t cycles, uint32_t & missCycles);
+        uint32_t getMergedMisses();
+        uint32_t getMshrFullStalls();
+        // prefetches sent, and how many of them were used in time, used while still in flight,
+        // or pushed out a block that was missed on later
+        uint32_t getPrefetchesIssued();
+        uint32_t getUsefulPrefetches();
+        uint32_t getLatePrefetches();
+        uint32_t getPollutingPrefetches();
+        bool isPrefetching() { return prefetcher != NULL; }
+        // stores that went into the write buffer, how many of them were merged into an entry already
+        // there, and the cycles stores waited for a free entry
+        uint32_t getBufferedWrites();
+        uint32_t getCoalescedWrites();
+        uint32_t getWriteBufferStalls();
+        bool hasWriteBuffer() { return writeBufferDepth != 0; }
+        // puts next below this cache, misses fill from it and evicted blocks go to it
+        void setNextLevel(Cache *next);
+        // calls from the level above
+        int fetchBlock(uint32_t address, uint8_t *data, uint32_t cycle);
+        void acceptEviction(uint32_t address, const uint8_t *data, bool dirty, uint32_t cycle);
+        bool invalidateBlock(uint32_t address, uint8_t *data);
+        int acceptWrite(uint32_t address, const uint8_t *data, const uint8_t *mask, uint32_t cycle, Cache *source);
         uint32_t getHits();
         uint32_t getMisses();
-        uint32_t cacheMiss(uint32_t address, uint32_t tag, uint32_t addrIndex, uint32_t blockOffset);
+        uint32_t getBlockSize() { return blockSize; }
         void drain();
+        // the lines and everything in flight, the counters, and what the policy and prefetcher have learned,
+        // for a checkpoint. load needs a cache built from the same config as the one saved
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
         ~Cache();
-};
\ No newline at end of file
+};
@@ -0,0 +1,46 @@
+#include <string.h>
+#include <errno.h>
+#include "checkpoint.h"
+
+CheckpointWriter::CheckpointWriter() : stream(&file) {}
+
+int CheckpointWriter::open(const char *path) {
+    file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file) return -EBADF;
+    file.write(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    return 0;
+}
+
+void CheckpointWriter::openBuffer(std::stringstream &buffer) {
+    stream = &buffer;
+    buffer.write(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+}
+
+int CheckpointWriter::close() {
+    if (stream != &file) return *stream ? 0 : -EIO;
+    if (!file.is_open()) return 0;
+    file.flush();
+    bool failed = !file;
+    file.close();
+    return failed ? -EIO : 0;
+}
+
+CheckpointReader::CheckpointReader() : stream(&file), truncated(false), mismatched(false) {}
+
+int CheckpointReader::checkMagic() {
+    char magic[CHECKPOINT_MAGIC_SIZE];
+    if (!*stream || !stream->read(magic, CHECKPOINT_MAGIC_SIZE) || memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0) {
+        return -EBADF;
+    }
+    return 0;
+}
+
+int CheckpointReader::open(const char *path) {
+    file.open(path, std::ios::binary | std::ios::in);
+    return checkMagic();
+}
+
+int CheckpointReader::openBuffer(std::stringstream &buffer) {
+    stream = &buffer;
+    return checkMagic();
+}
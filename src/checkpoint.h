@@ -0,0 +1,106 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using std::vector;
+
+// a checkpoint file is CHECKPOINT_MAGIC followed by the state of each part of the simulator in a fixed order.
+// values are kept in the host's byte order, a checkpoint only loads into a simulator built from the same sources
+#define CHECKPOINT_MAGIC "MCK1"
+#define CHECKPOINT_MAGIC_SIZE 4
+// the most elements a sequence in a checkpoint can hold, a larger size means the file is corrupt
+#define CHECKPOINT_MAX_ELEMENTS (1u << 28)
+
+// writes the values of a checkpoint one after the other. put takes plain values and structs without pointers
+class CheckpointWriter {
+    private:
+        std::ofstream file;
+        // file, or the buffer given to openBuffer
+        std::ostream *stream;
+    public:
+        CheckpointWriter();
+        // returns -EBADF if the file can't be created
+        int open(const char *path);
+        // writes the checkpoint into buffer instead of a file
+        void openBuffer(std::stringstream &buffer);
+        void write(const void *data, size_t size) {
+            stream->write((const char *) data, size);
+        }
+        template <typename T> void put(const T &value) {
+            write(&value, sizeof(T));
+        }
+        // a vector or deque, its size first
+        template <typename C> void putSequence(const C &values) {
+            put<uint64_t>(values.size());
+            for (const auto &value : values) put(value);
+        }
+        template <typename T> void putVector(const vector<T> &values) {
+            put<uint64_t>(values.size());
+            write(values.data(), values.size() * sizeof(T));
+        }
+        // returns -EIO if any write failed
+        int close();
+};
+
+// reads back what a CheckpointWriter wrote, in the same order. A read past the end of the file marks the
+// checkpoint as truncated, the values read from then on are garbage
+class CheckpointReader {
+    private:
+        std::ifstream file;
+        // file, or the buffer given to openBuffer
+        std::istream *stream;
+        bool truncated;
+        bool mismatched;
+        int checkMagic();
+    public:
+        CheckpointReader();
+        // returns -EBADF if the file can't be read or isn't a checkpoint
+        int open(const char *path);
+        // reads a checkpoint a CheckpointWriter wrote into buffer, returns -EBADF if it isn't one
+        int openBuffer(std::stringstream &buffer);
+        void read(void *data, size_t size) {
+            if (truncated || size == 0) return;
+            stream->read((char *) data, size);
+            if ((size_t) stream->gcount() != size) truncated = true;
+        }
+        template <typename T> void get(T &value) {
+            read(&value, sizeof(T));
+        }
+        template <typename C> void getSequence(C &values) {
+            uint64_t size = readSize();
+            values.clear();
+            for (uint64_t i = 0; i < size; i++) {
+                typename C::value_type value;
+                get(value);
+                values.push_back(value);
+            }
+        }
+        template <typename T> void getVector(vector<T> &values) {
+            values.resize(readSize());
+            read(values.data(), values.size() * sizeof(T));
+        }
+        // a config the simulator was set up with, the checkpoint doesn't match it unless it saved the same
+        template <typename T> void expect(const T &value) {
+            T saved = value;
+            get(saved);
+            if (saved != value) mismatched = true;
+        }
+        uint64_t readSize() {
+            uint64_t size = 0;
+            get(size);
+            if (size > CHECKPOINT_MAX_ELEMENTS) {
+                truncated = true;
+                return 0;
+            }
+            return size;
+        }
+        bool isTruncated() { return truncated; }
+        bool isMismatched() { return mismatched; }
+};
+
+#endif
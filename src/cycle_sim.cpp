@@ -1,271 +1,24 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <string.h>
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <errno.h>
 #include <math.h> 
 #include "MemoryStore.h"
 #include "RegisterInfo.h"
 #include "EndianHelpers.h"
 #include "DriverFunctions.h"
-
-// CACHE
-
-#define ADDRESS_LEN 32 
-
-using std::vector;
-
-struct metaData {
-    bool valid;
-    bool dirty; 
-    uint32_t tag;
-    uint32_t lru;
-    uint32_t cycleReady;
-};
-
-class Cache {
-    private:
-        // stores cache data for each block accessed by index, assoc value, and block offset
-        vector<vector<vector<uint8_t>>> cacheData;
-        // metadata for each cache block accessed by index and set block number if applicable 
-        vector<vector<metaData>> metaDataBits;
-        uint32_t hits;
-        uint32_t misses;
-        CacheType cacheType;
-        uint32_t address, numBlocks, numSets, blockSize, cacheSize, missLatency, assoc;
-        int offsetStart, offsetEnd, indexStart, indexEnd, tagStart, tagEnd;
-        int setCacheByte(uint32_t address, uint32_t value, uint32_t cycle);
-        int getCacheByte(uint32_t address, uint32_t & value, uint32_t cycle);
-        uint32_t cacheMiss(uint32_t address, uint32_t tag, uint32_t addrIndex, uint32_t blockOffset);
-        void updateLRU(int addrIndex, int recentlyUsed);
-        MemoryStore *mainMem;
-    public:
-        Cache(CacheConfig &cache, MemoryStore *mem);
-        int getCacheValue(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle);
-        int setCacheValue(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle);
-        uint32_t getHits();
-        uint32_t getMisses();
-        void drain();
-        ~Cache();
-};
-
-// initialize once for I cache and D cache
-Cache::Cache(CacheConfig &config, MemoryStore *mem) {
-    hits = 0;
-    misses = 0;
-    blockSize = config.blockSize;
-    cacheSize= config.cacheSize;
-    missLatency = config.missLatency;
-    cacheType = config.type;
-    mainMem = mem;
-    numBlocks = cacheSize/blockSize;
-    if(cacheType == TWO_WAY_SET_ASSOC) {
-        assoc = 2;
-    } else {
-        assoc = 1;
-    }
-    if(cacheType == TWO_WAY_SET_ASSOC) {
-        numSets = numBlocks/2;
-    } else {
-        numSets = numBlocks;
-    }
-    for (uint32_t i = 0; i < numSets; i++) {
-        metaDataBits.emplace_back();
-        for (uint32_t j = 0; j < assoc; j++) {
-            metaDataBits[i].emplace_back();
-        }
-    }
-
-    for (uint32_t i = 0; i < numSets; i++) {
-        cacheData.emplace_back();        
-        for (uint32_t j = 0; j < assoc; j++) {
-            cacheData[i].emplace_back();
-            for (uint32_t k = 0; k<blockSize; k++) {
-                cacheData[i][j].emplace_back();
-            }
-        }
-    }
-
-
-    offsetStart = 0;
-    offsetEnd   = log2(blockSize);
-    indexStart  = log2(blockSize);
-    indexEnd    = indexStart + log2(numSets);
-    tagStart    = indexStart + log2(numSets);
-    tagEnd      = ADDRESS_LEN;
-    
-}
-
- // address given is the address of the first byte
-int Cache::getCacheValue(uint32_t address, uint32_t & value, MemEntrySize size, uint32_t cycle){
-    int result;
-    value = 0;
-
-    // look at each byte  
-    for(uint32_t i = 0; i< size; i++){
-        uint32_t byteAddr = address+i;
-        uint32_t byte;
-        result = getCacheByte(byteAddr, byte, cycle);
-        if(i ==0){
-            if(result == 0) {
-                hits++;
-            } else {
-                misses++;
-                hits--;
-            }
-        }
-        value = value | (byte << ((size-1-i)*8));
-    }
-    return result;
-}
-
-    
-
-int Cache::setCacheValue(uint32_t address, uint32_t value, MemEntrySize size, uint32_t cycle) {
-    uint32_t mask = 0xFF;
-    int result;
-    for (uint32_t i = 0; i < size; i++) {
-        uint32_t byte = (value & (mask << ((size-1-i)*8))) >> ((size-1-i)*8);
-        result = setCacheByte(address + i, byte, cycle);
-        if(i ==0){
-            if(result == 0) {
-                hits++;
-            } else {
-                misses++;
-                hits--;
-            }
-        }
-    }
-    return result;
-}
-
-int Cache::getCacheByte(uint32_t address, uint32_t & value, uint32_t cycle){
-    uint32_t addressCopy = address;
-    uint32_t addrTag = addressCopy << (ADDRESS_LEN - tagEnd) >> (ADDRESS_LEN-tagEnd) >> (tagStart);
-    addressCopy = address;
-    uint32_t addrIndex = addressCopy << (ADDRESS_LEN - indexEnd) >> (ADDRESS_LEN - indexEnd) >> indexStart;
-    addressCopy = address;
-    uint32_t blockOffset = addressCopy << (ADDRESS_LEN - offsetEnd) >> (ADDRESS_LEN - offsetEnd) >> offsetStart;
-
-        // iterate through each block in a set
-       for (uint32_t i = 0; i< assoc; i++) {
-        // read Hit
-        if(metaDataBits[addrIndex][i].valid  && metaDataBits[addrIndex][i].tag == addrTag) {
-            if (metaDataBits[addrIndex][i].cycleReady > cycle) return missLatency;
-            value = cacheData[addrIndex][i][blockOffset];
-            updateLRU(addrIndex, i);
-            return 0;
-        } 
-    }
-    // gets data from memory after a cache miss 
-    uint32_t newBlock = cacheMiss(addressCopy, addrTag, addrIndex, blockOffset);
-    value = cacheData[addrIndex][newBlock][blockOffset];
-    metaDataBits[addrIndex][newBlock].cycleReady = cycle + missLatency;
-    return missLatency;
-}
-
-int Cache::setCacheByte(uint32_t address, uint32_t value, uint32_t cycle) {
-    uint32_t addressCopy = address;
-    uint32_t addrTag = (ADDRESS_LEN - tagEnd) >> (ADDRESS_LEN-tagEnd) >> (tagStart);
-    addressCopy = address;
-    uint32_t addrIndex = (addressCopy << (ADDRESS_LEN - indexEnd)) >> (ADDRESS_LEN - indexEnd) >> indexStart;
-    addressCopy = address;
-    uint32_t blockOffset = addressCopy << (ADDRESS_LEN - offsetEnd) >> (ADDRESS_LEN - offsetEnd) >> offsetStart;
-
-    // loop through blocks in the set, starting at startBlock
-    for (uint32_t i = 0; i < assoc; i++) {
-        // WRITE HIT
-        if (metaDataBits[addrIndex][i].valid  && metaDataBits[addrIndex][i].tag == addrTag) { 
-            if (metaDataBits[addrIndex][i].cycleReady > cycle) {
-                return missLatency; // we've hit before, but are emulating latency 
-            }
-            cacheData[addrIndex][i][blockOffset] = (uint8_t) value;
-            metaDataBits[addrIndex][i].dirty = 1;
-            updateLRU(addrIndex, i);
-            return 0;
-        }
-    }
-
-    // WRITE MISS
-    uint32_t newBlock = cacheMiss(address, addrTag, addrIndex, blockOffset);
-    cacheData[addrIndex][newBlock][blockOffset] = (uint8_t) value;
-    metaDataBits[addrIndex][newBlock].dirty = 1;
-    metaDataBits[addrIndex][newBlock].cycleReady = cycle + missLatency;
-    return missLatency;
-}
-
-uint32_t Cache::cacheMiss(uint32_t address, uint32_t tag, uint32_t addrIndex, uint32_t blockOffset) { 
-    uint32_t setBlock;
-    // compare each block in a set to see which one is LRU
-    if((metaDataBits[addrIndex][0].lru > metaDataBits[addrIndex][1].lru) || (cacheType == TWO_WAY_SET_ASSOC && !metaDataBits[addrIndex][1].valid)) {
-        setBlock = 1;
-    } else {
-        setBlock = 0;
-    }
-
-    // check if dirty, if so then write-back
-    if (metaDataBits[addrIndex][setBlock].dirty) {
-        uint32_t memAddr = (metaDataBits[addrIndex][setBlock].tag << tagStart) | (addrIndex << indexStart);
-        for(uint32_t byteOffset = 0; byteOffset < blockSize; byteOffset++){
-            mainMem->setMemValue(memAddr + byteOffset, (uint32_t) cacheData[addrIndex][setBlock][byteOffset], BYTE_SIZE);
-        }
-    }
-    
-    uint32_t blockStartMemAddr = (address >> offsetEnd) << offsetEnd; // removing byte offset from address
-
-    // loop by each byte read from memory and write it into cache to over write data
-     for (uint32_t byteOffset = 0; byteOffset < blockSize; byteOffset++) {
-        uint32_t temp;
-        mainMem->getMemValue(blockStartMemAddr + byteOffset, temp, BYTE_SIZE);
-        cacheData[addrIndex][setBlock][byteOffset] = (uint8_t) temp;
-    }
-    
-    metaDataBits[addrIndex][setBlock].dirty = 0;
-    metaDataBits[addrIndex][setBlock].valid = 1;
-    updateLRU(addrIndex, setBlock);
-    metaDataBits[addrIndex][setBlock].tag = tag;
-    return setBlock;
-    
-}
-
-// for a 2 way set, updates most recently used cache block as a one and least recently used as zero
-void Cache::updateLRU(int addrIndex, int recentlyUsed){
-    for(uint32_t i = 0; i < assoc; i++) {
-        if(metaDataBits[addrIndex][i].lru > metaDataBits[addrIndex][recentlyUsed].lru) {
-            metaDataBits[addrIndex][i].lru -= 1;
-        }
-    }
-    metaDataBits[addrIndex][recentlyUsed].lru = assoc - 1; 
-}
-
-uint32_t Cache::getHits() {
-    return hits;
-}
-
-uint32_t Cache::getMisses() {
-    return misses;
-}
-
-// writeback to memory all cache blocks that have a set valid/dirty bit
-void Cache::drain() {
-    for (uint32_t setNum = 0; setNum < numSets; setNum++) {
-        for(uint32_t i = 0; i< assoc; i++){
-            if (metaDataBits[setNum][i].valid && metaDataBits[setNum][i].dirty) {
-                uint32_t memAddr = (metaDataBits[setNum][i].tag << tagStart) | (setNum << indexStart);
-                for (uint32_t byte_offset = 0; byte_offset < blockSize; byte_offset++) {
-                    mainMem->setMemValue(memAddr + byte_offset, (uint32_t) cacheData[setNum][i][byte_offset], BYTE_SIZE);
-                }   
-            }
-        }
-    }
-}
-
-Cache::~Cache(){
-    metaDataBits.clear();
-    cacheData.clear();   
-}
+#include "cache_sim.h"
+#include "stack_profile.h"
+#include "trace.h"
+#include "branch_predictor.h"
+#include "checkpoint.h"
+#include "memory_image.h"
+#include "simulator.h"
 
 // SIMULATOR
 
@@ -355,52 +108,6 @@ enum FUN_IDS
     FUN_SUBU = 0x23
 };
 
-//Static global variables...
-static uint32_t regs[NUM_REGS];
-
-
-void fillRegisterState(RegisterInfo &reg)
-{
-    reg.at = regs[REG_AT];
-
-    for (int i = 0; i < V_REG_SIZE; i++)
-    {
-        reg.v[i] = regs[i + REG_V0];
-    }
-
-    for (int i = 0; i < A_REG_SIZE; i++)
-    {
-        reg.a[i] = regs[i + REG_A0];
-    }
-
-    //Remember, t8 and t9 are handled separately...
-    for (int i = 0; i < T_REG_SIZE - 2; i++)
-    {
-        reg.t[i] = regs[i + REG_T0];
-    }
-
-    for (int i = 0; i < S_REG_SIZE; i++)
-    {
-        reg.s[i] = regs[i + REG_S0];
-    }
-
-    //t8 and t9...
-    for (int i = 0; i < 2; i++)
-    {
-        reg.t[i + 8] = regs[i + REG_T8];
-    }
-
-    for (int i = 0; i < K_REG_SIZE; i++)
-    {
-        reg.k[i] = regs[i + REG_K0];
-    }
-
-    reg.gp = regs[REG_GP];
-    reg.sp = regs[REG_SP];
-    reg.fp = regs[REG_FP];
-    reg.ra = regs[REG_RA];
-}
-
 enum INST_TYPE
 {
     R,
@@ -448,7 +155,7 @@ struct InstructionData
     } data;
     INST_TYPE tag;
 
-    uint8_t rs()
+    uint8_t rs() const
     {
         switch (this->tag)
         {
@@ -461,7 +168,7 @@ struct InstructionData
         }
     }
 
-    uint8_t rt()
+    uint8_t rt() const
     {
         switch (this->tag)
         {
@@ -522,24 +229,382 @@ struct InstructionData
     }
 };
 
+// what a cycle is charged to in the CPI stack. A bubble carries the cause it was inserted for down the
+// pipeline, the cycle it reaches writeback in goes to that cause
+enum CycleCause : uint8_t
+{
+    // the pipeline filling up, draining after the halt or before a fast-forward, and the nops and the halt,
+    // which aren't counted as instructions either
+    CAUSE_OTHER,
+    // an instruction, the cycles it writes back in are base cycles
+    CAUSE_BASE,
+    CAUSE_ICACHE,
+    CAUSE_DCACHE,
+    // ID waiting for a load in EX
+    CAUSE_LOAD_USE,
+    // a branch or jr in ID waiting for its operands
+    CAUSE_BRANCH,
+    // fetch went past the delay slot of a branch or jump the wrong way
+    CAUSE_MISPREDICT,
+    // what an exception squashed
+    CAUSE_EXCEPTION,
+    CYCLE_CAUSES
+};
+
+// CAUSE_BASE for the cycle an instruction retires in, CAUSE_OTHER for a nop or the halt
+CycleCause baseCause(uint32_t instruction)
+{
+    return instruction != 0 && instruction != 0xfeedfeed ? CAUSE_BASE : CAUSE_OTHER;
+}
+
 struct IFID
 {
     uint32_t pc;
     uint32_t instruction;
+    // false for a bubble
+    bool fetched;
+    // with a predictor, where fetch goes after this instruction's delay slot, and whether that address
+    // comes off the return address stack
+    uint32_t predictedPc;
+    bool popsReturn;
+    // CAUSE_BASE for an instruction, why a bubble is empty
+    CycleCause cause;
 };
 
 struct IDEX
 {
+    uint32_t pc;
     uint32_t instruction;
     InstructionData instructionData;
     uint64_t regWriteValue = UINT64_MAX;
     uint8_t regToWrite;
+    uint32_t predictedPc;
+    CycleCause cause;
 };
 
 using EXMEM = IDEX;
 
 using MEMWB = EXMEM;
 
+enum CycleStatus
+{
+    NOT_HALTED,
+    HALTED
+};
+
+// instructions the decode table holds, direct mapped on the word address
+#define DECODE_TABLE_SIZE 1024
+
+// what ID does with an instruction besides reading its registers
+enum DecodeHandler
+{
+    // nothing, ALU operations, loads and stores
+    DECODE_PLAIN,
+    DECODE_JR,
+    DECODE_BRANCH,
+    DECODE_JUMP,
+    // an illegal opcode or function code, raises the exception
+    DECODE_ILLEGAL
+};
+
+// everything about an instruction that doesn't depend on the registers, decoded the first time its pc reaches ID
+struct DecodedInstruction
+{
+    uint32_t pc;
+    // a different word at the same pc, after a store to the code or in a bubble, is decoded again
+    uint32_t instruction;
+    InstructionData data;
+    DecodeHandler handler;
+    uint8_t regToWrite;
+    // the link address of a jal, UINT64_MAX otherwise
+    uint64_t regWriteValue;
+    // where a taken branch or a jump goes
+    uint32_t target;
+    bool valid;
+};
+
+// no instruction in flight writes the register, its value is in regs
+#define NO_PRODUCER UINT64_MAX
+
+// an instruction the out-of-order core fetched, waiting for rename
+struct FetchedInstruction
+{
+    uint32_t pc;
+    uint32_t instruction;
+    // where fetch went after this instruction's delay slot
+    uint32_t predictedPc;
+    uint32_t cycle;
+};
+
+// an instruction of the out-of-order core between rename and commit
+struct RobEntry
+{
+    uint64_t seq;
+    uint32_t pc;
+    uint32_t instruction;
+    // the register values are filled in once their producers are done
+    InstructionData data;
+    DecodeHandler handler;
+    uint8_t regToWrite;
+    // the result, UINT64_MAX when there is none
+    uint64_t value;
+    // the instructions in flight that write rs and rt, NO_PRODUCER once the value is in data
+    uint64_t rsProducer;
+    uint64_t rtProducer;
+    uint32_t predictedPc;
+    // a branch or jr once it executed: where it goes after its delay slot, and whether fetch went elsewhere
+    bool taken;
+    uint32_t nextPc;
+    bool mispredicted;
+    // the result can be used from doneCycle on
+    bool done;
+    uint32_t doneCycle;
+    // raised when the instruction reaches commit
+    bool exception;
+    bool isLoad;
+    bool isStore;
+    // stores know their address once they executed, younger loads wait for that
+    bool addressReady;
+    uint32_t address;
+    MemEntrySize size;
+};
+
+// the state of the out-of-order core. registers are renamed onto the reorder buffer: an instruction names each
+// source by the seq of the instruction in flight that writes it, and regs only changes when one commits
+struct OutOfOrderCore
+{
+    OutOfOrderConfig config;
+    std::deque<FetchedInstruction> fetchQueue;
+    // oldest first, the seqs follow each other without gaps
+    std::deque<RobEntry> rob;
+    uint64_t nextSeq;
+    // the youngest instruction in flight that writes each register
+    uint64_t producer[NUM_REGS];
+    // the instructions waiting to issue, and the loads and stores in flight, oldest first
+    std::vector<uint64_t> issueQueue;
+    std::deque<uint64_t> lsq;
+    // a blocking D-cache takes no other access until dcacheFreeCycle. a load that missed makes its access
+    // again then like in runCycle, and only gets its value if it wasn't squashed meanwhile
+    uint32_t dcacheFreeCycle;
+    bool retrying;
+    bool retryLive;
+    uint64_t retrySeq;
+    IData retryData;
+    MemEntrySize retrySize;
+    uint32_t retryPc;
+    // what an empty reorder buffer is charged to until an instruction from refillSeq on commits: the
+    // mispredict or exception that emptied it, CAUSE_OTHER otherwise. So is a head from squashSeq on,
+    // the branch and delay slot still to commit or the path fetched again
+    CycleCause refillCause;
+    uint64_t squashSeq;
+    uint64_t refillSeq;
+
+    OutOfOrderCore(OutOfOrderConfig &config) : config(config)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        fetchQueue.clear();
+        rob.clear();
+        nextSeq = 0;
+        std::fill(producer, producer + NUM_REGS, NO_PRODUCER);
+        issueQueue.clear();
+        lsq.clear();
+        dcacheFreeCycle = 0;
+        retrying = false;
+        retryLive = false;
+        refillCause = CAUSE_OTHER;
+        squashSeq = 0;
+        refillSeq = 0;
+    }
+
+    RobEntry &entry(uint64_t seq)
+    {
+        return rob[seq - rob.front().seq];
+    }
+};
+
+// where a sampled run is within its period, see SamplingConfig
+enum SamplingPhase
+{
+    // instructions run functionally, the pipeline is empty
+    SAMPLE_FAST_FORWARD,
+    // the pipeline runs, not measured yet
+    SAMPLE_WARMING,
+    SAMPLE_MEASURING,
+    // fetch stopped, what is in the pipeline finishes before the fast-forward takes over again
+    SAMPLE_DRAINING
+};
+
+// everything a simulation changes as it runs, so that simulators don't share any state
+struct Simulator::Machine
+{
+    uint32_t regs[NUM_REGS] = {};
+    Cache *icache = NULL;
+    Cache *dcache = NULL;
+    // shared levels below the split L1s, NULL when not configured
+    Cache *l2cache = NULL;
+    Cache *l3cache = NULL;
+    // what the caches and the predictor were built from, a checkpoint only loads into the same. the L2 and L3
+    // configs are zero without those levels
+    MemoryStore *mainMem = NULL;
+    // mainMem as a MemoryImage when the driver passed one, it saves its own contents in a checkpoint instead
+    // of a fixed image
+    MemoryImage *memoryImage = NULL;
+    CacheConfig icConfig{};
+    CacheConfig dcConfig{};
+    CacheConfig l2Config{};
+    CacheConfig l3Config{};
+    BranchPredictorConfig predictorConfig{};
+    // stack distance profiles of the L1 access streams, NULL unless enableStackProfiling was called
+    StackProfile *icProfile = NULL;
+    StackProfile *dcProfile = NULL;
+    // where the L1 accesses go when enableTraceCapture was called, NULL otherwise
+    TraceWriter *traceWriter = NULL;
+    // guides fetch when enableBranchPrediction was called, branches and jr then resolve in EX instead of ID
+    BranchPredictor *predictor = NULL;
+    PipeState pipeState{};
+    uint32_t pc = 0;
+    IFID ifid{};
+    IDEX idex{};
+    EXMEM exmem{};
+    MEMWB memwb{};
+    bool haltSeen = false;
+    int fetchHaltCycles = 0;
+    int memHaltCycles = 0;
+    uint32_t lastPcFetch = UINT32_MAX;
+    uint32_t lastInstructionFetch = 0;
+    // where a branch resolved during an I-cache miss goes once its delay slot is fetched
+    uint32_t branchTargetPc = UINT32_MAX;
+    // the cycle a load that missed in a non-blocking D-cache delivers each register
+    uint32_t regReadyCycle[NUM_REGS] = {};
+    CycleStatus cycleStatus{};
+    SimulationStats simStats{};
+    DecodedInstruction decodeTable[DECODE_TABLE_SIZE] = {};
+    // set by enableSuperscalar, the cycles then run on the wide latches below instead of ifid to memwb.
+    // each holds a slot per instruction, oldest first, IF/ID's first wideIfidCount are taken
+    bool wide = false;
+    SuperscalarConfig wideConfig{};
+    IFID wideIfid[MAX_ISSUE_WIDTH] = {};
+    uint32_t wideIfidCount = 0;
+    IDEX wideIdex[MAX_ISSUE_WIDTH] = {};
+    EXMEM wideExmem[MAX_ISSUE_WIDTH] = {};
+    MEMWB wideMemwb[MAX_ISSUE_WIDTH] = {};
+    // the loads and stores in MEM that got through before one of them missed in a blocking D-cache
+    bool wideMemDone[MAX_ISSUE_WIDTH] = {};
+    // the delay slot of a taken branch resolved before it was fetched, fetch goes to branchTargetPc after it
+    uint32_t delaySlotPc = UINT32_MAX;
+    // the out-of-order core, NULL unless enableOutOfOrder replaced the pipeline with it
+    OutOfOrderCore *ooo = NULL;
+    // set by enableSampling, the run then alternates between runFunctional and the pipeline
+    bool sampling = false;
+    SamplingConfig samplingConfig{};
+    SamplingPhase samplingPhase = SAMPLE_FAST_FORWARD;
+    // the instruction count at which the phase ends
+    uint64_t phaseEnd = 0;
+    // where the fast-forward fetches after pc, pc + 4 unless pc is the delay slot of a taken branch
+    uint32_t functionalNpc = 4;
+    // the counters at the start of the unit being measured
+    uint32_t unitStartCycle = 0;
+    uint32_t unitStartInstructions = 0;
+    // the sum of the CPIs the units measured and of their squares
+    double unitCpiSum = 0;
+    double unitCpiSquares = 0;
+    // fetch takes in nothing new, so that the pipeline drains
+    bool fetchStopped = false;
+    // the cycles charged to each cause so far, see CycleCause
+    uint32_t cpiStack[CYCLE_CAUSES] = {};
+    // what the bubbles IF inserts while fetchHaltCycles runs down are charged to, the I-cache unless the
+    // miss was on the wrong path
+    CycleCause fetchWaitCause = CAUSE_ICACHE;
+
+    ~Machine();
+    int initCaches(CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig *l2Config, CacheConfig *l3Config, MemoryStore *mainMem,
+                   MemoryImage *image);
+    void initState();
+    void freeCaches();
+    void fillRegisterState(RegisterInfo &reg);
+    const DecodedInstruction &decode(uint32_t pc, uint32_t instruction);
+    void fillDecoded(DecodedInstruction &entry, uint32_t pc, uint32_t instruction);
+    bool handleRInstEx(RData &rData, uint64_t &rdValue);
+    int handleMem(EXMEM &exmem);
+    void recordDataAccess(IData &iData);
+    int handleMemNonBlocking(EXMEM &exmem);
+    uint32_t resolveBranch(IDEX &branch, bool &taken);
+    CycleStatus runCycle();
+    bool wideIssueWaits(const InstructionData &data, CycleCause &cause);
+    CycleStatus runWideCycle();
+    bool oooReadOperands(RobEntry &entry);
+    bool oooIssueLoad(RobEntry &load, uint32_t &memOps);
+    void oooSquashFrom(uint64_t seq);
+    void oooRedirect(uint64_t seq, uint32_t target);
+    uint32_t oooCommit(uint32_t &memOps, uint32_t &memInstr);
+    uint32_t oooIssue(uint32_t &memOps, uint32_t &memInstr);
+    uint32_t oooRename();
+    uint32_t oooFetch();
+    CycleCause oooStallCause();
+    CycleStatus runOooCycle();
+    void advanceClock(uint32_t cycles, CycleCause cause);
+    void functionalMemAccess(IData &iData, uint32_t pc, uint64_t &value);
+    CycleStatus runFunctional();
+    bool pipelineEmpty();
+    void startUnit();
+    void startMeasuring();
+    void startFastForward();
+    CycleStatus runSampledStep();
+    CycleStatus runPipelineCycle();
+    CycleStatus runNextCycle();
+    uint32_t skipStallCycles(uint32_t cycles);
+    void collectStats(SimulationStats &s);
+    template <typename Checkpoint> void checkpointConfigs(Checkpoint &checkpoint);
+    int saveCheckpoint(CheckpointWriter &out);
+    void loadCheckpoint(CheckpointReader &in);
+};
+
+void Simulator::Machine::fillRegisterState(RegisterInfo &reg)
+{
+    reg.at = regs[REG_AT];
+
+    for (int i = 0; i < V_REG_SIZE; i++)
+    {
+        reg.v[i] = regs[i + REG_V0];
+    }
+
+    for (int i = 0; i < A_REG_SIZE; i++)
+    {
+        reg.a[i] = regs[i + REG_A0];
+    }
+
+    //Remember, t8 and t9 are handled separately...
+    for (int i = 0; i < T_REG_SIZE - 2; i++)
+    {
+        reg.t[i] = regs[i + REG_T0];
+    }
+
+    for (int i = 0; i < S_REG_SIZE; i++)
+    {
+        reg.s[i] = regs[i + REG_S0];
+    }
+
+    //t8 and t9...
+    for (int i = 0; i < 2; i++)
+    {
+        reg.t[i + 8] = regs[i + REG_T8];
+    }
+
+    for (int i = 0; i < K_REG_SIZE; i++)
+    {
+        reg.k[i] = regs[i + REG_K0];
+    }
+
+    reg.gp = regs[REG_GP];
+    reg.sp = regs[REG_SP];
+    reg.fp = regs[REG_FP];
+    reg.ra = regs[REG_RA];
+}
+
 // get opcode from instruction
 uint8_t getOpcode(uint32_t instr)
 {
@@ -589,7 +654,7 @@ enum INST_TYPE getInstType(uint32_t instr)
 }
 
 // Arg: current instruction
-// Return: struct RData holding relevant register instruction data
+// Return: struct RData holding relevant register instruction data, the register values are read in ID
 struct RData getRData(uint32_t instr)
 {
     if (instr == 0xfeedfeed)
@@ -598,8 +663,8 @@ struct RData getRData(uint32_t instr)
     uint8_t rt = (instr >> 16) & 0x1f;
     struct RData rData = {
         getOpcode(instr), // uint8_t opcode;
-        regs[rs],         // uint32_t rsValue;
-        regs[rt],         // uint32_t rtValue;
+        0,                // uint32_t rsValue;
+        0,                // uint32_t rtValue;
         rs,
         rt,
         (uint8_t)((instr >> 11) & 0x1f), // uint8_t rd
@@ -611,7 +676,7 @@ struct RData getRData(uint32_t instr)
 }
 
 // Arg: current instruction
-// Return: struct IData holding relevant immmediate instruction data
+// Return: struct IData holding relevant immmediate instruction data, the register values are read in ID
 struct IData getIData(uint32_t instr)
 {
     uint8_t rs = (instr >> 21) & 0x1f;
@@ -619,8 +684,8 @@ struct IData getIData(uint32_t instr)
     uint16_t imm = instr & 0xffff;
     struct IData iData = {
         getOpcode(instr),                                                       // uint8_t opcode;
-        regs[rs],                                                               // uint32_t rsValue;
-        regs[rt],                                                               // uint32_t rtValue;
+        0,                                                                      // uint32_t rsValue;
+        0,                                                                      // uint32_t rtValue;
         rs,                                                                     // uint8_t rs;
         rt,                                                                     // uint8_t rt;
         imm,                                                                    // uint16_t imm;
@@ -644,37 +709,50 @@ struct JData getJData(uint32_t instr, uint32_t pc)
     return jData;
 }
 
-enum CycleStatus
+// builds the cache hierarchy, l2Config and l3Config are NULL for levels that aren't used
+int Simulator::Machine::initCaches(CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig *l2Config, CacheConfig *l3Config, MemoryStore *mainMem,
+                                   MemoryImage *image)
 {
-    NOT_HALTED,
-    HALTED
-};
+    // blocks move between levels whole, so every level has to use the same block size
+    CacheConfig *shared[] = {l2Config, l3Config};
+    for (CacheConfig *config : shared) {
+        if (config && (config->blockSize != icConfig.blockSize || config->blockSize != dcConfig.blockSize)) {
+            std::cerr << "All cache levels need the same block size" << std::endl;
+            return -EINVAL;
+        }
+    }
+
+    CacheConfig *levels[] = {&icConfig, &dcConfig, l2Config, l3Config};
+    for (CacheConfig *config : levels) {
+        if (config && Cache::checkConfig(*config)) return -EINVAL;
+    }
 
-Cache *icache;
-Cache *dcache;
-PipeState pipeState;
-uint32_t pc;
-MemoryStore *memStore;
-IFID ifid;
-IDEX idex;
-EXMEM exmem;
-MEMWB memwb;
-bool haltSeen;
-int fetchHaltCycles;
-int memHaltCycles;
-uint32_t lastPcFetch;
-uint32_t lastInstructionFetch;
-CycleStatus cycleStatus{};
-SimulationStats simStats{};
-
-int initSimulator(CacheConfig &icConfig, CacheConfig &dcConfig, MemoryStore *mainMem)
-{
-    icache = new Cache{icConfig, mainMem};
-    dcache = new Cache{dcConfig, mainMem};
+    this->mainMem = mainMem;
+    this->memoryImage = image;
+    this->icConfig = icConfig;
+    this->dcConfig = dcConfig;
+    this->l2Config = l2Config ? *l2Config : CacheConfig{};
+    this->l3Config = l3Config ? *l3Config : CacheConfig{};
+    icache = new Cache{icConfig, mainMem, image};
+    dcache = new Cache{dcConfig, mainMem, image};
+    l2cache = l2Config ? new Cache{*l2Config, mainMem, image} : NULL;
+    l3cache = l3Config ? new Cache{*l3Config, mainMem, image} : NULL;
+    if (l2cache) {
+        icache->setNextLevel(l2cache);
+        dcache->setNextLevel(l2cache);
+    }
+    if (l3cache) {
+        l2cache->setNextLevel(l3cache);
+    }
+    return 0;
+}
 
+void Simulator::Machine::initState()
+{
+    memset(regs, 0, sizeof(regs));
+    memset(decodeTable, 0, sizeof(decodeTable));
     pipeState = PipeState{};
     pc = 0;
-    memStore = mainMem;
     ifid = IFID{};
     idex = IDEX{};
     exmem = EXMEM{};
@@ -684,9 +762,38 @@ int initSimulator(CacheConfig &icConfig, CacheConfig &dcConfig, MemoryStore *mai
     memHaltCycles = 0;
     lastPcFetch = UINT32_MAX;
     lastInstructionFetch = 0;
+    branchTargetPc = UINT32_MAX;
+    memset(regReadyCycle, 0, sizeof(regReadyCycle));
+    for (uint32_t i = 0; i < MAX_ISSUE_WIDTH; i++)
+    {
+        wideIfid[i] = IFID{};
+        wideIdex[i] = IDEX{};
+        wideExmem[i] = EXMEM{};
+        wideMemwb[i] = MEMWB{};
+        wideMemDone[i] = false;
+    }
+    wideIfidCount = 0;
+    delaySlotPc = UINT32_MAX;
+    if (ooo) ooo->reset();
+    samplingPhase = SAMPLE_FAST_FORWARD;
+    phaseEnd = 0;
+    functionalNpc = 4;
+    unitStartCycle = 0;
+    unitStartInstructions = 0;
+    unitCpiSum = 0;
+    unitCpiSquares = 0;
+    fetchStopped = false;
+    memset(cpiStack, 0, sizeof(cpiStack));
+    fetchWaitCause = CAUSE_ICACHE;
     cycleStatus = CycleStatus{};
     simStats = SimulationStats{};
-    return 0;
+    // profiles left over from a run that wasn't finalized
+    delete icProfile;
+    delete dcProfile;
+    icProfile = NULL;
+    dcProfile = NULL;
+    delete traceWriter;
+    traceWriter = NULL;
 }
 
 uint8_t getSign(uint32_t value)
@@ -735,7 +842,7 @@ bool doAddSub(uint32_t s1, uint32_t s2, bool isAdd, bool checkOverflow, uint64_t
 
 // sets rdValue to new value of rd, or UINT64_MAX if none
 // returns true if instruction caused exception, false otherwise
-bool handleRInstEx(RData &rData, uint64_t &rdValue)
+bool Simulator::Machine::handleRInstEx(RData &rData, uint64_t &rdValue)
 {
     switch (rData.funct)
     {
@@ -824,7 +931,7 @@ bool handleImmInstEx(IData &iData, uint64_t &rtValue)
 }
 
 // returns true when stall, false otherwise
-int handleMem(EXMEM &exmem)
+int Simulator::Machine::handleMem(EXMEM &exmem)
 {
     IData &iData = exmem.instructionData.data.iData;
     uint32_t addr = iData.rsValue + iData.seImm;
@@ -834,13 +941,13 @@ int handleMem(EXMEM &exmem)
     switch (iData.opcode)
     {
     case OP_SB:
-        return dcache->setCacheValue(addr, iData.rtValue, BYTE_SIZE, pipeState.cycle);
+        return dcache->setCacheValue(addr, iData.rtValue, BYTE_SIZE, pipeState.cycle, exmem.pc);
     case OP_SH:
-        return dcache->setCacheValue(addr, iData.rtValue, HALF_SIZE, pipeState.cycle);
+        return dcache->setCacheValue(addr, iData.rtValue, HALF_SIZE, pipeState.cycle, exmem.pc);
     case OP_SW:
-        return dcache->setCacheValue(addr, iData.rtValue, WORD_SIZE, pipeState.cycle);
+        return dcache->setCacheValue(addr, iData.rtValue, WORD_SIZE, pipeState.cycle, exmem.pc);
     case OP_LBU:
-        if (delay = dcache->getCacheValue(addr, data, BYTE_SIZE, pipeState.cycle))
+        if (delay = dcache->getCacheValue(addr, data, BYTE_SIZE, pipeState.cycle, exmem.pc))
         {
             return delay;
         }
@@ -848,7 +955,7 @@ int handleMem(EXMEM &exmem)
             exmem.regWriteValue = data;
         break;
     case OP_LHU:
-        if (delay = dcache->getCacheValue(addr, data, HALF_SIZE, pipeState.cycle))
+        if (delay = dcache->getCacheValue(addr, data, HALF_SIZE, pipeState.cycle, exmem.pc))
         {
 
             return delay;
@@ -857,7 +964,7 @@ int handleMem(EXMEM &exmem)
             exmem.regWriteValue = data;
         break;
     case OP_LW:
-        if (delay = dcache->getCacheValue(addr, data, WORD_SIZE, pipeState.cycle))
+        if (delay = dcache->getCacheValue(addr, data, WORD_SIZE, pipeState.cycle, exmem.pc))
         {
             return delay;
         }
@@ -868,27 +975,154 @@ int handleMem(EXMEM &exmem)
     return 0;
 }
 
-bool branchNeedsStall(InstructionData &currentInstr, IDEX &nextInstr, EXMEM &nextNextInstr, bool checkRt)
+// adds a load or store whose D-cache access is done to the stack profile and the trace
+void Simulator::Machine::recordDataAccess(IData &iData)
 {
-    auto rs = currentInstr.rs();
-    auto rt = currentInstr.rt();
-
-    if (rs == nextNextInstr.regToWrite && nextNextInstr.regToWrite != 0 && nextNextInstr.instructionData.isMemRead())
-    {
-        return true;
-    }
-
-    if (checkRt && rt == nextNextInstr.regToWrite && nextNextInstr.regToWrite != 0 && nextNextInstr.instructionData.isMemRead())
+    MemEntrySize size;
+    TraceKind kind;
+    switch (iData.opcode)
     {
-        return true;
+    case OP_SB:
+        size = BYTE_SIZE;
+        kind = TRACE_STORE;
+        break;
+    case OP_SH:
+        size = HALF_SIZE;
+        kind = TRACE_STORE;
+        break;
+    case OP_SW:
+        size = WORD_SIZE;
+        kind = TRACE_STORE;
+        break;
+    case OP_LBU:
+        size = BYTE_SIZE;
+        kind = TRACE_LOAD;
+        break;
+    case OP_LHU:
+        size = HALF_SIZE;
+        kind = TRACE_LOAD;
+        break;
+    case OP_LW:
+        size = WORD_SIZE;
+        kind = TRACE_LOAD;
+        break;
+    default:
+        return;
     }
+    uint32_t addr = iData.rsValue + iData.seImm;
+    if (dcProfile) dcProfile->access(addr, size);
+    if (traceWriter) traceWriter->record(addr, kind, size);
+}
 
-    if (rs == nextInstr.regToWrite && nextInstr.regToWrite != 0)
-    {
-        return true;
-    }
+// MEM stage of a non-blocking D-cache. a miss doesn't hold up the pipeline, the loaded register
+// just isn't ready until the block is. returns the cycles to stall, only nonzero while every MSHR
+// or write buffer entry a store needs is busy
+int Simulator::Machine::handleMemNonBlocking(EXMEM &exmem)
+{
+    IData &iData = exmem.instructionData.data.iData;
+    uint32_t addr = iData.rsValue + iData.seImm;
+    uint32_t data = 0;
 
-    if (checkRt && rt == nextInstr.regToWrite && nextInstr.regToWrite != 0)
+    int delay = 0;
+    switch (iData.opcode)
+    {
+    case OP_SB:
+        delay = dcache->issueStore(addr, iData.rtValue, BYTE_SIZE, pipeState.cycle, exmem.pc);
+        break;
+    case OP_SH:
+        delay = dcache->issueStore(addr, iData.rtValue, HALF_SIZE, pipeState.cycle, exmem.pc);
+        break;
+    case OP_SW:
+        delay = dcache->issueStore(addr, iData.rtValue, WORD_SIZE, pipeState.cycle, exmem.pc);
+        break;
+    case OP_LBU:
+        delay = dcache->issueLoad(addr, data, BYTE_SIZE, pipeState.cycle, exmem.pc);
+        break;
+    case OP_LHU:
+        delay = dcache->issueLoad(addr, data, HALF_SIZE, pipeState.cycle, exmem.pc);
+        break;
+    case OP_LW:
+        delay = dcache->issueLoad(addr, data, WORD_SIZE, pipeState.cycle, exmem.pc);
+        break;
+    default:
+        return 0;
+    }
+
+    if (delay == MSHR_FULL || delay == WRITE_BUFFER_FULL)
+    {
+        return 1;
+    }
+    if (exmem.instructionData.isMemRead())
+    {
+        exmem.regWriteValue = data;
+        if (exmem.regToWrite != 0)
+            regReadyCycle[exmem.regToWrite] = pipeState.cycle + delay;
+    }
+    return 0;
+}
+
+// whether a conditional branch with its register values read is taken
+bool isBranchTaken(IData &iData)
+{
+    switch (iData.opcode)
+    {
+    case OP_BEQ:
+        return iData.rsValue == iData.rtValue;
+    case OP_BNE:
+        return iData.rsValue != iData.rtValue;
+    case OP_BGTZ:
+        return iData.rsValue > 0;
+    case OP_BLEZ:
+        return iData.rsValue <= 0;
+    }
+    return false;
+}
+
+// where fetch has to go after the delay slot of a conditional branch or jr in EX, UINT32_MAX for
+// any other instruction
+uint32_t Simulator::Machine::resolveBranch(IDEX &branch, bool &taken)
+{
+    InstructionData &data = branch.instructionData;
+    if (data.tag == R && data.data.rData.funct == FUN_JR)
+    {
+        taken = true;
+        return data.data.rData.rsValue;
+    }
+    if (data.tag != I)
+        return UINT32_MAX;
+    switch (data.data.iData.opcode)
+    {
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BGTZ:
+    case OP_BLEZ:
+        taken = isBranchTaken(data.data.iData);
+        return taken ? branch.pc + 4 + (data.data.iData.seImm << 2) : branch.pc + 8;
+    }
+    return UINT32_MAX;
+}
+
+bool branchNeedsStall(InstructionData &currentInstr, IDEX &nextInstr, EXMEM &nextNextInstr, bool checkRt)
+{
+    auto rs = currentInstr.rs();
+    auto rt = currentInstr.rt();
+
+    if (rs == nextNextInstr.regToWrite && nextNextInstr.regToWrite != 0 && nextNextInstr.instructionData.isMemRead())
+    {
+        return true;
+    }
+
+    if (checkRt && rt == nextNextInstr.regToWrite && nextNextInstr.regToWrite != 0 && nextNextInstr.instructionData.isMemRead())
+    {
+        return true;
+    }
+
+    if (rs == nextInstr.regToWrite && nextInstr.regToWrite != 0)
+    {
+        return true;
+    }
+
+    if (checkRt && rt == nextInstr.regToWrite && nextInstr.regToWrite != 0)
     {
         return true;
     }
@@ -908,6 +1142,20 @@ void handleBranchForwarding(InstructionData &instr, EXMEM &exmem)
     }
 }
 
+// forwards the result of an instruction in EX/MEM or MEM/WB to one about to execute
+void handleExForwarding(InstructionData &instr, EXMEM &producer)
+{
+    // if (RegWrite and (RegisterRd ≠ 0)
+    if (producer.regWriteValue == UINT64_MAX || producer.regToWrite == 0)
+        return;
+    // (and RegisterRd = ID/EX.registerRs)) ForwardA
+    if (producer.regToWrite == instr.rs())
+        instr.rsValue(producer.regWriteValue);
+    // (and RegisterRd = ID/EX.registerRt)) ForwardB
+    if (producer.regToWrite == instr.rt())
+        instr.rtValue(producer.regWriteValue);
+}
+
 void handleMemForwarding(InstructionData &instr, MEMWB &memwb)
 {
     if (instr.rt() == memwb.regToWrite && memwb.regToWrite != 0 && memwb.regWriteValue != UINT64_MAX)
@@ -938,7 +1186,71 @@ bool isFuncCodeValid(uint8_t funct)
     }
 }
 
-CycleStatus runCycle()
+inline const DecodedInstruction &Simulator::Machine::decode(uint32_t pc, uint32_t instruction)
+{
+    DecodedInstruction &entry = decodeTable[(pc >> 2) % DECODE_TABLE_SIZE];
+    if (!entry.valid || entry.pc != pc || entry.instruction != instruction)
+        fillDecoded(entry, pc, instruction);
+    return entry;
+}
+
+void Simulator::Machine::fillDecoded(DecodedInstruction &entry, uint32_t pc, uint32_t instruction)
+{
+    entry = DecodedInstruction{};
+    entry.pc = pc;
+    entry.instruction = instruction;
+    entry.data.tag = getInstType(instruction);
+    entry.handler = DECODE_PLAIN;
+    entry.regWriteValue = UINT64_MAX;
+    entry.valid = true;
+    switch (entry.data.tag)
+    {
+    case R:
+        entry.data.data.rData = getRData(instruction);
+        if (!isFuncCodeValid(entry.data.data.rData.funct))
+            entry.handler = DECODE_ILLEGAL;
+        else if (entry.data.data.rData.funct == FUN_JR)
+            entry.handler = DECODE_JR;
+        else
+            entry.regToWrite = entry.data.data.rData.rd;
+        break;
+    case I:
+        entry.data.data.iData = getIData(instruction);
+        switch (entry.data.data.iData.opcode)
+        {
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BGTZ:
+        case OP_BLEZ:
+            entry.handler = DECODE_BRANCH;
+            entry.target = pc + 4 + (entry.data.data.iData.seImm << 2);
+            break;
+        case OP_SB:
+        case OP_SH:
+        case OP_SW:
+            break;
+        default:
+            entry.regToWrite = entry.data.data.iData.rt;
+            break;
+        }
+        break;
+    case J:
+        entry.data.data.jData = getJData(instruction, pc);
+        entry.handler = DECODE_JUMP;
+        entry.target = ((pc + 4) & 0xf0000000) | (entry.data.data.jData.addr << 2);
+        if (entry.data.data.jData.opcode == OP_JAL)
+        {
+            entry.regToWrite = 31;
+            entry.regWriteValue = pc + 8;
+        }
+        break;
+    case E:
+        entry.handler = DECODE_ILLEGAL;
+        break;
+    }
+}
+
+CycleStatus Simulator::Machine::runCycle()
 {
     IFID nextIfid{};
     IDEX nextIdex{};
@@ -949,11 +1261,19 @@ CycleStatus runCycle()
     bool stallId = false;
     bool stallMem = false;
 
+    // memory-level parallelism, how many D-cache misses overlap
+    uint32_t outstanding = dcache->getOutstandingMisses(pipeState.cycle);
+    if (outstanding) {
+        simStats.missCycles++;
+        simStats.outstandingMisses += outstanding;
+    }
+
     // if simulated cache miss time is not over yet
     if (--memHaltCycles > 0) {
         if (fetchHaltCycles > 0) fetchHaltCycles--;
         pipeState.cycle++;
         simStats.totalCycles++;
+        cpiStack[CAUSE_DCACHE]++;
         return cycleStatus;
     }
     else memHaltCycles = 0;
@@ -965,6 +1285,9 @@ CycleStatus runCycle()
     {
         regs[memwb.regToWrite] = memwb.regWriteValue;
     }
+    if (memwb.instruction != 0 && memwb.instruction != 0xfeedfeed)
+        simStats.instructions++;
+    cpiStack[memwb.cause == CAUSE_BASE ? baseCause(memwb.instruction) : memwb.cause]++;
 
     nextIfid.pc = pc;
 
@@ -974,131 +1297,114 @@ CycleStatus runCycle()
     // if something else stalls the pipeline, we rerun the instruction fetch stage
     // however, that results in getting a cache value again that should be stored in the pipeline instead
     // this avoids that by maintaining a "cache" for the last fetched instruction that won't increment icache hits
-    if (lastPcFetch == pc) {
+    if (fetchStopped) {
+        // a sampled run drains the pipeline
+    }
+
+    else if (lastPcFetch == pc) {
         instruction = lastInstructionFetch;
+        nextIfid.fetched = true;
     }
 
     else if (!haltSeen && --fetchHaltCycles <= 0)
     {
-        auto delay = icache->getCacheValue(pc, instruction, MemEntrySize::WORD_SIZE, pipeState.cycle);
+        auto delay = icache->getCacheValue(pc, instruction, MemEntrySize::WORD_SIZE, pipeState.cycle, pc);
         if (delay)
         {
             // cache miss, halt
             stallIf = true;
             fetchHaltCycles = delay;
+            fetchWaitCause = CAUSE_ICACHE;
         } else {
+            nextIfid.fetched = true;
             lastPcFetch = pc;
             lastInstructionFetch = instruction;
+            if (icProfile) icProfile->access(pc, WORD_SIZE);
+            if (traceWriter) traceWriter->record(pc, TRACE_FETCH, WORD_SIZE);
         }
     }
 
-    uint32_t nextPc = fetchHaltCycles > 0 ? pc : pc + 4;
-    
+    uint32_t nextPc = fetchHaltCycles > 0 || fetchStopped ? pc : pc + 4;
+    if (predictor && nextIfid.fetched)
+        nextIfid.predictedPc = predictor->predict(pc, nextIfid.popsReturn);
+    if (nextIfid.fetched)
+        nextIfid.cause = CAUSE_BASE;
+    else if (!haltSeen && !fetchStopped)
+        nextIfid.cause = fetchWaitCause;
+
     nextIfid.instruction = instruction;
     if (instruction == 0xfeedfeed)
         haltSeen = true;
 
-    // instructionDecode
-    nextIdex.instructionData.tag = getInstType(ifid.instruction);
-    switch (nextIdex.instructionData.tag)
-    {
-    case R:
+    // instructionDecode, the decode table has everything but the register values
+    const DecodedInstruction &decoded = decode(ifid.pc, ifid.instruction);
+    nextIdex.instructionData = decoded.data;
+    nextIdex.regToWrite = decoded.regToWrite;
+    nextIdex.regWriteValue = decoded.regWriteValue;
+    if (decoded.data.tag == R)
     {
-        nextIdex.instructionData.data.rData = getRData(ifid.instruction);
-
-        // Illegal instruction exception check
-        if (!isFuncCodeValid(nextIdex.instructionData.data.rData.funct))
-        {
-            nextPc = EXCEPTION_ADDR;
-            nextIfid.instruction = 0;
-            haltSeen = false;
-            nextIdex.instructionData = InstructionData{};
-            break;
-        }
-        if (nextIdex.instructionData.data.rData.funct == FUN_JR)
-        {
-            handleBranchForwarding(nextIdex.instructionData, exmem);
-            nextPc = nextIdex.instructionData.data.rData.rsValue;
-            stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, false);
-        }
-        else
-        {
-            nextIdex.regToWrite = nextIdex.instructionData.data.rData.rd;
-        }
-        break;
+        auto &rData = nextIdex.instructionData.data.rData;
+        rData.rsValue = regs[rData.rs];
+        rData.rtValue = regs[rData.rt];
     }
-    case I:
+    else if (decoded.data.tag == I)
     {
-        nextIdex.instructionData.data.iData = getIData(ifid.instruction);
         auto &iData = nextIdex.instructionData.data.iData;
-        switch (iData.opcode)
-        {
-        case OP_BEQ:
-            handleBranchForwarding(nextIdex.instructionData, exmem);
-            if (iData.rsValue == iData.rtValue)
-            {
-                nextPc = ifid.pc + 4 + ((static_cast<int32_t>(iData.seImm)) << 2);
-            }
-            stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, true);
-            break;
-        case OP_BNE:
-            handleBranchForwarding(nextIdex.instructionData, exmem);
-            if (iData.rsValue != iData.rtValue)
-            {
-                nextPc = ifid.pc + 4 + ((static_cast<int32_t>(iData.seImm)) << 2);
-            }
-            stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, true);
-            break;
-        case OP_BGTZ:
-            handleBranchForwarding(nextIdex.instructionData, exmem);
-            if (iData.rsValue > 0)
-            {
-                nextPc = ifid.pc + 4 + ((static_cast<int32_t>(iData.seImm)) << 2);
-            }
-            stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, false);
-            break;
-        case OP_BLEZ:
-            handleBranchForwarding(nextIdex.instructionData, exmem);
-            if (iData.rsValue <= 0)
-            {
-                nextPc = ifid.pc + 4 + ((static_cast<int32_t>(iData.seImm)) << 2);
-            }
-            stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, false);
-            break;
-        case OP_SB:
-        case OP_SH:
-        case OP_SW:
-            break;
-        default:
-            nextIdex.regToWrite = iData.rt;
+        iData.rsValue = regs[iData.rs];
+        iData.rtValue = regs[iData.rt];
+    }
+    switch (decoded.handler)
+    {
+    case DECODE_PLAIN:
+        break;
+    case DECODE_JR:
+        // with a predictor fetch has already gone on, EX checks where it went
+        if (predictor)
             break;
-        }
+        handleBranchForwarding(nextIdex.instructionData, exmem);
+        nextPc = nextIdex.instructionData.data.rData.rsValue;
+        stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, false);
         break;
-    }
-    case J:
+    case DECODE_BRANCH:
     {
-        auto jData = getJData(ifid.instruction, ifid.pc);
-        switch (jData.opcode)
-        {
-        case OP_JAL:
-            nextIdex.regToWrite = 31;
-            nextIdex.regWriteValue = ifid.pc + 8;
-            // fallthrough
-        case OP_J:
-            nextPc = ((ifid.pc + 4) & 0xf0000000) | (jData.addr << 2);
+        if (predictor)
             break;
+        handleBranchForwarding(nextIdex.instructionData, exmem);
+        auto &iData = nextIdex.instructionData.data.iData;
+        if (isBranchTaken(iData))
+        {
+            nextPc = decoded.target;
         }
-        nextIdex.instructionData.data.jData = jData;
+        stallId = branchNeedsStall(nextIdex.instructionData, idex, exmem, iData.opcode == OP_BEQ || iData.opcode == OP_BNE);
         break;
     }
-    case E:
+    case DECODE_JUMP:
+        nextPc = decoded.target;
+        break;
+    case DECODE_ILLEGAL:
+        // illegal opcode or function code exception
         nextPc = EXCEPTION_ADDR;
         nextIfid.instruction = 0; // squash instruction after illegal instruction exception
+        nextIfid.fetched = false;
+        nextIfid.cause = CAUSE_EXCEPTION;
         haltSeen = false;
         nextIdex = IDEX{};
+        nextIdex.cause = CAUSE_EXCEPTION;
+        break;
     }
-    if (nextIdex.instructionData.tag != E)
+    if (nextIdex.instructionData.tag != E) {
+        nextIdex.pc = ifid.pc;
         nextIdex.instruction = ifid.instruction;
+        nextIdex.predictedPc = ifid.predictedPc;
+        nextIdex.cause = ifid.cause;
+    }
+    // the bubble a stalled ID inserts, so far only a branch or jr can have stalled it
+    CycleCause idStall = stallId ? CAUSE_BRANCH : CAUSE_OTHER;
+    // a stale BTB entry sent fetch off after something that isn't a branch, before its next instruction is in
+    if (predictor && ifid.fetched && ifid.predictedPc != ifid.pc + 8 && decoded.handler != DECODE_BRANCH && decoded.handler != DECODE_JR)
+    {
+        branchTargetPc = UINT32_MAX;
+    }
 
     // if (ID/EX.MemRead and
     //  ((ID/EX.RegisterRt = IF/ID.RegisterRs) or
@@ -1108,38 +1414,21 @@ CycleStatus runCycle()
     if (idex.instructionData.isMemRead() && idexRt != 0 && (idexRt == nextIdex.instructionData.rs() || idexRt == nextIdex.instructionData.rt()))
     {
         stallId = true;
+        idStall = CAUSE_LOAD_USE;
     }
 
     // execute
 
-    // forwarding of results from register data being written back
-    if (memwb.regWriteValue != UINT64_MAX && memwb.regToWrite != 0)
-    { // if (MEM/WB.RegWrite and (MEM/WB.RegisterRd ≠ 0)
-        if (memwb.regToWrite == idex.instructionData.rs())
-        { // (and MEM/WB.registerRd = ID/EX.registerRs)) ForwardA = 01
-            idex.instructionData.rsValue(memwb.regWriteValue);
-        }
-        if (memwb.regToWrite == idex.instructionData.rt())
-        { // (and MEM/WB.registerRd = ID/EX.registerRt)) ForwardB = 01
-            idex.instructionData.rtValue(memwb.regWriteValue);
-        }
-    }
-
-    // forwarding of results from previous cycle's execute
-    if (exmem.regWriteValue != UINT64_MAX && exmem.regToWrite != 0)
-    { // if (EX/WB.RegWrite and (EX/WB.RegisterRd ≠ 0)
-        if (exmem.regToWrite == idex.instructionData.rs())
-        { // (and EX/WB.registerRd = ID/EX.registerRs)) ForwardA = 01
-            idex.instructionData.rsValue(exmem.regWriteValue);
-        }
-        if (exmem.regToWrite == idex.instructionData.rt())
-        { // (and EX/WB.registerRd = ID/EX.registerRt)) ForwardB = 01
-            idex.instructionData.rtValue(exmem.regWriteValue);
-        }
-    }
+    // forwarding of results from register data being written back, then from previous cycle's execute
+    handleExForwarding(idex.instructionData, memwb);
+    handleExForwarding(idex.instructionData, exmem);
 
     nextExmem = idex;
 
+    // with a predictor, branches and jr resolve here against where fetch went
+    bool branchTaken = false;
+    uint32_t branchNextPc = predictor ? resolveBranch(idex, branchTaken) : UINT32_MAX;
+
     bool exOverflow = false;
 
     switch (idex.instructionData.tag)
@@ -1160,8 +1449,12 @@ CycleStatus runCycle()
     {
         nextPc = EXCEPTION_ADDR;
         nextIfid.instruction = 0;
+        nextIfid.fetched = false;
+        nextIfid.cause = CAUSE_EXCEPTION;
         nextIdex = IDEX{};
+        nextIdex.cause = CAUSE_EXCEPTION;
         nextExmem = EXMEM{};
+        nextExmem.cause = CAUSE_EXCEPTION;
         haltSeen = false;
     }
 
@@ -1169,15 +1462,25 @@ CycleStatus runCycle()
     if (exmem.instructionData.tag == I)
     {
         handleMemForwarding(exmem.instructionData, memwb);
-        auto delay = handleMem(exmem);
+        auto delay = dcache->isNonBlocking() ? handleMemNonBlocking(exmem) : handleMem(exmem);
         if (delay) {
             memHaltCycles = delay;
             stallMem = true;
+        } else if (dcProfile || traceWriter) {
+            recordDataAccess(exmem.instructionData.data.iData);
         }
     }
 
     nextMemwb = exmem;
 
+    // an instruction in ID waits for a load that missed in a non-blocking D-cache, including one that just did
+    if (regReadyCycle[nextIdex.instructionData.rs()] > pipeState.cycle || regReadyCycle[nextIdex.instructionData.rt()] > pipeState.cycle)
+    {
+        if (!stallId)
+            idStall = CAUSE_DCACHE;
+        stallId = true;
+    }
+
     // writeback trigger halt
     if (memwb.instruction == 0xfeedfeed)
         cycleStatus = HALTED;
@@ -1194,27 +1497,73 @@ CycleStatus runCycle()
     // update total cycles
     simStats.totalCycles++;
 
+    // a branch or jump that resolves while its delay slot is still being fetched
+    // takes effect once the delay slot is in, an exception overrides it
+    if (nextPc == EXCEPTION_ADDR) {
+        branchTargetPc = UINT32_MAX;
+        memset(regReadyCycle, 0, sizeof(regReadyCycle));
+    } else if (fetchHaltCycles > 0 || fetchStopped) {
+        if (!stallId && !stallMem && nextPc != pc) {
+            branchTargetPc = nextPc;
+            nextPc = pc;
+        }
+    } else if (branchTargetPc != UINT32_MAX && !stallIf && !stallId && !stallMem) {
+        nextPc = branchTargetPc;
+        branchTargetPc = UINT32_MAX;
+    }
+
+    // the branch in EX moves on and trains the predictor, fetch goes back if it guessed wrong
+    bool mispredicted = false;
+    bool delaySlotInId = false;
+    uint32_t delaySlot = ifid.instruction;
+    if (branchNextPc != UINT32_MAX && !stallMem)
+    {
+        auto &data = idex.instructionData;
+        BranchKind kind = data.tag == I ? BRANCH_CONDITIONAL : data.rs() == REG_RA ? BRANCH_RETURN : BRANCH_INDIRECT;
+        predictor->update(idex.pc, kind, branchTaken, branchNextPc);
+        simStats.branches++;
+        // an exception in the delay slot takes over
+        if (branchNextPc != idex.predictedPc && nextPc != EXCEPTION_ADDR)
+        {
+            mispredicted = true;
+            simStats.mispredicts++;
+            delaySlotInId = ifid.fetched && ifid.pc == idex.pc + 4;
+        }
+    }
+
     // finish cycle
     if (!stallIf && !stallId && !stallMem)
     {
         ifid = nextIfid;
         pc = nextPc;
+        // a branch predicted taken sends fetch to its target once its delay slot is in
+        if (predictor && nextIfid.fetched)
+        {
+            if (nextIfid.popsReturn)
+                predictor->popReturn();
+            if (nextIfid.predictedPc != nextIfid.pc + 8)
+                branchTargetPc = nextIfid.predictedPc;
+        }
     }
 
-    if (stallIf)
+    if (stallIf && !stallId && !stallMem)
     {
-        // insert bubble
+        // insert bubble, unless a later stall keeps the instruction in ID
         ifid = IFID{};
+        ifid.cause = CAUSE_ICACHE;
     }
 
     if (!stallId && !stallMem)
     {
         idex = nextIdex;
+        if (predictor && nextIdex.instructionData.tag == J && nextIdex.regToWrite == REG_RA)
+            predictor->pushReturn(nextIdex.pc + 8);
     }
     else if (stallId && !stallMem)
     {
         // insert bubble
         idex = IDEX{};
+        idex.cause = idStall;
     }
 
     if (!stallMem)
@@ -1226,58 +1575,2113 @@ CycleStatus runCycle()
     {
         // insert bubble
         memwb = MEMWB{};
+        memwb.cause = CAUSE_DCACHE;
+    }
+
+    if (mispredicted)
+    {
+        if (delaySlotInId)
+        {
+            // IF fetched past the delay slot, that instruction and any I-cache miss it waits for are lost
+            if (!stallId)
+            {
+                ifid = IFID{};
+                ifid.cause = CAUSE_MISPREDICT;
+            }
+            if (fetchHaltCycles > 0)
+                fetchWaitCause = CAUSE_MISPREDICT;
+            // the bubble in IF/ID is the first cycle of the miss, if there is one
+            simStats.mispredictCycles += std::max(fetchHaltCycles, stallId ? 0 : 1);
+            haltSeen = delaySlot == 0xfeedfeed;
+            pc = branchNextPc;
+            branchTargetPc = UINT32_MAX;
+        }
+        else if (nextIfid.fetched && !stallIf && !stallId)
+        {
+            // the delay slot came in this cycle, nothing after it was fetched yet
+            pc = branchNextPc;
+            branchTargetPc = UINT32_MAX;
+        }
+        else
+        {
+            branchTargetPc = branchNextPc;
+        }
     }
 
     return cycleStatus;
 }
 
-int runCycles(unsigned int cycles)
+// SUPERSCALAR
+
+// loads and stores, the instructions that take a D-cache port
+bool isMemAccess(InstructionData &data)
 {
-    CycleStatus cycleStatus{};
-    for (; cycles > 0 && cycleStatus != HALTED; cycles--)
+    if (data.tag != I)
+        return false;
+    switch (data.data.iData.opcode)
     {
-        cycleStatus = runCycle();
+    case OP_LBU:
+    case OP_LHU:
+    case OP_LW:
+    case OP_SB:
+    case OP_SH:
+    case OP_SW:
+        return true;
     }
-    pipeState.cycle--;
-    dumpPipeState(pipeState);
-    pipeState.cycle++;
-    return cycleStatus == HALTED;
+    return false;
 }
-int runTillHalt()
+
+// whether an instruction reads rt, the other I-type ones write it or don't use it
+bool readsRt(const InstructionData &data)
 {
-    CycleStatus cycleStatus{};
-    do
+    if (data.tag == R)
+        return true;
+    if (data.tag != I)
+        return false;
+    switch (data.data.iData.opcode)
     {
-        cycleStatus = runCycle();
-    } while (cycleStatus != HALTED);
-    pipeState.cycle--;
-    dumpPipeState(pipeState);
-    pipeState.cycle++;
-    return 0;
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_SB:
+    case OP_SH:
+    case OP_SW:
+        return true;
+    }
+    return false;
 }
-int finalizeSimulator()
+
+// whether an instruction in ID waits for a load in EX, or for one that missed in a non-blocking D-cache. cause
+// is set to which of them it waits for
+bool Simulator::Machine::wideIssueWaits(const InstructionData &data, CycleCause &cause)
 {
-    // Set the register values in the struct for printing...
-    SimulationStats s;
-    s.totalCycles = pipeState.cycle;
-    s.icHits = icache->getHits();
-    s.icMisses = icache->getMisses();
-    s.dcHits = dcache->getHits();
-    s.dcMisses = dcache->getMisses();
-    printSimStats(s);
+    uint8_t rs = data.rs();
+    uint8_t rt = readsRt(data) ? data.rt() : 0;
+    if (regReadyCycle[rs] > pipeState.cycle || regReadyCycle[rt] > pipeState.cycle)
+    {
+        cause = CAUSE_DCACHE;
+        return true;
+    }
+    for (uint32_t i = 0; i < wideConfig.width; i++)
+    {
+        IDEX &load = wideIdex[i];
+        if (load.instructionData.isMemRead() && load.regToWrite != 0 && (load.regToWrite == rs || load.regToWrite == rt))
+        {
+            cause = CAUSE_LOAD_USE;
+            return true;
+        }
+    }
+    return false;
+}
 
-    icache->drain();
-    dcache->drain();
+// what writeback charges a cycle of the superscalar pipeline to: a base cycle when any slot holds an
+// instruction, the cause of the oldest bubble otherwise, and CAUSE_OTHER when there are only nops and the halt
+CycleCause wideCause(const IDEX *latch, uint32_t width)
+{
+    bool fetched = false;
+    for (uint32_t i = 0; i < width; i++)
+    {
+        if (latch[i].cause == CAUSE_BASE && baseCause(latch[i].instruction) == CAUSE_BASE)
+            return CAUSE_BASE;
+        fetched |= latch[i].cause == CAUSE_BASE;
+    }
+    return fetched ? CAUSE_OTHER : latch[0].cause;
+}
 
-    delete icache;
-    delete dcache;
+// runCycle for the superscalar pipeline, every stage works on all slots of its latch. ID issues in order up
+// to the first instruction that has to wait, the ones after it stay in IF/ID and fetch only fills the free
+// slots. Fetch doesn't go past the end of an I-cache block in a cycle
+CycleStatus Simulator::Machine::runWideCycle()
+{
+    uint32_t width = wideConfig.width;
+    IFID nextIfid[MAX_ISSUE_WIDTH] = {};
+    IDEX nextIdex[MAX_ISSUE_WIDTH] = {};
+    EXMEM nextExmem[MAX_ISSUE_WIDTH] = {};
+
+    uint32_t outstanding = dcache->getOutstandingMisses(pipeState.cycle);
+    if (outstanding) {
+        simStats.missCycles++;
+        simStats.outstandingMisses += outstanding;
+    }
 
-    RegisterInfo reg;
+    if (--memHaltCycles > 0) {
+        if (fetchHaltCycles > 0) fetchHaltCycles--;
+        pipeState.cycle++;
+        simStats.totalCycles++;
+        cpiStack[CAUSE_DCACHE]++;
+        return cycleStatus;
+    }
+    else memHaltCycles = 0;
+
+    // writeBack, in program order so that the youngest write to a register wins
+    for (uint32_t i = 0; i < width; i++)
+    {
+        MEMWB &slot = wideMemwb[i];
+        if (slot.regWriteValue != UINT64_MAX && slot.regToWrite != 0)
+            regs[slot.regToWrite] = slot.regWriteValue;
+        if (slot.instruction == 0xfeedfeed)
+            cycleStatus = HALTED;
+        else if (slot.instruction != 0)
+            simStats.instructions++;
+    }
+    cpiStack[wideCause(wideMemwb, width)]++;
+
+    // execute, forwarding from both bundles ahead, the older one first and each in program order. an
+    // instruction never needs a result of its own bundle, ID doesn't issue them together
+    bool exception = false;
+    for (uint32_t i = 0; i < width; i++)
+    {
+        IDEX &slot = wideIdex[i];
+        for (uint32_t j = 0; j < width; j++)
+            handleExForwarding(slot.instructionData, wideMemwb[j]);
+        for (uint32_t j = 0; j < width; j++)
+            handleExForwarding(slot.instructionData, wideExmem[j]);
+        nextExmem[i] = slot;
+        bool overflow = false;
+        if (slot.instructionData.tag == R)
+            overflow = handleRInstEx(slot.instructionData.data.rData, nextExmem[i].regWriteValue);
+        else if (slot.instructionData.tag == I)
+            overflow = handleImmInstEx(slot.instructionData.data.iData, nextExmem[i].regWriteValue);
+        if (overflow)
+        {
+            // the instruction and the younger ones are squashed
+            for (uint32_t j = i; j < width; j++)
+            {
+                nextExmem[j] = EXMEM{};
+                nextExmem[j].cause = CAUSE_EXCEPTION;
+            }
+            exception = true;
+            break;
+        }
+    }
+
+    // mem, in program order. after a miss in a blocking D-cache the bundle waits, the accesses before
+    // the one that missed aren't made again
+    bool stallMem = false;
+    for (uint32_t i = 0; i < width && !stallMem; i++)
+    {
+        EXMEM &slot = wideExmem[i];
+        if (slot.instructionData.tag != I || wideMemDone[i])
+            continue;
+        for (uint32_t j = 0; j < width; j++)
+            handleMemForwarding(slot.instructionData, wideMemwb[j]);
+        auto delay = dcache->isNonBlocking() ? handleMemNonBlocking(slot) : handleMem(slot);
+        if (delay) {
+            memHaltCycles = delay;
+            stallMem = true;
+        } else {
+            wideMemDone[i] = true;
+            if (dcProfile || traceWriter)
+                recordDataAccess(slot.instructionData.data.iData);
+        }
+    }
+
+    // instructionDecode, issues until an instruction has to wait or a restriction holds it back. the IF/ID
+    // slots from wrongPath on were fetched past the delay slot of a taken branch or jump
+    uint32_t issued = 0;
+    uint32_t memOps = 0;
+    bool controlIssued = false;
+    uint32_t wrongPath = wideIfidCount;
+    uint32_t redirectPc = UINT32_MAX;
+    uint32_t redirectDelaySlot = UINT32_MAX;
+    bool delaySlotInIfid = false;
+    // the bubble ID inserts when it issues nothing, an empty IF/ID holds the cause of its own
+    CycleCause idStall = wideIfid[0].cause;
+    for (uint32_t i = 0; i < wrongPath && !exception && !stallMem; i++)
+    {
+        IFID &slot = wideIfid[i];
+        const DecodedInstruction &decoded = decode(slot.pc, slot.instruction);
+        if (decoded.handler == DECODE_ILLEGAL)
+        {
+            // illegal opcode or function code exception, the instructions before it still issue
+            exception = true;
+            break;
+        }
+        IDEX next{};
+        next.pc = slot.pc;
+        next.instruction = slot.instruction;
+        next.cause = slot.cause;
+        next.instructionData = decoded.data;
+        next.regToWrite = decoded.regToWrite;
+        next.regWriteValue = decoded.regWriteValue;
+        InstructionData &data = next.instructionData;
+        if (data.tag == R)
+        {
+            data.data.rData.rsValue = regs[data.data.rData.rs];
+            data.data.rData.rtValue = regs[data.data.rData.rt];
+        }
+        else if (data.tag == I)
+        {
+            data.data.iData.rsValue = regs[data.data.iData.rs];
+            data.data.iData.rtValue = regs[data.data.iData.rt];
+        }
+        if (wideIssueWaits(data, idStall))
+            break;
+
+        uint8_t rs = data.rs();
+        uint8_t rt = readsRt(data) ? data.rt() : 0;
+        bool dependent = false;
+        for (uint32_t j = 0; j < issued; j++)
+        {
+            uint8_t written = nextIdex[j].regToWrite;
+            if (written != 0 && (written == rs || written == rt))
+                dependent = true;
+        }
+        if (dependent)
+        {
+            simStats.dependencySplits++;
+            break;
+        }
+        bool control = decoded.handler != DECODE_PLAIN;
+        if ((isMemAccess(data) && memOps == wideConfig.memOpsPerCycle) ||
+            (control && (controlIssued || (i > 0 && wideConfig.branchInSlot0))))
+        {
+            simStats.structuralSplits++;
+            break;
+        }
+
+        if (decoded.handler == DECODE_BRANCH || decoded.handler == DECODE_JR)
+        {
+            // resolves here like in runCycle, once its operands are out of EX and loads of them out of MEM
+            bool waits = false;
+            for (uint32_t j = 0; j < width; j++)
+            {
+                uint8_t exWrite = wideIdex[j].regToWrite;
+                uint8_t memLoad = wideExmem[j].instructionData.isMemRead() ? wideExmem[j].regToWrite : 0;
+                if ((exWrite != 0 && (exWrite == rs || exWrite == rt)) || (memLoad != 0 && (memLoad == rs || memLoad == rt)))
+                    waits = true;
+            }
+            if (waits)
+            {
+                idStall = CAUSE_BRANCH;
+                break;
+            }
+            for (uint32_t j = 0; j < width; j++)
+                handleExForwarding(data, wideExmem[j]);
+        }
+        if (control)
+        {
+            controlIssued = true;
+            if (decoded.handler == DECODE_JR)
+                redirectPc = data.data.rData.rsValue;
+            else if (decoded.handler == DECODE_JUMP || isBranchTaken(data.data.iData))
+                redirectPc = decoded.target;
+            if (redirectPc != UINT32_MAX)
+            {
+                redirectDelaySlot = slot.pc + 4;
+                delaySlotInIfid = i + 1 < wideIfidCount;
+                wrongPath = std::min(i + 2, wideIfidCount);
+            }
+        }
+        if (isMemAccess(data))
+            memOps++;
+        nextIdex[issued++] = next;
+    }
+    if (issued == 0)
+        nextIdex[0].cause = exception ? CAUSE_EXCEPTION : idStall;
+
+    // what didn't issue stays in IF/ID, unless it is on the wrong path or behind an exception
+    uint32_t held = 0;
+    if (!exception && !stallMem)
+    {
+        for (uint32_t i = issued; i < wrongPath; i++)
+            nextIfid[held++] = wideIfid[i];
+        for (uint32_t i = wrongPath; i < wideIfidCount; i++)
+        {
+            if (wideIfid[i].instruction == 0xfeedfeed)
+                haltSeen = false;
+        }
+    }
+
+    // instructionFetch, into the free IF/ID slots. when the delay slot of a taken branch is in IF/ID
+    // already, what this cycle would fetch is on the wrong path and fetch goes to the target next cycle
+    uint32_t firstFetched = 0;
+    if (fetchHaltCycles > 0)
+        fetchHaltCycles--;
+    if (stallMem)
+    {
+        // everything waits for the D-cache, an I-cache miss goes on
+    }
+    else if (exception)
+    {
+        pc = EXCEPTION_ADDR;
+        haltSeen = false;
+        delaySlotPc = UINT32_MAX;
+        branchTargetPc = UINT32_MAX;
+        memset(regReadyCycle, 0, sizeof(regReadyCycle));
+    }
+    else if (redirectPc != UINT32_MAX && delaySlotInIfid)
+    {
+        pc = redirectPc;
+    }
+    else
+    {
+        // a branch that resolved before its delay slot was fetched redirects fetch after it
+        if (redirectPc != UINT32_MAX)
+        {
+            delaySlotPc = redirectDelaySlot;
+            branchTargetPc = redirectPc;
+        }
+        uint32_t blockSize = icache->getBlockSize();
+        uint32_t block = pc / blockSize;
+        uint32_t fetched = 0;
+        while (!haltSeen && !fetchStopped && fetchHaltCycles == 0 && held < width && pc / blockSize == block)
+        {
+            uint32_t instruction = 0;
+            auto delay = icache->getCacheValue(pc, instruction, MemEntrySize::WORD_SIZE, pipeState.cycle, pc);
+            if (delay)
+            {
+                // cache miss, halt
+                fetchHaltCycles = delay;
+                fetchWaitCause = CAUSE_ICACHE;
+                break;
+            }
+            if (icProfile) icProfile->access(pc, WORD_SIZE);
+            if (traceWriter) traceWriter->record(pc, TRACE_FETCH, WORD_SIZE);
+            if (fetched++ == 0)
+                firstFetched = instruction;
+            nextIfid[held].pc = pc;
+            nextIfid[held].instruction = instruction;
+            nextIfid[held].fetched = true;
+            nextIfid[held].cause = CAUSE_BASE;
+            held++;
+            if (instruction == 0xfeedfeed)
+                haltSeen = true;
+            if (pc == delaySlotPc)
+            {
+                pc = branchTargetPc;
+                delaySlotPc = UINT32_MAX;
+                branchTargetPc = UINT32_MAX;
+                break;
+            }
+            pc += 4;
+        }
+    }
+    // an empty IF/ID keeps why for the cycle ID has nothing to issue in
+    if (held == 0)
+    {
+        if (exception)
+            nextIfid[0].cause = CAUSE_EXCEPTION;
+        else if (redirectPc != UINT32_MAX && delaySlotInIfid)
+            nextIfid[0].cause = CAUSE_MISPREDICT;
+        else if (fetchHaltCycles > 0)
+            nextIfid[0].cause = fetchWaitCause;
+    }
+
+    // update pipe state information, the oldest slot of each stage
+    pipeState.cycle++;
+    pipeState.ifInstr = firstFetched;
+    pipeState.idInstr = wideIfid[0].instruction;
+    pipeState.exInstr = nextExmem[0].instruction;
+    pipeState.memInstr = wideExmem[0].instruction;
+    pipeState.wbInstr = wideMemwb[0].instruction;
+    simStats.totalCycles++;
+
+    // finish cycle
+    for (uint32_t i = 0; i < width; i++)
+    {
+        if (stallMem)
+        {
+            // insert bubble
+            wideMemwb[i] = MEMWB{};
+            wideMemwb[i].cause = CAUSE_DCACHE;
+            continue;
+        }
+        wideMemwb[i] = wideExmem[i];
+        wideExmem[i] = nextExmem[i];
+        wideMemDone[i] = false;
+        wideIdex[i] = nextIdex[i];
+        wideIfid[i] = nextIfid[i];
+    }
+    if (!stallMem)
+        wideIfidCount = held;
+
+    return cycleStatus;
+}
+
+// OUT-OF-ORDER CORE
+
+// the bytes a load or store moves
+MemEntrySize memAccessSize(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case OP_LBU:
+    case OP_SB:
+        return BYTE_SIZE;
+    case OP_LHU:
+    case OP_SH:
+        return HALF_SIZE;
+    }
+    return WORD_SIZE;
+}
+
+// fills in the source values whose producers are done, false while one isn't. a producer that already
+// committed left its value in regs, no younger write to the register can have committed before the reader
+bool Simulator::Machine::oooReadOperands(RobEntry &entry)
+{
+    OutOfOrderCore &core = *ooo;
+    uint64_t *producers[] = {&entry.rsProducer, &entry.rtProducer};
+    for (int i = 0; i < 2; i++)
+    {
+        uint64_t seq = *producers[i];
+        if (seq == NO_PRODUCER)
+            continue;
+        uint64_t value;
+        if (seq < core.rob.front().seq)
+        {
+            value = regs[i == 0 ? entry.data.rs() : entry.data.rt()];
+        }
+        else
+        {
+            RobEntry &producer = core.entry(seq);
+            if (!producer.done || producer.doneCycle > pipeState.cycle)
+                return false;
+            value = producer.value;
+        }
+        if (i == 0)
+            entry.data.rsValue(value);
+        else
+            entry.data.rtValue(value);
+        *producers[i] = NO_PRODUCER;
+    }
+    return true;
+}
+
+// a load with its address goes to the D-cache, or takes its value from the youngest older store in the LSQ
+// that writes the bytes it reads. false while it has to wait: for the address of an older store, for an older
+// store that writes only some of its bytes to commit, or for the D-cache
+bool Simulator::Machine::oooIssueLoad(RobEntry &load, uint32_t &memOps)
+{
+    OutOfOrderCore &core = *ooo;
+    IData &iData = load.data.data.iData;
+    uint32_t address = iData.rsValue + iData.seImm;
+    RobEntry *source = NULL;
+    for (uint64_t seq : core.lsq)
+    {
+        if (seq >= load.seq)
+            break;
+        RobEntry &store = core.entry(seq);
+        if (!store.isStore)
+            continue;
+        if (!store.addressReady)
+            return false;
+        if (store.address < address + load.size && address < store.address + store.size)
+            source = &store;
+    }
+    if (source)
+    {
+        if (address < source->address || address + load.size > source->address + source->size)
+            return false;
+        // big endian, the bytes of the store after the ones loaded are the low ones of its value
+        uint32_t value = source->data.data.iData.rtValue >> (8 * (source->address + source->size - address - load.size));
+        load.value = load.size == WORD_SIZE ? value : value & ((1u << (8 * load.size)) - 1);
+        load.done = true;
+        load.doneCycle = pipeState.cycle + 2;
+        return true;
+    }
+
+    if (memOps == core.config.memOpsPerCycle)
+        return false;
+    uint32_t data = 0;
+    int delay;
+    if (dcache->isNonBlocking())
+    {
+        delay = dcache->issueLoad(address, data, load.size, pipeState.cycle, load.pc);
+        if (delay == MSHR_FULL)
+            return false;
+    }
+    else
+    {
+        if (core.retrying || core.dcacheFreeCycle > pipeState.cycle)
+            return false;
+        delay = dcache->getCacheValue(address, data, load.size, pipeState.cycle, load.pc);
+        if (delay)
+        {
+            // the load is done once its access is made again after the miss
+            core.dcacheFreeCycle = pipeState.cycle + delay;
+            core.retrying = true;
+            core.retryLive = true;
+            core.retrySeq = load.seq;
+            core.retryData = iData;
+            core.retrySize = load.size;
+            core.retryPc = load.pc;
+            memOps++;
+            return true;
+        }
+    }
+    memOps++;
+    if (dcProfile || traceWriter)
+        recordDataAccess(iData);
+    load.value = data;
+    load.done = true;
+    load.doneCycle = pipeState.cycle + 2 + delay;
+    return true;
+}
+
+// drops the instructions from seq on out of the reorder buffer and the queues, and renames the registers
+// again onto the ones left
+void Simulator::Machine::oooSquashFrom(uint64_t seq)
+{
+    OutOfOrderCore &core = *ooo;
+    while (!core.rob.empty() && core.rob.back().seq >= seq)
+    {
+        core.rob.pop_back();
+        simStats.squashedInstructions++;
+    }
+    core.nextSeq = seq;
+    auto squashed = [seq](uint64_t queued) { return queued >= seq; };
+    core.issueQueue.erase(std::remove_if(core.issueQueue.begin(), core.issueQueue.end(), squashed), core.issueQueue.end());
+    core.lsq.erase(std::remove_if(core.lsq.begin(), core.lsq.end(), squashed), core.lsq.end());
+    std::fill(core.producer, core.producer + NUM_REGS, NO_PRODUCER);
+    for (RobEntry &entry : core.rob)
+    {
+        if (entry.regToWrite != 0)
+            core.producer[entry.regToWrite] = entry.seq;
+    }
+    if (core.retrying && core.retrySeq >= seq)
+        core.retryLive = false;
+}
+
+// fetch goes to target after the delay slot of instruction seq, what came in past the delay slot is dropped.
+// the delay slot is the next instruction in the reorder buffer or in the fetch queue, or the next one fetched
+void Simulator::Machine::oooRedirect(uint64_t seq, uint32_t target)
+{
+    OutOfOrderCore &core = *ooo;
+    uint32_t delaySlot;
+    if (seq + 1 < core.nextSeq)
+    {
+        oooSquashFrom(seq + 2);
+        simStats.squashedInstructions += core.fetchQueue.size();
+        core.fetchQueue.clear();
+        delaySlot = core.entry(seq + 1).instruction;
+    }
+    else if (!core.fetchQueue.empty())
+    {
+        simStats.squashedInstructions += core.fetchQueue.size() - 1;
+        core.fetchQueue.resize(1);
+        delaySlot = core.fetchQueue.front().instruction;
+    }
+    else
+    {
+        pc = core.entry(seq).pc + 4;
+        delaySlotPc = pc;
+        branchTargetPc = target;
+        haltSeen = false;
+        return;
+    }
+    pc = target;
+    delaySlotPc = UINT32_MAX;
+    branchTargetPc = UINT32_MAX;
+    haltSeen = delaySlot == 0xfeedfeed;
+    core.refillCause = CAUSE_MISPREDICT;
+    core.squashSeq = seq;
+    core.refillSeq = seq + 2;
+}
+
+// retires up to commitWidth done instructions in program order. stores write the D-cache here, and an
+// exception squashes everything and sends fetch to the handler once it is the oldest instruction
+uint32_t Simulator::Machine::oooCommit(uint32_t &memOps, uint32_t &memInstr)
+{
+    OutOfOrderCore &core = *ooo;
+    uint32_t first = 0;
+    uint32_t retired = 0;
+    uint32_t counted = 0;
+    for (uint32_t n = 0; n < core.config.commitWidth && !core.rob.empty() && cycleStatus != HALTED; n++)
+    {
+        RobEntry &head = core.rob.front();
+        if (!head.done || head.doneCycle > pipeState.cycle)
+            break;
+        if (head.exception)
+        {
+            core.refillCause = CAUSE_EXCEPTION;
+            core.squashSeq = head.seq;
+            core.refillSeq = head.seq;
+            oooSquashFrom(head.seq);
+            simStats.squashedInstructions += core.fetchQueue.size();
+            core.fetchQueue.clear();
+            pc = EXCEPTION_ADDR;
+            haltSeen = false;
+            delaySlotPc = UINT32_MAX;
+            branchTargetPc = UINT32_MAX;
+            break;
+        }
+        if (head.isStore)
+        {
+            if (memOps == core.config.memOpsPerCycle)
+                break;
+            IData &iData = head.data.data.iData;
+            if (dcache->isNonBlocking())
+            {
+                int delay = dcache->issueStore(head.address, iData.rtValue, head.size, pipeState.cycle, head.pc);
+                if (delay == MSHR_FULL || delay == WRITE_BUFFER_FULL)
+                    break;
+            }
+            else
+            {
+                if (core.retrying || core.dcacheFreeCycle > pipeState.cycle)
+                    break;
+                int delay = dcache->setCacheValue(head.address, iData.rtValue, head.size, pipeState.cycle, head.pc);
+                if (delay)
+                {
+                    // made again once the miss is served, like in runCycle
+                    core.dcacheFreeCycle = pipeState.cycle + delay;
+                    break;
+                }
+            }
+            if (memOps++ == 0)
+                memInstr = head.instruction;
+            if (dcProfile || traceWriter)
+                recordDataAccess(iData);
+        }
+        if (head.regToWrite != 0 && head.value != UINT64_MAX)
+            regs[head.regToWrite] = head.value;
+        if (head.regToWrite != 0 && core.producer[head.regToWrite] == head.seq)
+            core.producer[head.regToWrite] = NO_PRODUCER;
+        if (head.handler == DECODE_BRANCH || head.handler == DECODE_JR)
+        {
+            // only branches on the right path train the predictor
+            if (predictor)
+            {
+                BranchKind kind = head.handler == DECODE_BRANCH ? BRANCH_CONDITIONAL : head.data.rs() == REG_RA ? BRANCH_RETURN : BRANCH_INDIRECT;
+                predictor->update(head.pc, kind, head.taken, head.nextPc);
+            }
+            simStats.branches++;
+            if (head.mispredicted)
+                simStats.mispredicts++;
+        }
+        if (head.instruction == 0xfeedfeed)
+            cycleStatus = HALTED;
+        else if (head.instruction != 0)
+            counted++;
+        if (n == 0)
+            first = head.instruction;
+        if (head.seq >= core.refillSeq)
+            core.refillCause = CAUSE_OTHER;
+        if (head.isLoad || head.isStore)
+            core.lsq.pop_front();
+        core.rob.pop_front();
+        retired++;
+    }
+    simStats.instructions += counted;
+    // like in the pipelines, a cycle that only retired nops or the halt isn't a base cycle
+    CycleCause cause = counted ? CAUSE_BASE : retired ? CAUSE_OTHER : oooStallCause();
+    // the cycles lost to a mispredict are the ones charged to it
+    if (cause == CAUSE_MISPREDICT)
+        simStats.mispredictCycles++;
+    cpiStack[cause]++;
+    return first;
+}
+
+// what a cycle in which nothing commits is charged to: while the reorder buffer is empty the I-cache, or the
+// mispredict or exception that emptied it. Otherwise the D-cache when its head is a load or store, and a
+// mispredict or exception from the branch or instruction that raised it on, until the first instruction of
+// the right path has committed
+CycleCause Simulator::Machine::oooStallCause()
+{
+    OutOfOrderCore &core = *ooo;
+    if (core.rob.empty())
+        return fetchHaltCycles > 0 ? CAUSE_ICACHE : core.refillCause;
+    RobEntry &head = core.rob.front();
+    if (head.isLoad || head.isStore)
+        return CAUSE_DCACHE;
+    return head.seq >= core.squashSeq ? core.refillCause : CAUSE_OTHER;
+}
+
+// sends up to issueWidth instructions whose operands are ready to execute, oldest first. ALU operations
+// take a cycle and loads two, more on a miss. A branch or jr that fetch followed the wrong way sends it back
+uint32_t Simulator::Machine::oooIssue(uint32_t &memOps, uint32_t &memInstr)
+{
+    OutOfOrderCore &core = *ooo;
+    uint32_t first = 0;
+    uint32_t issued = 0;
+    for (size_t i = 0; i < core.issueQueue.size() && issued < core.config.issueWidth;)
+    {
+        RobEntry &entry = core.entry(core.issueQueue[i]);
+        uint32_t memOpsBefore = memOps;
+        if (!oooReadOperands(entry) || (entry.isLoad && !oooIssueLoad(entry, memOps)))
+        {
+            i++;
+            continue;
+        }
+        core.issueQueue.erase(core.issueQueue.begin() + i);
+        if (issued++ == 0)
+            first = entry.instruction;
+        if (entry.isLoad)
+        {
+            if (memInstr == 0 && memOps > memOpsBefore)
+                memInstr = entry.instruction;
+            continue;
+        }
+
+        InstructionData &data = entry.data;
+        entry.done = true;
+        entry.doneCycle = pipeState.cycle + 1;
+        if (entry.isStore)
+        {
+            entry.address = data.data.iData.rsValue + data.data.iData.seImm;
+            entry.addressReady = true;
+        }
+        else if (data.tag == R)
+        {
+            entry.exception = handleRInstEx(data.data.rData, entry.value);
+        }
+        else if (data.tag == I)
+        {
+            entry.exception = handleImmInstEx(data.data.iData, entry.value);
+        }
+
+        if (entry.handler == DECODE_BRANCH || entry.handler == DECODE_JR)
+        {
+            if (entry.handler == DECODE_JR)
+            {
+                entry.taken = true;
+                entry.nextPc = data.data.rData.rsValue;
+            }
+            else
+            {
+                entry.taken = isBranchTaken(data.data.iData);
+                entry.nextPc = entry.taken ? entry.pc + 4 + (data.data.iData.seImm << 2) : entry.pc + 8;
+            }
+            if (entry.nextPc != entry.predictedPc)
+            {
+                // the queue changes, the rest issue next cycle
+                entry.mispredicted = true;
+                oooRedirect(entry.seq, entry.nextPc);
+                break;
+            }
+        }
+    }
+    return first;
+}
+
+// moves up to width instructions fetched in an earlier cycle into the reorder buffer, renaming their registers.
+// decode knows where everything but a branch or jr goes after its delay slot, and sends fetch there if it
+// went elsewhere
+uint32_t Simulator::Machine::oooRename()
+{
+    OutOfOrderCore &core = *ooo;
+    uint32_t first = 0;
+    for (uint32_t n = 0; n < core.config.width && !core.fetchQueue.empty(); n++)
+    {
+        FetchedInstruction fetched = core.fetchQueue.front();
+        if (fetched.cycle >= pipeState.cycle)
+            break;
+        const DecodedInstruction &decoded = decode(fetched.pc, fetched.instruction);
+        RobEntry entry{};
+        entry.data = decoded.data;
+        bool isLoad = entry.data.isMemRead();
+        bool isStore = isMemAccess(entry.data) && !isLoad;
+        // nops, the halt, jumps and illegal instructions are done as they come in
+        bool issues = decoded.handler != DECODE_JUMP && decoded.handler != DECODE_ILLEGAL &&
+                      fetched.instruction != 0 && fetched.instruction != 0xfeedfeed;
+        if (core.rob.size() == core.config.robSize)
+        {
+            simStats.robFullStalls++;
+            break;
+        }
+        if (issues && core.issueQueue.size() == core.config.iqSize)
+        {
+            simStats.iqFullStalls++;
+            break;
+        }
+        if ((isLoad || isStore) && core.lsq.size() == core.config.lsqSize)
+        {
+            simStats.lsqFullStalls++;
+            break;
+        }
+        core.fetchQueue.pop_front();
+
+        entry.seq = core.nextSeq++;
+        entry.pc = fetched.pc;
+        entry.instruction = fetched.instruction;
+        entry.handler = decoded.handler;
+        entry.regToWrite = decoded.regToWrite;
+        entry.value = decoded.regWriteValue;
+        entry.rsProducer = NO_PRODUCER;
+        entry.rtProducer = NO_PRODUCER;
+        if (entry.data.tag == R || entry.data.tag == I)
+        {
+            uint8_t rs = entry.data.rs();
+            uint8_t rt = readsRt(entry.data) ? entry.data.rt() : 0;
+            entry.rsProducer = core.producer[rs];
+            entry.rtProducer = core.producer[rt];
+            entry.data.rsValue(regs[rs]);
+            entry.data.rtValue(regs[rt]);
+        }
+        entry.predictedPc = fetched.predictedPc;
+        entry.done = !issues;
+        entry.doneCycle = pipeState.cycle;
+        entry.exception = decoded.handler == DECODE_ILLEGAL;
+        entry.isLoad = isLoad;
+        entry.isStore = isStore;
+        if (isLoad || isStore)
+            entry.size = memAccessSize(entry.data.data.iData.opcode);
+        if (entry.regToWrite != 0)
+            core.producer[entry.regToWrite] = entry.seq;
+        if (predictor && decoded.handler == DECODE_JUMP && decoded.regToWrite == REG_RA)
+            predictor->pushReturn(fetched.pc + 8);
+        core.rob.push_back(entry);
+        if (issues)
+            core.issueQueue.push_back(entry.seq);
+        if (isLoad || isStore)
+            core.lsq.push_back(entry.seq);
+        if (n == 0)
+            first = entry.instruction;
+
+        if (decoded.handler != DECODE_BRANCH && decoded.handler != DECODE_JR)
+        {
+            uint32_t nextPc = decoded.handler == DECODE_JUMP ? decoded.target : fetched.pc + 8;
+            if (fetched.predictedPc != nextPc)
+                oooRedirect(entry.seq, nextPc);
+        }
+    }
+    return first;
+}
+
+// fetches up to width instructions of one I-cache block into the fetch queue. fetch goes to the predicted
+// target after the delay slot of an instruction predicted taken
+uint32_t Simulator::Machine::oooFetch()
+{
+    OutOfOrderCore &core = *ooo;
+    uint32_t first = 0;
+    if (fetchHaltCycles > 0)
+        fetchHaltCycles--;
+    uint32_t blockSize = icache->getBlockSize();
+    uint32_t block = pc / blockSize;
+    for (uint32_t n = 0; n < core.config.width && !haltSeen && !fetchStopped && fetchHaltCycles == 0 &&
+                         core.fetchQueue.size() < core.config.fetchQueueSize && pc / blockSize == block; n++)
+    {
+        uint32_t instruction = 0;
+        auto delay = icache->getCacheValue(pc, instruction, MemEntrySize::WORD_SIZE, pipeState.cycle, pc);
+        if (delay)
+        {
+            // cache miss, halt
+            fetchHaltCycles = delay;
+            break;
+        }
+        if (icProfile) icProfile->access(pc, WORD_SIZE);
+        if (traceWriter) traceWriter->record(pc, TRACE_FETCH, WORD_SIZE);
+        if (n == 0)
+            first = instruction;
+        if (instruction == 0xfeedfeed)
+            haltSeen = true;
+        FetchedInstruction fetched{pc, instruction, pc + 8, pipeState.cycle};
+        // the delay slot of an instruction predicted taken, its own prediction doesn't count
+        bool redirect = pc == delaySlotPc;
+        if (!redirect && predictor)
+        {
+            bool popsReturn = false;
+            fetched.predictedPc = predictor->predict(pc, popsReturn);
+            if (popsReturn)
+                predictor->popReturn();
+            if (fetched.predictedPc != pc + 8)
+            {
+                delaySlotPc = pc + 4;
+                branchTargetPc = fetched.predictedPc;
+            }
+        }
+        core.fetchQueue.push_back(fetched);
+        if (redirect)
+        {
+            pc = branchTargetPc;
+            delaySlotPc = UINT32_MAX;
+            branchTargetPc = UINT32_MAX;
+            break;
+        }
+        pc += 4;
+    }
+    return first;
+}
+
+// runCycle for the out-of-order core. Within a cycle commit goes first, then issue, rename and fetch, so an
+// instruction spends at least a cycle in each. The pipe state shows the oldest instruction each stage worked
+// on: IF fetch, ID rename, EX issue, MEM the first D-cache access and WB commit
+CycleStatus Simulator::Machine::runOooCycle()
+{
+    OutOfOrderCore &core = *ooo;
+
+    uint32_t outstanding = dcache->getOutstandingMisses(pipeState.cycle);
+    if (outstanding) {
+        simStats.missCycles++;
+        simStats.outstandingMisses += outstanding;
+    }
+
+    // the load that missed in a blocking D-cache makes its access again once the block is in
+    uint32_t memOps = 0;
+    uint32_t memInstr = 0;
+    if (core.retrying && core.dcacheFreeCycle <= pipeState.cycle)
+    {
+        IData &iData = core.retryData;
+        uint32_t data = 0;
+        int delay = dcache->getCacheValue(iData.rsValue + iData.seImm, data, core.retrySize, pipeState.cycle, core.retryPc);
+        if (delay)
+        {
+            core.dcacheFreeCycle = pipeState.cycle + delay;
+        }
+        else
+        {
+            core.retrying = false;
+            memOps++;
+            if (dcProfile || traceWriter)
+                recordDataAccess(iData);
+            if (core.retryLive)
+            {
+                RobEntry &load = core.entry(core.retrySeq);
+                memInstr = load.instruction;
+                load.value = data;
+                load.done = true;
+                load.doneCycle = pipeState.cycle + 2;
+            }
+        }
+    }
+
+    uint32_t committed = oooCommit(memOps, memInstr);
+    uint32_t issued = oooIssue(memOps, memInstr);
+    uint32_t renamed = oooRename();
+    uint32_t fetched = oooFetch();
+
+    pipeState.cycle++;
+    pipeState.ifInstr = fetched;
+    pipeState.idInstr = renamed;
+    pipeState.exInstr = issued;
+    pipeState.memInstr = memInstr;
+    pipeState.wbInstr = committed;
+    simStats.totalCycles++;
+    return cycleStatus;
+}
+
+// a cycle of whichever pipeline the machine runs
+inline CycleStatus Simulator::Machine::runPipelineCycle()
+{
+    if (ooo)
+        return runOooCycle();
+    return wide ? runWideCycle() : runCycle();
+}
+
+// SAMPLING
+
+// the fast-forward waits out a miss by moving the clock on, the caches see the same cycles a pipeline would.
+// the cycles are charged to cause
+void Simulator::Machine::advanceClock(uint32_t cycles, CycleCause cause)
+{
+    pipeState.cycle += cycles;
+    simStats.totalCycles += cycles;
+    cpiStack[cause] += cycles;
+}
+
+// the D-cache access of a load or store in the fast-forward, made again after a miss until it goes through.
+// a non-blocking D-cache only holds it up while its MSHRs or write buffer are full, value gets what a load read
+void Simulator::Machine::functionalMemAccess(IData &iData, uint32_t pc, uint64_t &value)
+{
+    uint32_t addr = iData.rsValue + iData.seImm;
+    MemEntrySize size = memAccessSize(iData.opcode);
+    bool load = iData.opcode == OP_LBU || iData.opcode == OP_LHU || iData.opcode == OP_LW;
+    uint32_t data = 0;
+    for (;;)
+    {
+        int delay;
+        if (dcache->isNonBlocking())
+        {
+            delay = load ? dcache->issueLoad(addr, data, size, pipeState.cycle, pc) : dcache->issueStore(addr, iData.rtValue, size, pipeState.cycle, pc);
+            if (delay != MSHR_FULL && delay != WRITE_BUFFER_FULL)
+                break;
+            delay = 1;
+        }
+        else
+        {
+            delay = load ? dcache->getCacheValue(addr, data, size, pipeState.cycle, pc) : dcache->setCacheValue(addr, iData.rtValue, size, pipeState.cycle, pc);
+            if (!delay)
+                break;
+        }
+        advanceClock(delay, CAUSE_DCACHE);
+    }
+    if (load)
+        value = data;
+    if (dcProfile || traceWriter)
+        recordDataAccess(iData);
+}
+
+// runs the instruction at pc to the end, without the pipeline. it goes through the I-cache and D-cache and
+// trains the predictor the way the pipeline would, and takes a cycle plus the latency of its misses
+CycleStatus Simulator::Machine::runFunctional()
+{
+    uint32_t instruction = 0;
+    while (int delay = icache->getCacheValue(pc, instruction, MemEntrySize::WORD_SIZE, pipeState.cycle, pc))
+        advanceClock(delay, CAUSE_ICACHE);
+    if (icProfile) icProfile->access(pc, WORD_SIZE);
+    if (traceWriter) traceWriter->record(pc, TRACE_FETCH, WORD_SIZE);
+    advanceClock(1, baseCause(instruction));
+    if (instruction == 0xfeedfeed)
+    {
+        cycleStatus = HALTED;
+        return cycleStatus;
+    }
+
+    const DecodedInstruction &decoded = decode(pc, instruction);
+    InstructionData data = decoded.data;
+    if (data.tag == R)
+    {
+        data.data.rData.rsValue = regs[data.data.rData.rs];
+        data.data.rData.rtValue = regs[data.data.rData.rt];
+    }
+    else if (data.tag == I)
+    {
+        data.data.iData.rsValue = regs[data.data.iData.rs];
+        data.data.iData.rtValue = regs[data.data.iData.rt];
+    }
+
+    uint64_t value = decoded.regWriteValue;
+    uint32_t nextNpc = functionalNpc + 4;
+    bool exception = false;
+    bool taken = false;
+    switch (decoded.handler)
+    {
+    case DECODE_PLAIN:
+        if (isMemAccess(data))
+            functionalMemAccess(data.data.iData, pc, value);
+        else if (data.tag == R)
+            exception = handleRInstEx(data.data.rData, value);
+        else if (data.tag == I)
+            exception = handleImmInstEx(data.data.iData, value);
+        break;
+    case DECODE_JR:
+        taken = true;
+        nextNpc = data.data.rData.rsValue;
+        break;
+    case DECODE_BRANCH:
+        taken = isBranchTaken(data.data.iData);
+        if (taken)
+            nextNpc = decoded.target;
+        break;
+    case DECODE_JUMP:
+        nextNpc = decoded.target;
+        if (predictor && decoded.regToWrite == REG_RA)
+            predictor->pushReturn(pc + 8);
+        break;
+    case DECODE_ILLEGAL:
+        exception = true;
+        break;
+    }
+
+    if (exception)
+    {
+        pc = EXCEPTION_ADDR;
+        functionalNpc = EXCEPTION_ADDR + 4;
+        return cycleStatus;
+    }
+    if (predictor && (decoded.handler == DECODE_BRANCH || decoded.handler == DECODE_JR))
+    {
+        // fetch would have asked for a prediction, which pops the return address stack on a return
+        bool popsReturn = false;
+        predictor->predict(pc, popsReturn);
+        if (popsReturn)
+            predictor->popReturn();
+        BranchKind kind = decoded.handler == DECODE_BRANCH ? BRANCH_CONDITIONAL : data.rs() == REG_RA ? BRANCH_RETURN : BRANCH_INDIRECT;
+        predictor->update(pc, kind, taken, nextNpc);
+    }
+    if (value != UINT64_MAX && decoded.regToWrite != 0)
+        regs[decoded.regToWrite] = value;
+    if (instruction != 0)
+        simStats.instructions++;
+    pc = functionalNpc;
+    functionalNpc = nextNpc;
+    return cycleStatus;
+}
+
+// whether the last instruction in the pipeline has written back
+bool Simulator::Machine::pipelineEmpty()
+{
+    if (ooo)
+        return ooo->rob.empty() && ooo->fetchQueue.empty() && !ooo->retrying;
+    if (memHaltCycles > 0)
+        return false;
+    if (wide)
+    {
+        if (wideIfidCount != 0)
+            return false;
+        for (uint32_t i = 0; i < wideConfig.width; i++)
+        {
+            if (wideIdex[i].instruction != 0 || wideExmem[i].instruction != 0 || wideMemwb[i].instruction != 0)
+                return false;
+        }
+        return true;
+    }
+    return ifid.instruction == 0 && idex.instruction == 0 && exmem.instruction == 0 && memwb.instruction == 0;
+}
+
+// hands the fast-forward's pc over to the empty pipeline, a taken branch it stopped in the delay slot of
+// sends fetch to its target after it
+void Simulator::Machine::startUnit()
+{
+    ifid = IFID{};
+    idex = IDEX{};
+    exmem = EXMEM{};
+    memwb = MEMWB{};
+    for (uint32_t i = 0; i < MAX_ISSUE_WIDTH; i++)
+    {
+        wideIfid[i] = IFID{};
+        wideIdex[i] = IDEX{};
+        wideExmem[i] = EXMEM{};
+        wideMemwb[i] = MEMWB{};
+        wideMemDone[i] = false;
+    }
+    wideIfidCount = 0;
+    haltSeen = false;
+    fetchHaltCycles = 0;
+    memHaltCycles = 0;
+    lastPcFetch = UINT32_MAX;
+    memset(regReadyCycle, 0, sizeof(regReadyCycle));
+    fetchStopped = false;
+    delaySlotPc = UINT32_MAX;
+    branchTargetPc = UINT32_MAX;
+    if (functionalNpc != pc + 4)
+    {
+        delaySlotPc = pc;
+        branchTargetPc = functionalNpc;
+    }
+    samplingPhase = SAMPLE_WARMING;
+    phaseEnd = static_cast<uint64_t>(simStats.instructions) + samplingConfig.warming;
+    if (samplingConfig.warming == 0)
+        startMeasuring();
+}
+
+void Simulator::Machine::startMeasuring()
+{
+    samplingPhase = SAMPLE_MEASURING;
+    phaseEnd = static_cast<uint64_t>(simStats.instructions) + samplingConfig.unitSize;
+    unitStartCycle = pipeState.cycle;
+    unitStartInstructions = simStats.instructions;
+}
+
+// the drained pipeline leaves pc, and a branch whose delay slot it didn't fetch yet, to the fast-forward
+void Simulator::Machine::startFastForward()
+{
+    functionalNpc = branchTargetPc != UINT32_MAX ? branchTargetPc : pc + 4;
+    delaySlotPc = UINT32_MAX;
+    branchTargetPc = UINT32_MAX;
+    samplingPhase = SAMPLE_FAST_FORWARD;
+    phaseEnd = static_cast<uint64_t>(simStats.instructions) + samplingConfig.period - samplingConfig.warming - samplingConfig.unitSize;
+}
+
+// a step of a sampled run: an instruction of the fast-forward or a cycle of the pipeline, after which the
+// run moves on to the next phase once the instruction count reaches its end. A halt ends the run in any
+// phase, a unit it cuts short isn't measured
+CycleStatus Simulator::Machine::runSampledStep()
+{
+    if (samplingPhase == SAMPLE_FAST_FORWARD)
+    {
+        if (simStats.instructions < phaseEnd)
+            runFunctional();
+        if (simStats.instructions >= phaseEnd && cycleStatus != HALTED)
+            startUnit();
+        return cycleStatus;
+    }
+
+    runPipelineCycle();
+    if (cycleStatus == HALTED)
+        return cycleStatus;
+    switch (samplingPhase)
+    {
+    case SAMPLE_WARMING:
+        if (simStats.instructions >= phaseEnd)
+            startMeasuring();
+        break;
+    case SAMPLE_MEASURING:
+        if (simStats.instructions >= phaseEnd)
+        {
+            // a wide pipeline can retire past the end of the unit, the CPI counts what it did retire
+            double cpi = static_cast<double>(pipeState.cycle - unitStartCycle) / (simStats.instructions - unitStartInstructions);
+            simStats.sampleUnits++;
+            unitCpiSum += cpi;
+            unitCpiSquares += cpi * cpi;
+            samplingPhase = SAMPLE_DRAINING;
+            fetchStopped = true;
+        }
+        break;
+    case SAMPLE_DRAINING:
+        if (pipelineEmpty())
+            startFastForward();
+        break;
+    case SAMPLE_FAST_FORWARD:
+        break;
+    }
+    return cycleStatus;
+}
+
+// a cycle of the pipeline, or a step of a sampled run
+inline CycleStatus Simulator::Machine::runNextCycle()
+{
+    if (sampling)
+        return runSampledStep();
+    return runPipelineCycle();
+}
+
+// jumps over the cycles of a cache miss wait in which runCycle would only count, in one step instead of
+// one call per cycle. Returns how many of at most cycles it skipped, 0 when the next cycle has to run
+uint32_t Simulator::Machine::skipStallCycles(uint32_t cycles)
+{
+    // the fast-forward waits out its misses itself
+    if (sampling && samplingPhase == SAMPLE_FAST_FORWARD)
+        return 0;
+    uint32_t skip = 0;
+    // what the skipped cycles are charged to
+    CycleCause cause = CAUSE_ICACHE;
+    if (memHaltCycles > 1) {
+        // the whole pipeline waits for the D-cache, the last cycle of the wait runs
+        cause = CAUSE_DCACHE;
+        skip = std::min<uint32_t>(memHaltCycles - 1, cycles);
+        memHaltCycles -= skip;
+        if (fetchHaltCycles > 0) fetchHaltCycles = std::max(fetchHaltCycles - static_cast<int>(skip), 0);
+    } else if (ooo) {
+        // an empty out-of-order core waiting for the I-cache
+        if (!ooo->rob.empty() || !ooo->fetchQueue.empty() || ooo->retrying || haltSeen || fetchStopped || fetchHaltCycles <= 1)
+            return 0;
+        skip = std::min<uint32_t>(fetchHaltCycles - 1, cycles);
+        fetchHaltCycles -= skip;
+        pipeState.ifInstr = 0;
+        pipeState.idInstr = 0;
+        pipeState.exInstr = 0;
+        pipeState.memInstr = 0;
+        pipeState.wbInstr = 0;
+    } else if (wide) {
+        // an empty superscalar pipeline waiting for the I-cache
+        if (wideIfidCount != 0 || fetchStopped || fetchHaltCycles <= 1)
+            return 0;
+        for (uint32_t i = 0; i < wideConfig.width; i++) {
+            if (wideIdex[i].instruction != 0 || wideExmem[i].instruction != 0 || wideMemwb[i].instruction != 0)
+                return 0;
+        }
+        // the bubbles in the latches are charged to the same cause as the ones fetch inserts, so the first
+        // cycles of a wait run until those behind IF/ID have written back
+        cause = fetchWaitCause;
+        if (wideIfid[0].cause != cause || wideCause(wideIdex, wideConfig.width) != cause ||
+            wideCause(wideExmem, wideConfig.width) != cause || wideCause(wideMemwb, wideConfig.width) != cause)
+            return 0;
+        skip = std::min<uint32_t>(fetchHaltCycles - 1, cycles);
+        fetchHaltCycles -= skip;
+        pipeState.ifInstr = 0;
+        pipeState.idInstr = 0;
+        pipeState.exInstr = 0;
+        pipeState.memInstr = 0;
+        pipeState.wbInstr = 0;
+    } else if (idex.instruction == 0 && exmem.instruction == 0 && memwb.instruction == 0) {
+        // nothing but bubbles behind ID, a cycle changes nothing while ID and IF both wait
+        uint32_t idWait = 0;
+        if (ifid.instruction == 0) {
+            idWait = UINT32_MAX;
+        } else {
+            const DecodedInstruction &decoded = decode(ifid.pc, ifid.instruction);
+            uint32_t ready = std::max(regReadyCycle[decoded.data.rs()], regReadyCycle[decoded.data.rt()]);
+            if (decoded.handler != DECODE_ILLEGAL && ready > pipeState.cycle) idWait = ready - pipeState.cycle;
+        }
+        // a stalled ID refetches the instruction it already has, IF otherwise waits for the I-cache. a sampled
+        // run that drains the pipeline fetches nothing, the cycle it is empty in has to run
+        bool refetch = ifid.instruction != 0 && lastPcFetch == pc && !fetchStopped;
+        uint32_t ifWait = refetch ? UINT32_MAX : 0;
+        if (!refetch && lastPcFetch != pc && !haltSeen && !fetchStopped && fetchHaltCycles > 1) ifWait = fetchHaltCycles - 1;
+        skip = std::min(std::min(idWait, ifWait), cycles);
+        if (skip == 0)
+            return 0;
+        // ID passes on the bubbles of the I-cache miss, or inserts its own while it waits for the D-cache.
+        // like in the superscalar pipeline, the ones behind it have to be charged to the same cause
+        cause = ifid.instruction == 0 ? fetchWaitCause : CAUSE_DCACHE;
+        if ((ifid.instruction == 0 && ifid.cause != cause) || idex.cause != cause || exmem.cause != cause || memwb.cause != cause)
+            return 0;
+        if (!refetch) fetchHaltCycles -= skip;
+        pipeState.ifInstr = refetch ? lastInstructionFetch : 0;
+        pipeState.idInstr = ifid.instruction;
+        pipeState.exInstr = 0;
+        pipeState.memInstr = 0;
+        pipeState.wbInstr = 0;
+    }
+    if (skip == 0)
+        return 0;
+
+    uint32_t missCycles;
+    simStats.outstandingMisses += dcache->getOutstandingMisses(pipeState.cycle, skip, missCycles);
+    simStats.missCycles += missCycles;
+    pipeState.cycle += skip;
+    simStats.totalCycles += skip;
+    cpiStack[cause] += skip;
+    return skip;
+}
+
+// the counters of the run so far, gathered from the pipeline and the caches
+void Simulator::Machine::collectStats(SimulationStats &s)
+{
+    s = SimulationStats{};
+    s.totalCycles = pipeState.cycle;
+    s.icHits = icache->getHits();
+    s.icMisses = icache->getMisses();
+    s.dcHits = dcache->getHits();
+    s.dcMisses = dcache->getMisses();
+    if (l2cache) {
+        s.l2Hits = l2cache->getHits();
+        s.l2Misses = l2cache->getMisses();
+    }
+    if (l3cache) {
+        s.l3Hits = l3cache->getHits();
+        s.l3Misses = l3cache->getMisses();
+    }
+    s.dcMergedMisses = dcache->getMergedMisses();
+    s.mshrFullStalls = dcache->getMshrFullStalls();
+    s.missCycles = simStats.missCycles;
+    s.outstandingMisses = simStats.outstandingMisses;
+    s.icPrefetches = icache->getPrefetchesIssued();
+    s.icUsefulPrefetches = icache->getUsefulPrefetches();
+    s.icLatePrefetches = icache->getLatePrefetches();
+    s.icPollutingPrefetches = icache->getPollutingPrefetches();
+    s.dcPrefetches = dcache->getPrefetchesIssued();
+    s.dcUsefulPrefetches = dcache->getUsefulPrefetches();
+    s.dcLatePrefetches = dcache->getLatePrefetches();
+    s.dcPollutingPrefetches = dcache->getPollutingPrefetches();
+    s.bufferedWrites = dcache->getBufferedWrites();
+    s.coalescedWrites = dcache->getCoalescedWrites();
+    s.writeBufferStalls = dcache->getWriteBufferStalls();
+    s.branches = simStats.branches;
+    s.mispredicts = simStats.mispredicts;
+    s.mispredictCycles = simStats.mispredictCycles;
+    s.instructions = simStats.instructions;
+    s.dependencySplits = simStats.dependencySplits;
+    s.structuralSplits = simStats.structuralSplits;
+    s.robFullStalls = simStats.robFullStalls;
+    s.iqFullStalls = simStats.iqFullStalls;
+    s.lsqFullStalls = simStats.lsqFullStalls;
+    s.squashedInstructions = simStats.squashedInstructions;
+    s.sampleUnits = simStats.sampleUnits;
+    if (s.sampleUnits > 0)
+        s.sampledCpi = unitCpiSum / s.sampleUnits;
+    if (s.sampleUnits > 1)
+    {
+        // the 95% confidence interval of the mean, from the variance between units
+        double variance = std::max((unitCpiSquares - s.sampleUnits * s.sampledCpi * s.sampledCpi) / (s.sampleUnits - 1), 0.0);
+        s.sampledCpiError = 1.96 * sqrt(variance / s.sampleUnits);
+    }
+    s.baseCycles = cpiStack[CAUSE_BASE];
+    s.icacheStallCycles = cpiStack[CAUSE_ICACHE];
+    s.dcacheStallCycles = cpiStack[CAUSE_DCACHE];
+    s.loadUseStallCycles = cpiStack[CAUSE_LOAD_USE];
+    s.branchStallCycles = cpiStack[CAUSE_BRANCH];
+    s.mispredictStallCycles = cpiStack[CAUSE_MISPREDICT];
+    s.exceptionStallCycles = cpiStack[CAUSE_EXCEPTION];
+    s.otherStallCycles = cpiStack[CAUSE_OTHER];
+}
+
+
+void Simulator::Machine::freeCaches()
+{
+    delete icache;
+    delete dcache;
+    delete l2cache;
+    delete l3cache;
+    icache = dcache = l2cache = l3cache = NULL;
+}
+
+Simulator::Machine::~Machine()
+{
+    freeCaches();
+    delete icProfile;
+    delete dcProfile;
+    delete traceWriter;
+    delete predictor;
+    delete ooo;
+}
+
+// CHECKPOINTS
+
+// the bytes of memory a checkpoint holds. The memory store turns down any access that reaches its last byte,
+// so no program can have used that one
+#define CHECKPOINT_MEMORY_SIZE (MEMORY_SIZE - 1)
+
+// a config the simulator was set up with, which a checkpoint saves and a restore has to find the same
+template <typename T> static void checkpointConfig(CheckpointWriter &out, const T &value)
+{
+    out.put(value);
+}
+
+template <typename T> static void checkpointConfig(CheckpointReader &in, const T &value)
+{
+    in.expect(value);
+}
+
+template <typename Checkpoint> static void checkpointCacheFields(Checkpoint &checkpoint, const CacheConfig &config)
+{
+    checkpointConfig(checkpoint, config.cacheSize);
+    checkpointConfig(checkpoint, config.blockSize);
+    checkpointConfig(checkpoint, config.type);
+    checkpointConfig(checkpoint, config.missLatency);
+    checkpointConfig(checkpoint, config.associativity);
+    checkpointConfig(checkpoint, config.replacement);
+    checkpointConfig(checkpoint, config.hitLatency);
+    checkpointConfig(checkpoint, config.inclusion);
+    checkpointConfig(checkpoint, config.mshrs);
+    checkpointConfig(checkpoint, config.prefetcher);
+    checkpointConfig(checkpoint, config.prefetchDegree);
+    checkpointConfig(checkpoint, config.prefetchDistance);
+    checkpointConfig(checkpoint, config.writePolicy);
+    checkpointConfig(checkpoint, config.writeAllocate);
+    checkpointConfig(checkpoint, config.writeBufferDepth);
+}
+
+// the configs go first, field by field, so that the writer and the reader go through the same ones
+template <typename Checkpoint> void Simulator::Machine::checkpointConfigs(Checkpoint &checkpoint)
+{
+    checkpointConfig(checkpoint, l2cache != NULL);
+    checkpointConfig(checkpoint, l3cache != NULL);
+    checkpointConfig(checkpoint, memoryImage != NULL);
+    checkpointCacheFields(checkpoint, icConfig);
+    checkpointCacheFields(checkpoint, dcConfig);
+    checkpointCacheFields(checkpoint, l2Config);
+    checkpointCacheFields(checkpoint, l3Config);
+    checkpointConfig(checkpoint, predictor != NULL);
+    if (predictor)
+    {
+        checkpointConfig(checkpoint, predictorConfig.type);
+        checkpointConfig(checkpoint, predictorConfig.tableSize);
+        checkpointConfig(checkpoint, predictorConfig.historyBits);
+        checkpointConfig(checkpoint, predictorConfig.btbSize);
+        checkpointConfig(checkpoint, predictorConfig.btbWays);
+        checkpointConfig(checkpoint, predictorConfig.rasDepth);
+    }
+    checkpointConfig(checkpoint, wide);
+    if (wide)
+    {
+        checkpointConfig(checkpoint, wideConfig.width);
+        checkpointConfig(checkpoint, wideConfig.memOpsPerCycle);
+        checkpointConfig(checkpoint, wideConfig.branchInSlot0);
+    }
+    checkpointConfig(checkpoint, ooo != NULL);
+    if (ooo)
+    {
+        checkpointConfig(checkpoint, ooo->config.width);
+        checkpointConfig(checkpoint, ooo->config.issueWidth);
+        checkpointConfig(checkpoint, ooo->config.memOpsPerCycle);
+        checkpointConfig(checkpoint, ooo->config.commitWidth);
+        checkpointConfig(checkpoint, ooo->config.fetchQueueSize);
+        checkpointConfig(checkpoint, ooo->config.robSize);
+        checkpointConfig(checkpoint, ooo->config.iqSize);
+        checkpointConfig(checkpoint, ooo->config.lsqSize);
+    }
+    checkpointConfig(checkpoint, sampling);
+    if (sampling)
+    {
+        checkpointConfig(checkpoint, samplingConfig.period);
+        checkpointConfig(checkpoint, samplingConfig.warming);
+        checkpointConfig(checkpoint, samplingConfig.unitSize);
+    }
+}
+
+// the configs, then the registers and pipeline, the caches from the top down, the predictor and the memory
+// image, or what the MemoryImage saves. returns -EIO if the memory can't be read
+int Simulator::Machine::saveCheckpoint(CheckpointWriter &out)
+{
+    checkpointConfigs(out);
+    out.put(regs);
+    out.put(pc);
+    out.put(pipeState);
+    out.put(ifid);
+    out.put(idex);
+    out.put(exmem);
+    out.put(memwb);
+    out.put(haltSeen);
+    out.put(fetchHaltCycles);
+    out.put(memHaltCycles);
+    out.put(lastPcFetch);
+    out.put(lastInstructionFetch);
+    out.put(branchTargetPc);
+    out.put(regReadyCycle);
+    out.put(cycleStatus);
+    out.put(simStats);
+    out.put(wideIfid);
+    out.put(wideIfidCount);
+    out.put(wideIdex);
+    out.put(wideExmem);
+    out.put(wideMemwb);
+    out.put(wideMemDone);
+    out.put(delaySlotPc);
+    if (ooo)
+    {
+        out.putSequence(ooo->fetchQueue);
+        out.putSequence(ooo->rob);
+        out.put(ooo->nextSeq);
+        out.put(ooo->producer);
+        out.putVector(ooo->issueQueue);
+        out.putSequence(ooo->lsq);
+        out.put(ooo->dcacheFreeCycle);
+        out.put(ooo->retrying);
+        out.put(ooo->retryLive);
+        out.put(ooo->retrySeq);
+        out.put(ooo->retryData);
+        out.put(ooo->retrySize);
+        out.put(ooo->retryPc);
+        out.put(ooo->refillCause);
+        out.put(ooo->squashSeq);
+        out.put(ooo->refillSeq);
+    }
+    out.put(samplingPhase);
+    out.put(phaseEnd);
+    out.put(functionalNpc);
+    out.put(unitStartCycle);
+    out.put(unitStartInstructions);
+    out.put(unitCpiSum);
+    out.put(unitCpiSquares);
+    out.put(fetchStopped);
+    out.put(cpiStack);
+    out.put(fetchWaitCause);
+
+    icache->save(out);
+    dcache->save(out);
+    if (l2cache) l2cache->save(out);
+    if (l3cache) l3cache->save(out);
+    if (predictor) predictor->save(out);
+
+    if (memoryImage) {
+        memoryImage->save(out);
+        return 0;
+    }
+    vector<uint8_t> image(CHECKPOINT_MEMORY_SIZE);
+    if (mainMem->readBlock(0, image.data(), image.size()))
+        return -EIO;
+    out.write(image.data(), image.size());
+    return 0;
+}
+
+// loads what saveCheckpoint wrote, after checkpointConfigs found the same configs. The decode table only
+// caches what the instructions at each pc decode to, it starts over
+void Simulator::Machine::loadCheckpoint(CheckpointReader &in)
+{
+    in.get(regs);
+    in.get(pc);
+    in.get(pipeState);
+    in.get(ifid);
+    in.get(idex);
+    in.get(exmem);
+    in.get(memwb);
+    in.get(haltSeen);
+    in.get(fetchHaltCycles);
+    in.get(memHaltCycles);
+    in.get(lastPcFetch);
+    in.get(lastInstructionFetch);
+    in.get(branchTargetPc);
+    in.get(regReadyCycle);
+    in.get(cycleStatus);
+    in.get(simStats);
+    in.get(wideIfid);
+    in.get(wideIfidCount);
+    in.get(wideIdex);
+    in.get(wideExmem);
+    in.get(wideMemwb);
+    in.get(wideMemDone);
+    in.get(delaySlotPc);
+    if (ooo)
+    {
+        in.getSequence(ooo->fetchQueue);
+        in.getSequence(ooo->rob);
+        in.get(ooo->nextSeq);
+        in.get(ooo->producer);
+        in.getVector(ooo->issueQueue);
+        in.getSequence(ooo->lsq);
+        in.get(ooo->dcacheFreeCycle);
+        in.get(ooo->retrying);
+        in.get(ooo->retryLive);
+        in.get(ooo->retrySeq);
+        in.get(ooo->retryData);
+        in.get(ooo->retrySize);
+        in.get(ooo->retryPc);
+        in.get(ooo->refillCause);
+        in.get(ooo->squashSeq);
+        in.get(ooo->refillSeq);
+    }
+    in.get(samplingPhase);
+    in.get(phaseEnd);
+    in.get(functionalNpc);
+    in.get(unitStartCycle);
+    in.get(unitStartInstructions);
+    in.get(unitCpiSum);
+    in.get(unitCpiSquares);
+    in.get(fetchStopped);
+    in.get(cpiStack);
+    in.get(fetchWaitCause);
+    memset(decodeTable, 0, sizeof(decodeTable));
+
+    icache->load(in);
+    dcache->load(in);
+    if (l2cache) l2cache->load(in);
+    if (l3cache) l3cache->load(in);
+    if (predictor) predictor->load(in);
+
+    if (memoryImage) {
+        memoryImage->load(in);
+        return;
+    }
+    vector<uint8_t> image(CHECKPOINT_MEMORY_SIZE);
+    in.read(image.data(), image.size());
+    if (!in.isTruncated())
+        mainMem->writeBlock(0, image.data(), image.size());
+}
+
+// SIMULATOR INSTANCES
+
+Simulator::Simulator() : machine(new Machine()) {}
+
+Simulator::~Simulator()
+{
+    delete machine;
+}
+
+int Simulator::init(CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig *l2Config, CacheConfig *l3Config, MemoryStore *mainMem,
+                    MemoryImage *image)
+{
+    if (l3Config && !l2Config)
+        return -EINVAL;
+    machine->freeCaches();
+    int ret = machine->initCaches(icConfig, dcConfig, l2Config, l3Config, mainMem, image);
+    if (ret) return ret;
+    machine->initState();
+    return 0;
+}
+
+int Simulator::enableStackProfiling(uint32_t maxSets, uint32_t maxWays)
+{
+    Machine &m = *machine;
+    if (!m.icache || maxSets == 0 || (maxSets & (maxSets - 1)) != 0 || maxWays == 0 || (maxWays & (maxWays - 1)) != 0)
+        return -EINVAL;
+    delete m.icProfile;
+    delete m.dcProfile;
+    m.icProfile = new StackProfile(m.icache->getBlockSize(), maxSets, maxWays);
+    m.dcProfile = new StackProfile(m.dcache->getBlockSize(), maxSets, maxWays);
+    return 0;
+}
+
+int Simulator::enableTraceCapture(const char *path)
+{
+    Machine &m = *machine;
+    if (!m.icache)
+        return -EINVAL;
+    delete m.traceWriter;
+    m.traceWriter = new TraceWriter();
+    int ret = m.traceWriter->open(path);
+    if (ret) {
+        delete m.traceWriter;
+        m.traceWriter = NULL;
+    }
+    return ret;
+}
+
+int Simulator::enableBranchPrediction(BranchPredictorConfig &config)
+{
+    Machine &m = *machine;
+    if (!m.icache || m.wide || !BranchPredictor::isValidConfig(config))
+        return -EINVAL;
+    delete m.predictor;
+    m.predictor = new BranchPredictor(config);
+    m.predictorConfig = config;
+    return 0;
+}
+
+int Simulator::enableSuperscalar(SuperscalarConfig &config)
+{
+    Machine &m = *machine;
+    if (!m.icache || m.predictor || m.ooo || m.pipeState.cycle != 0 || config.width == 0 || config.width > MAX_ISSUE_WIDTH ||
+        config.memOpsPerCycle == 0 || config.memOpsPerCycle > config.width)
+        return -EINVAL;
+    m.wide = true;
+    m.wideConfig = config;
+    return 0;
+}
+
+int Simulator::enableOutOfOrder(OutOfOrderConfig &config)
+{
+    Machine &m = *machine;
+    if (!m.icache || m.wide || m.ooo || m.pipeState.cycle != 0 || config.width == 0 || config.issueWidth == 0 ||
+        config.memOpsPerCycle == 0 || config.memOpsPerCycle > config.issueWidth || config.commitWidth == 0 ||
+        config.fetchQueueSize == 0 || config.robSize == 0 || config.iqSize == 0 || config.lsqSize == 0)
+        return -EINVAL;
+    m.ooo = new OutOfOrderCore(config);
+    return 0;
+}
+
+int Simulator::enableSampling(SamplingConfig &config)
+{
+    Machine &m = *machine;
+    if (!m.icache || m.pipeState.cycle != 0 || config.unitSize == 0 || config.warming > config.period ||
+        config.unitSize > config.period - config.warming)
+        return -EINVAL;
+    m.sampling = true;
+    m.samplingConfig = config;
+    m.samplingPhase = SAMPLE_FAST_FORWARD;
+    m.phaseEnd = config.period - config.warming - config.unitSize;
+    return 0;
+}
+
+int Simulator::saveCheckpoint(const char *path)
+{
+    Machine &m = *machine;
+    if (!m.icache)
+        return -EINVAL;
+    CheckpointWriter out;
+    int ret = out.open(path);
+    if (ret) return ret;
+    ret = m.saveCheckpoint(out);
+    int closed = out.close();
+    return ret ? ret : closed;
+}
+
+int Simulator::restoreCheckpoint(const char *path)
+{
+    Machine &m = *machine;
+    if (!m.icache)
+        return -EINVAL;
+    CheckpointReader in;
+    int ret = in.open(path);
+    if (ret) return ret;
+    m.checkpointConfigs(in);
+    if (in.isTruncated()) return -EIO;
+    if (in.isMismatched()) return -EINVAL;
+
+    // a file cut off part way through would leave the machine half loaded, so its state is kept aside
+    // and put back if the load doesn't get to the end
+    std::stringstream buffer;
+    CheckpointWriter backup;
+    backup.openBuffer(buffer);
+    ret = m.saveCheckpoint(backup);
+    if (ret || backup.close()) return ret ? ret : -EIO;
+    m.loadCheckpoint(in);
+    if (!in.isTruncated()) return 0;
+
+    CheckpointReader saved;
+    saved.openBuffer(buffer);
+    m.checkpointConfigs(saved);
+    m.loadCheckpoint(saved);
+    return -EIO;
+}
+
+int Simulator::runCycles(uint32_t cycles)
+{
+    if (!machine->icache)
+        return -EINVAL;
+    CycleStatus cycleStatus{};
+    while (cycles > 0 && cycleStatus != HALTED)
+    {
+        uint32_t skipped = machine->skipStallCycles(cycles);
+        if (skipped) {
+            cycles -= skipped;
+            continue;
+        }
+        // a step of the fast-forward can take more than a cycle
+        uint32_t start = machine->pipeState.cycle;
+        cycleStatus = machine->runNextCycle();
+        cycles -= std::min(cycles, machine->pipeState.cycle - start);
+    }
+    return cycleStatus == HALTED;
+}
+
+int Simulator::runTillHalt()
+{
+    if (!machine->icache)
+        return -EINVAL;
+    CycleStatus cycleStatus{};
+    do
+    {
+        machine->skipStallCycles(UINT32_MAX);
+        cycleStatus = machine->runNextCycle();
+    } while (cycleStatus != HALTED);
+    return 0;
+}
+
+int Simulator::getPipeState(PipeState &state)
+{
+    state = machine->pipeState;
+    return 0;
+}
+
+int Simulator::getStats(SimulationStats &stats)
+{
+    if (!machine->icache)
+        return -EINVAL;
+    machine->collectStats(stats);
+    return 0;
+}
+
+int Simulator::getRegisterState(RegisterInfo &reg)
+{
     memset(&reg, 0, sizeof(RegisterInfo));
-    fillRegisterState(reg);
+    machine->fillRegisterState(reg);
+    return 0;
+}
+
+int Simulator::printExtendedStats(SimulationStats &stats, std::ostream &out)
+{
+    Machine &m = *machine;
+    if (!m.icache)
+        return -EINVAL;
+    out << std::left;
+    if (m.l2cache) {
+        out << std::setw(20) << "L2 hits:" << stats.l2Hits << std::endl;
+        out << std::setw(20) << "L2 misses:" << stats.l2Misses << std::endl;
+    }
+    if (m.l3cache) {
+        out << std::setw(20) << "L3 hits:" << stats.l3Hits << std::endl;
+        out << std::setw(20) << "L3 misses:" << stats.l3Misses << std::endl;
+    }
+    if (m.dcache->isNonBlocking()) {
+        double mlp = stats.missCycles ? (double) stats.outstandingMisses / stats.missCycles : 0;
+        out << std::setw(20) << "D-cache merged:" << stats.dcMergedMisses << std::endl;
+        out << std::setw(20) << "MSHR full stalls:" << stats.mshrFullStalls << std::endl;
+        out << std::setw(20) << "Average MLP:" << std::fixed << std::setprecision(2) << mlp << std::endl;
+    }
+    if (m.icache->isPrefetching()) {
+        out << std::setw(20) << "I-cache prefetches:" << stats.icPrefetches << std::endl;
+        out << std::setw(20) << "I-cache useful pf:" << stats.icUsefulPrefetches << std::endl;
+        out << std::setw(20) << "I-cache late pf:" << stats.icLatePrefetches << std::endl;
+        out << std::setw(20) << "I-cache polluting:" << stats.icPollutingPrefetches << std::endl;
+    }
+    if (m.dcache->isPrefetching()) {
+        out << std::setw(20) << "D-cache prefetches:" << stats.dcPrefetches << std::endl;
+        out << std::setw(20) << "D-cache useful pf:" << stats.dcUsefulPrefetches << std::endl;
+        out << std::setw(20) << "D-cache late pf:" << stats.dcLatePrefetches << std::endl;
+        out << std::setw(20) << "D-cache polluting:" << stats.dcPollutingPrefetches << std::endl;
+    }
+    if (m.dcache->hasWriteBuffer()) {
+        out << std::setw(20) << "Buffered writes:" << stats.bufferedWrites << std::endl;
+        out << std::setw(20) << "Coalesced writes:" << stats.coalescedWrites << std::endl;
+        out << std::setw(20) << "Write buf stalls:" << stats.writeBufferStalls << std::endl;
+    }
+    if (m.predictor || m.ooo) {
+        double accuracy = stats.branches ? 100.0 * (stats.branches - stats.mispredicts) / stats.branches : 0;
+        out << std::setw(20) << "Branches:" << stats.branches << std::endl;
+        out << std::setw(20) << "Mispredicts:" << stats.mispredicts << std::endl;
+        out << std::setw(20) << "Predictor accuracy:" << std::fixed << std::setprecision(2) << accuracy << "%" << std::endl;
+        out << std::setw(20) << "Mispredict cycles:" << stats.mispredictCycles << std::endl;
+    }
+    if (m.wide) {
+        double ipc = stats.totalCycles ? (double) stats.instructions / stats.totalCycles : 0;
+        out << std::setw(20) << "Instructions:" << stats.instructions << std::endl;
+        out << std::setw(20) << "IPC:" << std::fixed << std::setprecision(2) << ipc << std::endl;
+        out << std::setw(20) << "Dependent splits:" << stats.dependencySplits << std::endl;
+        out << std::setw(20) << "Structural splits:" << stats.structuralSplits << std::endl;
+    }
+    if (m.ooo) {
+        double ipc = stats.totalCycles ? (double) stats.instructions / stats.totalCycles : 0;
+        out << std::setw(20) << "Instructions:" << stats.instructions << std::endl;
+        out << std::setw(20) << "IPC:" << std::fixed << std::setprecision(2) << ipc << std::endl;
+        out << std::setw(20) << "ROB full stalls:" << stats.robFullStalls << std::endl;
+        out << std::setw(20) << "IQ full stalls:" << stats.iqFullStalls << std::endl;
+        out << std::setw(20) << "LSQ full stalls:" << stats.lsqFullStalls << std::endl;
+        out << std::setw(20) << "Squashed instrs:" << stats.squashedInstructions << std::endl;
+    }
+    if (m.sampling) {
+        out << std::setw(20) << "Sample units:" << stats.sampleUnits << std::endl;
+        out << std::setw(20) << "Sampled CPI:" << std::fixed << std::setprecision(3) << stats.sampledCpi << std::endl;
+        out << std::setw(20) << "CPI 95% interval:" << "+/- " << std::fixed << std::setprecision(3) << stats.sampledCpiError << std::endl;
+        out << std::setw(20) << "Estimated cycles:" << static_cast<uint64_t>(stats.sampledCpi * stats.instructions + 0.5) << std::endl;
+    }
+    return 0;
+}
+
+int Simulator::printCpiStack(SimulationStats &stats, std::ostream &out)
+{
+    if (!machine->icache)
+        return -EINVAL;
+    const char *names[] = {"Base", "I-cache", "D-cache", "Load-use", "Branch operands", "Mispredicts", "Exceptions", "Other"};
+    uint32_t cycles[] = {stats.baseCycles, stats.icacheStallCycles, stats.dcacheStallCycles, stats.loadUseStallCycles,
+                         stats.branchStallCycles, stats.mispredictStallCycles, stats.exceptionStallCycles, stats.otherStallCycles};
+    out << stats.instructions << " instructions, " << stats.totalCycles << " cycles" << std::endl;
+    out << std::left << std::setw(20) << "Cause" << std::setw(12) << "Cycles" << "CPI" << std::endl;
+    for (uint32_t i = 0; i < sizeof(cycles) / sizeof(cycles[0]); i++)
+    {
+        double cpi = stats.instructions ? (double) cycles[i] / stats.instructions : 0;
+        out << std::setw(20) << names[i] << std::setw(12) << cycles[i] << std::fixed << std::setprecision(3) << cpi << std::endl;
+    }
+    double total = stats.instructions ? (double) stats.totalCycles / stats.instructions : 0;
+    out << std::setw(20) << "Total" << std::setw(12) << stats.totalCycles << std::fixed << std::setprecision(3) << total << std::endl;
+    return 0;
+}
+
+int Simulator::printStackProfile(std::ostream &out)
+{
+    Machine &m = *machine;
+    if (!m.icProfile)
+        return -EINVAL;
+    m.icProfile->print(out, "I-cache");
+    out << std::endl;
+    m.dcProfile->print(out, "D-cache");
+    return 0;
+}
+
+int Simulator::finalize()
+{
+    Machine &m = *machine;
+    if (!m.icache)
+        return -EINVAL;
+    delete m.icProfile;
+    delete m.dcProfile;
+    m.icProfile = NULL;
+    m.dcProfile = NULL;
+    if (m.traceWriter) {
+        m.traceWriter->close();
+        delete m.traceWriter;
+        m.traceWriter = NULL;
+    }
+
+    // a level's dirty blocks are at least as new as the ones below it, so the bottom level goes first
+    if (m.l3cache) m.l3cache->drain();
+    if (m.l2cache) m.l2cache->drain();
+    m.icache->drain();
+    m.dcache->drain();
+    m.freeCaches();
+    return 0;
+}
+
+// DRIVER FUNCTIONS
+
+// the simulator the functions in DriverFunctions.h drive, and the memory it was given
+static Simulator *simulator;
+static MemoryStore *memStore;
+static MemoryImage *memImage;
+
+static int initGlobalSimulator(CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig *l2Config, CacheConfig *l3Config, MemoryStore *mainMem,
+                               MemoryImage *image)
+{
+    delete simulator;
+    simulator = new Simulator();
+    memStore = mainMem;
+    memImage = image;
+    return simulator->init(icConfig, dcConfig, l2Config, l3Config, mainMem, image);
+}
+
+int initSimulator(CacheConfig &icConfig, CacheConfig &dcConfig, MemoryStore *mainMem, MemoryImage *image)
+{
+    return initGlobalSimulator(icConfig, dcConfig, NULL, NULL, mainMem, image);
+}
+
+int initSimulator(CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig &l2Config, MemoryStore *mainMem, MemoryImage *image)
+{
+    return initGlobalSimulator(icConfig, dcConfig, &l2Config, NULL, mainMem, image);
+}
+
+int initSimulator(CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig &l2Config, CacheConfig &l3Config, MemoryStore *mainMem,
+                  MemoryImage *image)
+{
+    return initGlobalSimulator(icConfig, dcConfig, &l2Config, &l3Config, mainMem, image);
+}
+
+int enableStackProfiling(uint32_t maxSets, uint32_t maxWays)
+{
+    return simulator ? simulator->enableStackProfiling(maxSets, maxWays) : -EINVAL;
+}
+
+int enableTraceCapture(const char *path)
+{
+    return simulator ? simulator->enableTraceCapture(path) : -EINVAL;
+}
+
+int enableBranchPrediction(BranchPredictorConfig &config)
+{
+    return simulator ? simulator->enableBranchPrediction(config) : -EINVAL;
+}
+
+int enableSuperscalar(SuperscalarConfig &config)
+{
+    return simulator ? simulator->enableSuperscalar(config) : -EINVAL;
+}
+
+int enableOutOfOrder(OutOfOrderConfig &config)
+{
+    return simulator ? simulator->enableOutOfOrder(config) : -EINVAL;
+}
+
+int enableSampling(SamplingConfig &config)
+{
+    return simulator ? simulator->enableSampling(config) : -EINVAL;
+}
+
+int saveCheckpoint(const char *path)
+{
+    return simulator ? simulator->saveCheckpoint(path) : -EINVAL;
+}
+
+int restoreCheckpoint(const char *path)
+{
+    return simulator ? simulator->restoreCheckpoint(path) : -EINVAL;
+}
+
+// the pipe state dump shows the last cycle that ran
+static void dumpLastPipeState()
+{
+    PipeState pipeState;
+    simulator->getPipeState(pipeState);
+    pipeState.cycle--;
+    dumpPipeState(pipeState);
+}
+
+int runCycles(unsigned int cycles)
+{
+    if (!simulator)
+        return -EINVAL;
+    int ret = simulator->runCycles(cycles);
+    dumpLastPipeState();
+    return ret;
+}
+
+int runTillHalt()
+{
+    if (!simulator)
+        return -EINVAL;
+    int ret = simulator->runTillHalt();
+    dumpLastPipeState();
+    return ret;
+}
+
+int getSimulationStats(SimulationStats &stats)
+{
+    return simulator ? simulator->getStats(stats) : -EINVAL;
+}
+
+// dumpMemoryState only takes the provided store. a store passed with a MemoryImage dumps the same range
+// itself: 0 to 0x1f4, or the start and end in print_mem_range, in hex
+static void dumpMemory(MemoryStore *mem, MemoryImage *image)
+{
+    if (!image) {
+        dumpMemoryState(mem);
+        return;
+    }
+    uint32_t start = 0;
+    uint32_t end = 0x1f4;
+    ifstream range("print_mem_range");
+    if (range) range >> hex >> start >> end;
+    image->dumpState(start, end);
+}
+
+int finalizeSimulator()
+{
+    if (!simulator)
+        return -EINVAL;
+
+    SimulationStats s;
+    int ret = simulator->getStats(s);
+    if (ret) return ret;
+    printSimStats(s);
+    {
+        // appends what printSimStats doesn't know about to sim_stats.out, in the same format
+        std::ofstream out("sim_stats.out", std::ios::app);
+        simulator->printExtendedStats(s, out);
+    }
+    {
+        std::ofstream out("cpi_stack.out");
+        simulator->printCpiStack(s, out);
+    }
+    std::ostringstream profile;
+    if (simulator->printStackProfile(profile) == 0) {
+        std::ofstream out("stack_profile.out");
+        out << profile.str();
+    }
+    simulator->finalize();
 
+    RegisterInfo reg;
+    simulator->getRegisterState(reg);
     dumpRegisterState(reg);
-    dumpMemoryState(memStore);
+    dumpMemory(memStore, memImage);
 
     return 0;
-}
\ No newline at end of file
+}
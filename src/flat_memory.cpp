@@ -0,0 +1,36 @@
+#include <iostream>
+#include <errno.h>
+#include "MemoryStore.h"
+#include "flat_memory.h"
+
+FlatMemoryStore::FlatMemoryStore() : bytes(MEMORY_SIZE) {}
+
+int FlatMemoryStore::outOfRange(uint32_t address) {
+    std::cerr << "Address 0x" << std::hex << address << " is out of range" << std::endl;
+    return -EINVAL;
+}
+
+int FlatMemoryStore::invalidSize() {
+    std::cerr << "Invalid size passed, cannot read/write memory" << std::endl;
+    return -EINVAL;
+}
+
+int FlatMemoryStore::printMemory(uint32_t startAddress, uint32_t endAddress) {
+    return printRange(startAddress, endAddress, std::cout);
+}
+
+int FlatMemoryStore::printRange(uint32_t startAddress, uint32_t endAddress, std::ostream &out) {
+    if (startAddress > endAddress || endAddress > MEMORY_SIZE) {
+        std::cerr << "Address range 0x" << std::hex << startAddress << "-0x" << endAddress << " is out of range"
+                  << std::endl;
+        return -EINVAL;
+    }
+    // the last word can reach past the end of memory, those bytes print as zero
+    printMemoryWords(startAddress, endAddress,
+                     [this](uint64_t address) { return address < MEMORY_SIZE ? bytes[address] : 0; }, out);
+    return 0;
+}
+
+int FlatMemoryStore::dumpState(uint32_t startAddress, uint32_t endAddress) {
+    return writeMemoryState(*this, startAddress, endAddress);
+}
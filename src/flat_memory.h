@@ -0,0 +1,107 @@
+#ifndef FLAT_MEMORY_H
+#define FLAT_MEMORY_H
+
+#include <inttypes.h>
+#include <string.h>
+#include <ostream>
+#include <vector>
+#include "memory_format.h"
+
+// MemoryStore.h can only be included once, so it has to come before this header
+
+// a MemoryStore on one flat host buffer, kept in memory (big endian) byte order. the class is final and
+// its accessors are defined here, so code that holds a FlatMemoryStore, as its own type or through a
+// template parameter, calls them directly and each access inlines to a bounds check, one host load or
+// store and one byte swap. through a MemoryStore pointer it works like any other store, and block
+// transfers always go through MemoryStore's readBlock and writeBlock, a word at a time.
+// errors, their messages and the print format are those of the provided store, including that an access
+// can't touch the last byte of memory, so a program runs the same on either. unlike there, an address
+// close enough to 0xffffffff to wrap around is out of range too
+class FlatMemoryStore final : public MemoryStore {
+    private:
+        std::vector<uint8_t> bytes;
+
+        // also turns down an access that ends at the last byte, like the provided store. the sum is taken in
+        // 64 bits, so an address near the top of the 32-bit space doesn't wrap around into range
+        static bool inRange(uint32_t address, uint32_t size) {
+            return (uint64_t) address + size < MEMORY_SIZE;
+        }
+        // print the provided store's message and return -EINVAL
+        static int outOfRange(uint32_t address);
+        static int invalidSize();
+
+    public:
+        FlatMemoryStore();
+
+        int getWord(uint32_t address, uint32_t &value) {
+            if (!inRange(address, WORD_SIZE)) return outOfRange(address);
+            uint32_t raw;
+            memcpy(&raw, &bytes[address], WORD_SIZE);
+            value = bigEndianWord(raw);
+            return 0;
+        }
+        int getHalf(uint32_t address, uint32_t &value) {
+            if (!inRange(address, HALF_SIZE)) return outOfRange(address);
+            uint16_t raw;
+            memcpy(&raw, &bytes[address], HALF_SIZE);
+            value = bigEndianHalf(raw);
+            return 0;
+        }
+        int getByte(uint32_t address, uint32_t &value) {
+            if (!inRange(address, BYTE_SIZE)) return outOfRange(address);
+            value = bytes[address];
+            return 0;
+        }
+        // stores the low bytes of value, like setMemValue
+        int setWord(uint32_t address, uint32_t value) {
+            if (!inRange(address, WORD_SIZE)) return outOfRange(address);
+            uint32_t raw = bigEndianWord(value);
+            memcpy(&bytes[address], &raw, WORD_SIZE);
+            return 0;
+        }
+        int setHalf(uint32_t address, uint32_t value) {
+            if (!inRange(address, HALF_SIZE)) return outOfRange(address);
+            uint16_t raw = bigEndianHalf((uint16_t) value);
+            memcpy(&bytes[address], &raw, HALF_SIZE);
+            return 0;
+        }
+        int setByte(uint32_t address, uint32_t value) {
+            if (!inRange(address, BYTE_SIZE)) return outOfRange(address);
+            bytes[address] = (uint8_t) value;
+            return 0;
+        }
+
+        int getMemValue(uint32_t address, uint32_t &value, MemEntrySize size) override {
+            switch (size) {
+            case WORD_SIZE:
+                return getWord(address, value);
+            case HALF_SIZE:
+                return getHalf(address, value);
+            case BYTE_SIZE:
+                return getByte(address, value);
+            }
+            return inRange(address, size) ? invalidSize() : outOfRange(address);
+        }
+        int setMemValue(uint32_t address, uint32_t value, MemEntrySize size) override {
+            switch (size) {
+            case WORD_SIZE:
+                return setWord(address, value);
+            case HALF_SIZE:
+                return setHalf(address, value);
+            case BYTE_SIZE:
+                return setByte(address, value);
+            }
+            return inRange(address, size) ? invalidSize() : outOfRange(address);
+        }
+
+        // the MEMORY_SIZE bytes of the memory, for generated code that loads and stores them itself
+        uint8_t *hostBytes() { return bytes.data(); }
+
+        // prints startAddress to endAddress a word at a time, five words per line
+        int printMemory(uint32_t startAddress, uint32_t endAddress) override;
+        int printRange(uint32_t startAddress, uint32_t endAddress, std::ostream &out);
+        // writes startAddress to endAddress to mem_state.out, like dumpMemoryState
+        int dumpState(uint32_t startAddress, uint32_t endAddress);
+};
+
+#endif
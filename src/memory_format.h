@@ -0,0 +1,75 @@
+#ifndef MEMORY_FORMAT_H
+#define MEMORY_FORMAT_H
+
+#include <inttypes.h>
+#include <errno.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+
+// converts a word or halfword between host and memory (big endian) byte order, one byte swap on a little
+// endian host
+static inline uint32_t bigEndianWord(uint32_t value) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+static inline uint16_t bigEndianHalf(uint16_t value) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(value);
+#else
+    return value;
+#endif
+}
+
+// how the provided store prints memory, a word at a time and five words per line
+#define PRINT_WORD_SIZE 4
+#define PRINT_WORDS_PER_LINE 5
+
+// prints startAddress to endAddress in the provided store's format, byteAt(address) giving each byte. like
+// there, a word that starts before endAddress is printed whole
+template <typename ByteAt> void printMemoryWords(uint32_t startAddress, uint32_t endAddress, ByteAt byteAt,
+                                                 std::ostream &out) {
+    uint64_t address = startAddress;
+    uint32_t lineAddress = startAddress;
+    while (address < endAddress) {
+        out << "0x" << std::hex << std::setfill('0') << std::setw(8) << lineAddress << ": ";
+        for (int i = 0; i < PRINT_WORDS_PER_LINE; i++) {
+            if (address >= endAddress) {
+                out << std::endl;
+                return;
+            }
+            out << "0x";
+            for (int j = 0; j < PRINT_WORD_SIZE; j++, address++) {
+                unsigned byte = byteAt(address);
+                out << std::hex << std::setfill('0') << std::setw(2) << byte;
+            }
+            out << " ";
+        }
+        out << std::endl;
+        lineAddress += PRINT_WORD_SIZE * PRINT_WORDS_PER_LINE;
+    }
+}
+
+// writes mem.printRange(startAddress, endAddress) to mem_state.out, framed like dumpMemoryState does
+template <typename Store> int writeMemoryState(Store &mem, uint32_t startAddress, uint32_t endAddress) {
+    std::ofstream out("mem_state.out", std::ios::out | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Could not create memory state dump file" << std::endl;
+        return -EBADF;
+    }
+
+    out << "---------------------" << std::endl;
+    out << "Begin Memory State" << std::endl;
+    out << "---------------------" << std::endl;
+    int ret = mem.printRange(startAddress, endAddress, out);
+    out << "---------------------" << std::endl;
+    out << "End Memory State" << std::endl;
+    out << "---------------------" << std::endl;
+    return ret;
+}
+
+#endif
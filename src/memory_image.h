@@ -0,0 +1,28 @@
+#ifndef MEMORY_IMAGE_H
+#define MEMORY_IMAGE_H
+
+#include <inttypes.h>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// what a store can do beyond MemoryStore, which can't take new virtual functions. a driver whose store
+// implements this passes it to initSimulator along with the store, and the simulator then asks it rather than
+// assuming the provided 64 KB store: how far the addresses go, block transfers that don't go a word at a
+// time, checkpoints of the store's own contents and the memory dump. both must be the same object
+class MemoryImage {
+    public:
+        virtual ~MemoryImage() {}
+        // one past the last address the store holds
+        virtual uint64_t addressSpaceEnd() const = 0;
+        // like MemoryStore::readBlock and writeBlock, with the same errors
+        virtual int readRange(uint32_t address, uint8_t *data, uint32_t size) = 0;
+        virtual int writeRange(uint32_t address, const uint8_t *data, uint32_t size) = 0;
+        // the contents of the store. load replaces them with what save wrote
+        virtual void save(CheckpointWriter &out) = 0;
+        virtual void load(CheckpointReader &in) = 0;
+        // writes startAddress to endAddress to mem_state.out, like dumpMemoryState
+        virtual int dumpState(uint32_t startAddress, uint32_t endAddress) = 0;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include "MemoryStore.h"
+#include "paged_memory.h"
+#include "checkpoint.h"
+
+PagedMemoryStore::PagedMemoryStore() : directory(), pages(0), lastPageNumber(NO_PAGE), lastPage(NULL) {}
+
+PagedMemoryStore::~PagedMemoryStore() {
+    clear();
+}
+
+int PagedMemoryStore::outOfRange(uint32_t address) {
+    std::cerr << "Address 0x" << std::hex << address << " is out of range" << std::endl;
+    return -EINVAL;
+}
+
+int PagedMemoryStore::invalidSize() {
+    std::cerr << "Invalid size passed, cannot read/write memory" << std::endl;
+    return -EINVAL;
+}
+
+PagedMemoryStore::Page *PagedMemoryStore::findPage(uint32_t pageNumber) {
+    Page **table = directory[pageNumber >> PAGE_TABLE_BITS];
+    if (!table) return NULL;
+    Page *page = table[pageNumber & (PAGE_TABLE_SIZE - 1)];
+    if (page) {
+        lastPageNumber = pageNumber;
+        lastPage = page;
+    }
+    return page;
+}
+
+PagedMemoryStore::Page *PagedMemoryStore::touchPage(uint32_t pageNumber) {
+    Page **&table = directory[pageNumber >> PAGE_TABLE_BITS];
+    if (!table) table = new Page *[PAGE_TABLE_SIZE]();
+    Page *&page = table[pageNumber & (PAGE_TABLE_SIZE - 1)];
+    if (!page) {
+        page = new Page();
+        pages++;
+    } else if (isShared(page)) {
+        Page *copy = new Page();
+        memcpy(copy->bytes, page->bytes, MEMORY_PAGE_SIZE);
+        releasePage(page);
+        page = copy;
+    }
+    lastPageNumber = pageNumber;
+    lastPage = page;
+    return page;
+}
+
+void PagedMemoryStore::releasePage(Page *page) {
+    if (page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete page;
+}
+
+// an access that crosses a page or leaves the address space, big endian a byte at a time
+int PagedMemoryStore::getBytes(uint32_t address, uint32_t size, uint32_t &value) {
+    if (!inRange(address, size)) return outOfRange(address);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        Page *page = findPage((address + i) >> MEMORY_PAGE_BITS);
+        uint8_t byte = page ? page->bytes[(address + i) & (MEMORY_PAGE_SIZE - 1)] : 0;
+        result = (result << 8) | byte;
+    }
+    value = result;
+    return 0;
+}
+
+int PagedMemoryStore::setBytes(uint32_t address, uint32_t size, uint32_t value) {
+    if (!inRange(address, size)) return outOfRange(address);
+    for (uint32_t i = 0; i < size; i++) {
+        Page *page = touchPage((address + i) >> MEMORY_PAGE_BITS);
+        page->bytes[(address + i) & (MEMORY_PAGE_SIZE - 1)] = (uint8_t) (value >> (8 * (size - 1 - i)));
+    }
+    return 0;
+}
+
+int PagedMemoryStore::readRange(uint32_t address, uint8_t *data, uint32_t size) {
+    if (!inRange(address, size)) return MemoryStore::readBlock(address, data, size);
+    while (size > 0) {
+        uint32_t offset = address & (MEMORY_PAGE_SIZE - 1);
+        uint32_t chunk = std::min(size, MEMORY_PAGE_SIZE - offset);
+        Page *page = findPage(address >> MEMORY_PAGE_BITS);
+        if (page) {
+            memcpy(data, page->bytes + offset, chunk);
+        } else {
+            memset(data, 0, chunk);
+        }
+        address += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+int PagedMemoryStore::writeRange(uint32_t address, const uint8_t *data, uint32_t size) {
+    if (!inRange(address, size)) return MemoryStore::writeBlock(address, data, size);
+    while (size > 0) {
+        uint32_t offset = address & (MEMORY_PAGE_SIZE - 1);
+        uint32_t chunk = std::min(size, MEMORY_PAGE_SIZE - offset);
+        memcpy(touchPage(address >> MEMORY_PAGE_BITS)->bytes + offset, data, chunk);
+        address += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+void PagedMemoryStore::clear() {
+    for (uint32_t i = 0; i < PAGE_TABLE_SIZE; i++) {
+        if (!directory[i]) continue;
+        for (uint32_t j = 0; j < PAGE_TABLE_SIZE; j++) {
+            if (directory[i][j]) releasePage(directory[i][j]);
+        }
+        delete[] directory[i];
+        directory[i] = NULL;
+    }
+    pages = 0;
+    lastPageNumber = NO_PAGE;
+    lastPage = NULL;
+}
+
+PagedMemoryStore *PagedMemoryStore::snapshot() const {
+    PagedMemoryStore *copy = new PagedMemoryStore();
+    for (uint32_t i = 0; i < PAGE_TABLE_SIZE; i++) {
+        if (!directory[i]) continue;
+        copy->directory[i] = new Page *[PAGE_TABLE_SIZE];
+        for (uint32_t j = 0; j < PAGE_TABLE_SIZE; j++) {
+            Page *page = directory[i][j];
+            if (page) page->refs.fetch_add(1, std::memory_order_relaxed);
+            copy->directory[i][j] = page;
+        }
+    }
+    copy->pages = pages;
+    return copy;
+}
+
+int PagedMemoryStore::printMemory(uint32_t startAddress, uint32_t endAddress) {
+    return printRange(startAddress, endAddress, std::cout);
+}
+
+int PagedMemoryStore::printRange(uint32_t startAddress, uint32_t endAddress, std::ostream &out) {
+    if (startAddress > endAddress) {
+        std::cerr << "Address range 0x" << std::hex << startAddress << "-0x" << endAddress << " is out of range"
+                  << std::endl;
+        return -EINVAL;
+    }
+    // the last word can reach past the top of the address space, those bytes print as zero
+    printMemoryWords(startAddress, endAddress,
+                     [this](uint64_t address) -> uint8_t {
+                         if (address > 0xffffffffu) return 0;
+                         Page *page = findPage((uint32_t) address >> MEMORY_PAGE_BITS);
+                         return page ? page->bytes[address & (MEMORY_PAGE_SIZE - 1)] : 0;
+                     },
+                     out);
+    return 0;
+}
+
+int PagedMemoryStore::dumpState(uint32_t startAddress, uint32_t endAddress) {
+    return writeMemoryState(*this, startAddress, endAddress);
+}
+
+void PagedMemoryStore::save(CheckpointWriter &out) {
+    out.put<uint64_t>(pages);
+    for (uint32_t i = 0; i < PAGE_TABLE_SIZE; i++) {
+        if (!directory[i]) continue;
+        for (uint32_t j = 0; j < PAGE_TABLE_SIZE; j++) {
+            if (!directory[i][j]) continue;
+            out.put<uint32_t>((i << PAGE_TABLE_BITS) | j);
+            out.write(directory[i][j]->bytes, MEMORY_PAGE_SIZE);
+        }
+    }
+}
+
+void PagedMemoryStore::load(CheckpointReader &in) {
+    clear();
+    uint64_t count = in.readSize();
+    for (uint64_t i = 0; i < count && !in.isTruncated(); i++) {
+        uint32_t pageNumber = 0;
+        in.get(pageNumber);
+        if (in.isTruncated() || pageNumber >= PAGE_TABLE_SIZE * PAGE_TABLE_SIZE) break;
+        in.read(touchPage(pageNumber)->bytes, MEMORY_PAGE_SIZE);
+    }
+}
@@ -0,0 +1,176 @@
+#ifndef PAGED_MEMORY_H
+#define PAGED_MEMORY_H
+
+#include <inttypes.h>
+#include <string.h>
+#include <ostream>
+#include <atomic>
+#include "memory_format.h"
+#include "memory_image.h"
+
+// MemoryStore.h can only be included once, so it has to come before this header
+
+// 4 KB pages, found through a two-level table: the top 10 bits of an address index the directory, the next
+// 10 bits one of its tables
+#define MEMORY_PAGE_BITS 12
+#define MEMORY_PAGE_SIZE (1u << MEMORY_PAGE_BITS)
+#define PAGE_TABLE_BITS 10
+#define PAGE_TABLE_SIZE (1u << PAGE_TABLE_BITS)
+// no page has this number, it marks the last page as unset
+#define NO_PAGE 0xffffffffu
+
+// a MemoryStore for the whole 32-bit address space that only holds the pages a program wrote. a page is
+// allocated and zeroed on its first store, reads of a page that was never written return zero, so the
+// memory used follows the footprint of the program rather than the size of the space. the page of the
+// last access is kept aside, so a run of accesses to one page skips the table walk. like
+// FlatMemoryStore, the class is final and its accessors are inline; an access that straddles two pages
+// goes a byte at a time.
+// snapshot gives a second store with the same contents that shares every page with this one. a shared
+// page is copied the first time either store writes it, so a loaded program can be cloned into any
+// number of simulators at the cost of its page tables, and each only pays for the pages it changes.
+// a driver passes it to initSimulator as the MemoryImage too, for the caches to reach the whole space
+class PagedMemoryStore final : public MemoryStore, public MemoryImage {
+    private:
+        struct Page {
+            // the stores holding the page, only one of them may write it
+            std::atomic<uint32_t> refs;
+            uint8_t bytes[MEMORY_PAGE_SIZE];
+            Page() : refs(1), bytes() {}
+        };
+        // a table of PAGE_TABLE_SIZE pages for each directory entry, NULL while none of its pages exist
+        Page **directory[PAGE_TABLE_SIZE];
+        uint32_t pages;
+        uint32_t lastPageNumber;
+        Page *lastPage;
+
+        static bool inRange(uint32_t address, uint32_t size) {
+            return (uint64_t) address + size <= (1ull << 32);
+        }
+        // print the same messages as FlatMemoryStore and return -EINVAL
+        static int outOfRange(uint32_t address);
+        static int invalidSize();
+
+        // the page with that number, NULL if it was never written. both make it the last page when there is one
+        Page *findPage(uint32_t pageNumber);
+        // the page with that number, allocated if it doesn't exist yet and copied if it is shared
+        Page *touchPage(uint32_t pageNumber);
+        static bool isShared(Page *page) {
+            return page->refs.load(std::memory_order_acquire) > 1;
+        }
+        // drops this store's hold on the page, the last store to let go frees it
+        static void releasePage(Page *page);
+
+        // the host bytes of an access that stays in one page. returns NULL if it crosses into the next one,
+        // or if the page doesn't exist and create is false
+        uint8_t *hostAddress(uint32_t address, uint32_t size, bool create) {
+            uint32_t offset = address & (MEMORY_PAGE_SIZE - 1);
+            if (offset + size > MEMORY_PAGE_SIZE) return NULL;
+            uint32_t pageNumber = address >> MEMORY_PAGE_BITS;
+            if (pageNumber == lastPageNumber && !(create && isShared(lastPage))) return lastPage->bytes + offset;
+            Page *page = create ? touchPage(pageNumber) : findPage(pageNumber);
+            return page ? page->bytes + offset : NULL;
+        }
+        int getBytes(uint32_t address, uint32_t size, uint32_t &value);
+        int setBytes(uint32_t address, uint32_t size, uint32_t value);
+
+        PagedMemoryStore(const PagedMemoryStore &) = delete;
+        PagedMemoryStore &operator=(const PagedMemoryStore &) = delete;
+
+    public:
+        PagedMemoryStore();
+        ~PagedMemoryStore();
+
+        int getWord(uint32_t address, uint32_t &value) {
+            uint8_t *host = hostAddress(address, WORD_SIZE, false);
+            if (!host) return getBytes(address, WORD_SIZE, value);
+            uint32_t raw;
+            memcpy(&raw, host, WORD_SIZE);
+            value = bigEndianWord(raw);
+            return 0;
+        }
+        int getHalf(uint32_t address, uint32_t &value) {
+            uint8_t *host = hostAddress(address, HALF_SIZE, false);
+            if (!host) return getBytes(address, HALF_SIZE, value);
+            uint16_t raw;
+            memcpy(&raw, host, HALF_SIZE);
+            value = bigEndianHalf(raw);
+            return 0;
+        }
+        int getByte(uint32_t address, uint32_t &value) {
+            uint8_t *host = hostAddress(address, BYTE_SIZE, false);
+            if (!host) return getBytes(address, BYTE_SIZE, value);
+            value = *host;
+            return 0;
+        }
+        // stores the low bytes of value, like setMemValue
+        int setWord(uint32_t address, uint32_t value) {
+            uint8_t *host = hostAddress(address, WORD_SIZE, true);
+            if (!host) return setBytes(address, WORD_SIZE, value);
+            uint32_t raw = bigEndianWord(value);
+            memcpy(host, &raw, WORD_SIZE);
+            return 0;
+        }
+        int setHalf(uint32_t address, uint32_t value) {
+            uint8_t *host = hostAddress(address, HALF_SIZE, true);
+            if (!host) return setBytes(address, HALF_SIZE, value);
+            uint16_t raw = bigEndianHalf((uint16_t) value);
+            memcpy(host, &raw, HALF_SIZE);
+            return 0;
+        }
+        int setByte(uint32_t address, uint32_t value) {
+            uint8_t *host = hostAddress(address, BYTE_SIZE, true);
+            if (!host) return setBytes(address, BYTE_SIZE, value);
+            *host = (uint8_t) value;
+            return 0;
+        }
+
+        int getMemValue(uint32_t address, uint32_t &value, MemEntrySize size) override {
+            switch (size) {
+            case WORD_SIZE:
+                return getWord(address, value);
+            case HALF_SIZE:
+                return getHalf(address, value);
+            case BYTE_SIZE:
+                return getByte(address, value);
+            }
+            return inRange(address, size) ? invalidSize() : outOfRange(address);
+        }
+        int setMemValue(uint32_t address, uint32_t value, MemEntrySize size) override {
+            switch (size) {
+            case WORD_SIZE:
+                return setWord(address, value);
+            case HALF_SIZE:
+                return setHalf(address, value);
+            case BYTE_SIZE:
+                return setByte(address, value);
+            }
+            return inRange(address, size) ? invalidSize() : outOfRange(address);
+        }
+
+        uint64_t addressSpaceEnd() const override { return 1ull << 32; }
+        // copies a page at a time. a block that runs past the top of the address space goes an access at a
+        // time like in MemoryStore, so it stops at the same byte with the same message
+        int readRange(uint32_t address, uint8_t *data, uint32_t size) override;
+        int writeRange(uint32_t address, const uint8_t *data, uint32_t size) override;
+
+        // the pages this store holds, shared or not
+        uint32_t pageCount() const { return pages; }
+        // a new store with the same contents, sharing the pages of this one until either writes them. any
+        // number of threads can take snapshots at once as long as nothing writes this store meanwhile
+        PagedMemoryStore *snapshot() const;
+        // drops every page, the memory reads as zero again
+        void clear();
+
+        // prints startAddress to endAddress a word at a time, five words per line
+        int printMemory(uint32_t startAddress, uint32_t endAddress) override;
+        int printRange(uint32_t startAddress, uint32_t endAddress, std::ostream &out);
+        // writes startAddress to endAddress to mem_state.out, like dumpMemoryState
+        int dumpState(uint32_t startAddress, uint32_t endAddress) override;
+
+        // the pages that exist, with their numbers. load replaces the contents of the memory with what save
+        // wrote
+        void save(CheckpointWriter &out) override;
+        void load(CheckpointReader &in) override;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include <stddef.h>
+#include "prefetcher.h"
+#include "checkpoint.h"
+
+// entries in the stride prefetcher's reference prediction table, indexed by pc
+#define STRIDE_TABLE_SIZE 64
+// a stride is trusted once it has been seen this many times in a row
+#define STRIDE_CONFIDENT 2
+#define STRIDE_CONFIDENCE_MAX 3
+// streams the stream prefetcher follows at once
+#define STREAM_COUNT 8
+// a miss within this many blocks of a stream's last block belongs to the stream
+#define STREAM_WINDOW 4
+// misses in the same direction before a stream starts prefetching
+#define STREAM_CONFIDENT 2
+
+// NEXT LINE
+
+NextLinePrefetcher::NextLinePrefetcher(uint32_t blockSize, uint32_t degree, uint32_t distance) : blockSize(blockSize), degree(degree), distance(distance) {}
+
+void NextLinePrefetcher::observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches) {
+    if (!trigger) return;
+    for (uint32_t i = 0; i < degree; i++) {
+        prefetches.push_back(address + (distance + i) * blockSize);
+    }
+}
+
+// STRIDE
+
+StridePrefetcher::StridePrefetcher(uint32_t degree, uint32_t distance) : table(STRIDE_TABLE_SIZE, Entry{0, 0, 0, 0, false}), degree(degree), distance(distance) {}
+
+void StridePrefetcher::observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches) {
+    Entry &entry = table[(pc >> 2) % STRIDE_TABLE_SIZE];
+    if (!entry.valid || entry.pc != pc) {
+        entry = Entry{pc, address, 0, 0, true};
+        return;
+    }
+    // a retried access shows up again with the same address, it says nothing about the stride
+    if (address == entry.lastAddress) return;
+
+    int32_t stride = (int32_t) (address - entry.lastAddress);
+    entry.lastAddress = address;
+    if (stride == entry.stride) {
+        if (entry.confidence < STRIDE_CONFIDENCE_MAX) entry.confidence++;
+    } else if (entry.confidence > 0) {
+        entry.confidence--;
+    } else {
+        entry.stride = stride;
+    }
+
+    if (entry.confidence < STRIDE_CONFIDENT) return;
+    for (uint32_t i = 0; i < degree; i++) {
+        prefetches.push_back(address + (distance + i) * entry.stride);
+    }
+}
+
+void StridePrefetcher::save(CheckpointWriter &out) {
+    out.putVector(table);
+}
+
+void StridePrefetcher::load(CheckpointReader &in) {
+    in.getVector(table);
+}
+
+// STREAM
+
+StreamPrefetcher::StreamPrefetcher(uint32_t blockSize, uint32_t degree, uint32_t distance) : streams(STREAM_COUNT, Stream{0, 0, 0, 0, false}), blockSize(blockSize), degree(degree), distance(distance), clock(0) {}
+
+void StreamPrefetcher::observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches) {
+    if (!trigger) return;
+    uint32_t block = address / blockSize;
+    clock++;
+
+    Stream *stream = NULL;
+    Stream *oldest = &streams[0];
+    for (Stream &candidate : streams) {
+        if (candidate.valid) {
+            int32_t offset = (int32_t) (block - candidate.lastBlock);
+            if (offset != 0 && offset <= STREAM_WINDOW && offset >= -STREAM_WINDOW) {
+                stream = &candidate;
+                break;
+            }
+        }
+        if (!candidate.valid || candidate.lastUsed < oldest->lastUsed) oldest = &candidate;
+    }
+
+    if (!stream) {
+        *oldest = Stream{block, 0, 0, clock, true};
+        return;
+    }
+
+    int32_t direction = (int32_t) (block - stream->lastBlock) > 0 ? 1 : -1;
+    if (direction == stream->direction) {
+        if (stream->confidence < STREAM_CONFIDENT) stream->confidence++;
+    } else {
+        stream->direction = direction;
+        stream->confidence = 1;
+    }
+    stream->lastBlock = block;
+    stream->lastUsed = clock;
+
+    if (stream->confidence < STREAM_CONFIDENT) return;
+    for (uint32_t i = 0; i < degree; i++) {
+        prefetches.push_back((block + direction * (int32_t) (distance + i)) * blockSize);
+    }
+}
+
+void StreamPrefetcher::save(CheckpointWriter &out) {
+    out.putVector(streams);
+    out.put(clock);
+}
+
+void StreamPrefetcher::load(CheckpointReader &in) {
+    in.getVector(streams);
+    in.get(clock);
+}
+
+Prefetcher *createPrefetcher(PrefetcherType type, uint32_t blockSize, uint32_t degree, uint32_t distance) {
+    switch (type) {
+    case NEXT_LINE:
+        return new NextLinePrefetcher(blockSize, degree, distance);
+    case STRIDE:
+        return new StridePrefetcher(degree, distance);
+    case STREAM:
+        return new StreamPrefetcher(blockSize, degree, distance);
+    case NO_PREFETCH:
+        break;
+    }
+    return NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <inttypes.h>
+#include <vector>
+#include "CacheConfig.h"
+
+using std::vector;
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// watches the demand accesses of a cache and picks blocks to fetch before they are asked for.
+// the cache drops requests for blocks it already holds, so a prefetcher doesn't have to track them
+class Prefetcher {
+    public:
+        virtual ~Prefetcher() {}
+        // a demand access by the instruction at pc. trigger is set on a miss and on the first use of a
+        // prefetched block, the events a prefetcher acts on when it doesn't need to see every access.
+        // addresses to prefetch are appended to prefetches
+        virtual void observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches) = 0;
+        // what the prefetcher has learned, for a checkpoint. nothing unless it keeps a table
+        virtual void save(CheckpointWriter &out) {}
+        virtual void load(CheckpointReader &in) {}
+};
+
+// tagged next-line prefetching, each trigger fetches the blocks right after the one accessed
+class NextLinePrefetcher : public Prefetcher {
+    private:
+        uint32_t blockSize, degree, distance;
+    public:
+        NextLinePrefetcher(uint32_t blockSize, uint32_t degree, uint32_t distance);
+        void observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches);
+};
+
+// reference prediction table (Chen and Baer, 1995). each load or store pc remembers its last address
+// and stride, and once the same stride is seen twice the addresses further along it are prefetched
+class StridePrefetcher : public Prefetcher {
+    private:
+        struct Entry {
+            uint32_t pc;
+            uint32_t lastAddress;
+            int32_t stride;
+            uint8_t confidence;
+            bool valid;
+        };
+        vector<Entry> table;
+        uint32_t degree, distance;
+    public:
+        StridePrefetcher(uint32_t degree, uint32_t distance);
+        void observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// stream detection on misses. misses close to each other in one direction start a stream,
+// which then runs distance blocks ahead of the accesses that keep following it
+class StreamPrefetcher : public Prefetcher {
+    private:
+        struct Stream {
+            uint32_t lastBlock;
+            int32_t direction;
+            uint8_t confidence;
+            uint64_t lastUsed;
+            bool valid;
+        };
+        vector<Stream> streams;
+        uint32_t blockSize, degree, distance;
+        uint64_t clock;
+    public:
+        StreamPrefetcher(uint32_t blockSize, uint32_t degree, uint32_t distance);
+        void observe(uint32_t pc, uint32_t address, bool trigger, vector<uint32_t> &prefetches);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// returns NULL for NO_PREFETCH
+Prefetcher *createPrefetcher(PrefetcherType type, uint32_t blockSize, uint32_t degree, uint32_t distance);
+
+#endif
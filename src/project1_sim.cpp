@@ -1,15 +1,29 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <vector>
 #include <string.h>
 #include <errno.h>
 #include "MemoryStore.h"
+#include "flat_memory.h"
 #include "RegisterInfo.h"
 #include "EndianHelpers.h"
+#include "trace.h"
+
+//Blocks are translated to native code on x86-64 hosts, unless built with -DNO_JIT. Everywhere
+//else, or when the code can't be mapped, they run through runBlock.
+#if defined(__x86_64__) && !defined(NO_JIT)
+#define JIT_NATIVE
+#include <sys/mman.h>
+#include "x86_emitter.h"
+#endif
 
 #define MAGIC_DEMARC 0xfeedfeed
 #define EXCEPTION_ADDR 0x8000
 
+//The end of the memory dumped after the run, like dumpMemoryState does.
+#define MEM_DUMP_END 0x1f4
+
 //Note that an instruction that modifies the PC will never throw an
 //exception or be prone to errors from the memory abstraction.
 //Thus a single value is enough to depict the status of an instruction.
@@ -106,22 +120,43 @@ using namespace std;
 //Static global variables...
 static uint32_t progCounter;
 static uint32_t regs[NUM_REGS];
-static MemoryStore *mem;
+//A flat memory, so the loads, stores and fetches call it directly instead of going
+//through the MemoryStore interface.
+static FlatMemoryStore *mem;
 
 static bool ll_sc_flag;
 static uint32_t ll_sc_addr;
 
+//Where the memory accesses go when a trace file was given, NULL otherwise.
+static TraceWriter *trace;
+
+static void traceAccess(uint32_t addr, TraceKind kind, MemEntrySize size)
+{
+    if(trace)
+    {
+        trace->record(addr, kind, size);
+    }
+}
+
 int initMemory(ifstream & inputProg)
 {
     if(inputProg && mem)
     {
-        uint32_t curVal = 0;
+        char chunk[4096];
         uint32_t addr = 0;
 
-        while(inputProg.read((char *)(&curVal), sizeof(uint32_t)))
+        //The program is stored big endian, which is already the memory's byte order,
+        //so the file is copied in a chunk at a time. Like before, a trailing partial
+        //word is ignored.
+        while(inputProg.read(chunk, sizeof(chunk)) || inputProg.gcount() > 0)
         {
-            curVal = ConvertWordToBigEndian(curVal);
-            int ret = mem->setMemValue(addr, curVal, WORD_SIZE);
+            uint32_t size = static_cast<uint32_t>(inputProg.gcount()) & ~0x3u;
+            if(size == 0)
+            {
+                break;
+            }
+
+            int ret = mem->writeBlock(addr, reinterpret_cast<uint8_t *>(chunk), size);
 
             if(ret)
             {
@@ -129,8 +164,7 @@ int initMemory(ifstream & inputProg)
                 return -EINVAL;
             }
 
-            //We're reading 4 bytes each time...
-            addr += 4;
+            addr += size;
         }
     }
     else
@@ -191,100 +225,11 @@ int doAddSub(uint8_t rd, uint32_t s1, uint32_t s2, bool isAdd, bool checkOverflo
     return 0;
 }
 
-int runDelayInstruction(uint32_t delayPC, int succRet);
-
-int handleOpZeroInst(uint32_t instr)
-{
-    uint8_t rs = (instr >> 21) & 0x1f;
-    uint8_t rt = (instr >> 16) & 0x1f;
-    uint8_t rd = (instr >> 11) & 0x1f;
-    uint8_t shamt = (instr >> 6) & 0x1f;
-    uint8_t funct = instr & 0x3f;
-
-    int ret = 0;
-    uint32_t oldPC = progCounter;
-
-    switch(funct)
-    {
-        case FUN_ADD:
-            ret = doAddSub(rd, regs[rs], regs[rt], true, true);
-            break;
-        case FUN_ADDU:
-            //No overflow...
-            ret = doAddSub(rd, regs[rs], regs[rt], true, false);
-            break;
-        case FUN_AND:
-            regs[rd] = regs[rs] & regs[rt];
-            break;
-        case FUN_JR:
-            progCounter = regs[rs];
-            ret = NOINC_PC;
-            break;
-        case FUN_NOR:
-            regs[rd] = ~(regs[rs] | regs[rt]);
-            break;
-        case FUN_OR:
-            regs[rd] = regs[rs] | regs[rt];
-            break;
-        case FUN_SLT:
-            regs[rd] = (static_cast<int32_t>(regs[rs]) < static_cast<int32_t>(regs[rt])) ? 1 : 0;
-            break;
-        case FUN_SLTU:
-            regs[rd] = (regs[rs] < regs[rt]) ? 1 : 0;
-            break;
-        case FUN_SLL:
-            regs[rd] = regs[rt] << shamt;
-            break;
-        case FUN_SRL:
-            regs[rd] = regs[rt] >> shamt;
-            break;
-        case FUN_SUB:
-            ret = doAddSub(rd, regs[rs], regs[rt], false, true);
-            break;
-        case FUN_SUBU:
-            //No overflow...
-            ret = doAddSub(rd, regs[rs], regs[rt], false, false);
-            break;
-        default:
-            //Illegal instruction. Trigger an exception.
-            ret = ILLEGAL_INST;
-            cerr << "Illegal instruction at address " << "0x" << hex
-                 << setfill('0') << setw(8) << progCounter << endl;
-            break;
-    }
-
-    //Reset the zero register...
-    regs[REG_ZERO] = 0;
-
-    //Did this instruction throw an exception or fail? If so, just return that
-    //and do nothing further.
-    if(ret && ret != NOINC_PC)
-    {
-        return ret;
-    }
-
-    //Did this instruction modify the PC? If so, execute the instruction
-    //in the delay slot and then return the return value of the immediate
-    //instruction's execution unless the delay slot instruction throws an exception,
-    //in which case just return the exception of that delay instruction.
-    if(ret == NOINC_PC)
-    {
-        return runDelayInstruction(oldPC + 4, NOINC_PC);
-    }
-
-    //The ret value must be 0 here, or something's amiss.
-    if(ret != 0)
-    {
-        cerr << "ret was nonzero - check logic!" << endl;
-    }
-
-    return 0;
-}
-
 int doLoad(uint32_t addr, MemEntrySize size, uint8_t rt)
 {
     uint32_t value = 0;
     int ret = 0;
+    traceAccess(addr, TRACE_LOAD, size);
     ret = mem->getMemValue(addr, value, size);
     if(ret)
     {
@@ -333,271 +278,1317 @@ void checkLLSCOverlap(uint32_t addr, MemEntrySize size)
     }
 }
 
+//An instruction decoded once into the handler that runs it and the fields it uses, so
+//running it again doesn't go through the opcode and function switches or a memory access.
+struct DecodedInst;
+typedef int (*InstHandler)(const DecodedInst & inst);
+
+struct DecodedInst
+{
+    //NULL while the word hasn't been decoded.
+    InstHandler handler;
+    uint32_t instr;
+    //The sign extended immediate, or the zero extended one for andi and ori, the value lui
+    //loads, how far a taken branch moves the PC, or the jump target within its 256 MB region.
+    uint32_t imm;
+    uint8_t rs;
+    uint8_t rt;
+    uint8_t rd;
+    uint8_t shamt;
+};
+
+//The decoded instruction of every word of memory that has been fetched.
+static DecodedInst decodedInsts[MEMORY_SIZE / 4];
+//Set when a store overwrites a decoded instruction, until the blocks holding copies of
+//the old one have been dropped.
+static bool codeModified;
+
+//A store over code that was already decoded drops the decoded instruction, so the new one
+//is decoded when it's fetched next. That's all self-modifying code needs: each instruction
+//is still fetched only once all previous instructions have finished execution.
+static void invalidateDecoded(uint32_t addr, MemEntrySize size)
+{
+    uint32_t last = (addr + static_cast<uint32_t>(size) - 1) >> 2;
+
+    for(uint32_t word = addr >> 2 ; word <= last && word < MEMORY_SIZE / 4 ; word++)
+    {
+        if(decodedInsts[word].handler)
+        {
+            decodedInsts[word].handler = NULL;
+            codeModified = true;
+        }
+    }
+}
+
+static int doStore(uint32_t addr, uint32_t value, MemEntrySize size)
+{
+    traceAccess(addr, TRACE_STORE, size);
+    int ret = mem->setMemValue(addr, value, size);
+    invalidateDecoded(addr, size);
+    return ret;
+}
+
+static uint32_t memAddress(const DecodedInst & inst)
+{
+    return static_cast<uint32_t>(static_cast<int32_t>(regs[inst.rs]) + static_cast<int32_t>(inst.imm));
+}
+
+static int opIllegal(const DecodedInst & inst)
+{
+    //Illegal instruction. Trigger an exception.
+    cerr << "Illegal instruction at address " << "0x" << hex
+         << setfill('0') << setw(8) << progCounter << endl;
+    return ILLEGAL_INST;
+}
+
+//R-type handlers...
+static int opAdd(const DecodedInst & inst)
+{
+    return doAddSub(inst.rd, regs[inst.rs], regs[inst.rt], true, true);
+}
+
+static int opAddu(const DecodedInst & inst)
+{
+    //No overflow...
+    return doAddSub(inst.rd, regs[inst.rs], regs[inst.rt], true, false);
+}
+
+static int opAnd(const DecodedInst & inst)
+{
+    regs[inst.rd] = regs[inst.rs] & regs[inst.rt];
+    return 0;
+}
+
+static int opJr(const DecodedInst & inst)
+{
+    progCounter = regs[inst.rs];
+    return NOINC_PC;
+}
+
+static int opNor(const DecodedInst & inst)
+{
+    regs[inst.rd] = ~(regs[inst.rs] | regs[inst.rt]);
+    return 0;
+}
+
+static int opOr(const DecodedInst & inst)
+{
+    regs[inst.rd] = regs[inst.rs] | regs[inst.rt];
+    return 0;
+}
+
+static int opSlt(const DecodedInst & inst)
+{
+    regs[inst.rd] = (static_cast<int32_t>(regs[inst.rs]) < static_cast<int32_t>(regs[inst.rt])) ? 1 : 0;
+    return 0;
+}
+
+static int opSltu(const DecodedInst & inst)
+{
+    regs[inst.rd] = (regs[inst.rs] < regs[inst.rt]) ? 1 : 0;
+    return 0;
+}
+
+static int opSll(const DecodedInst & inst)
+{
+    regs[inst.rd] = regs[inst.rt] << inst.shamt;
+    return 0;
+}
+
+static int opSrl(const DecodedInst & inst)
+{
+    regs[inst.rd] = regs[inst.rt] >> inst.shamt;
+    return 0;
+}
+
+static int opSub(const DecodedInst & inst)
+{
+    return doAddSub(inst.rd, regs[inst.rs], regs[inst.rt], false, true);
+}
+
+static int opSubu(const DecodedInst & inst)
+{
+    //No overflow...
+    return doAddSub(inst.rd, regs[inst.rs], regs[inst.rt], false, false);
+}
+
+//I-type handlers...
+static int opAddi(const DecodedInst & inst)
+{
+    return doAddSub(inst.rt, regs[inst.rs], inst.imm, true, true);
+}
+
+static int opAddiu(const DecodedInst & inst)
+{
+    return doAddSub(inst.rt, regs[inst.rs], inst.imm, true, false);
+}
+
+static int opAndi(const DecodedInst & inst)
+{
+    regs[inst.rt] = regs[inst.rs] & inst.imm;
+    return 0;
+}
+
+//Branches move the PC relative to its value when they run, which for a branch in a delay
+//slot is already the target of the one before it.
+static int opBeq(const DecodedInst & inst)
+{
+    //Note that signs don't matter when you're checking for equality :).
+    if(regs[inst.rs] == regs[inst.rt])
+    {
+        progCounter += inst.imm;
+        //Note that if the branch is not taken, we don't need to do anything with
+        //regard to delay slots. The instruction after the branch will be executed
+        //as required by the regular straight-line execution logic.
+        return NOINC_PC;
+    }
+    return 0;
+}
+
+static int opBne(const DecodedInst & inst)
+{
+    //See also notes for BEQ above.
+    if(regs[inst.rs] != regs[inst.rt])
+    {
+        progCounter += inst.imm;
+        return NOINC_PC;
+    }
+    return 0;
+}
+
 //TODO: Do address calculations that overflow cause an overflow exception?
 //Probably not, because memory is always addressed by UNSIGNED numbers, not signed ones.
-int handleImmInst(uint32_t instr)
+static int opLbu(const DecodedInst & inst)
+{
+    return doLoad(memAddress(inst), BYTE_SIZE, inst.rt);
+}
+
+static int opLhu(const DecodedInst & inst)
+{
+    return doLoad(memAddress(inst), HALF_SIZE, inst.rt);
+}
+
+static int opLl(const DecodedInst & inst)
+{
+    //Set the ll_sc_flag. It'll be cleared on any exception or when the SC succeeds,
+    //or if there's an intervening store that overlaps with the ll word in any way.
+    ll_sc_flag = true;
+    ll_sc_addr = memAddress(inst);
+    return doLoad(ll_sc_addr, WORD_SIZE, inst.rt);
+}
+
+static int opLui(const DecodedInst & inst)
+{
+    regs[inst.rt] = inst.imm;
+    return 0;
+}
+
+static int opLw(const DecodedInst & inst)
+{
+    return doLoad(memAddress(inst), WORD_SIZE, inst.rt);
+}
+
+static int opOri(const DecodedInst & inst)
+{
+    regs[inst.rt] = regs[inst.rs] | inst.imm;
+    return 0;
+}
+
+static int opSlti(const DecodedInst & inst)
+{
+    regs[inst.rt] = (static_cast<int32_t>(regs[inst.rs]) < static_cast<int32_t>(inst.imm)) ? 1 : 0;
+    return 0;
+}
+
+static int opSltiu(const DecodedInst & inst)
+{
+    regs[inst.rt] = (regs[inst.rs] < inst.imm) ? 1 : 0;
+    return 0;
+}
+
+static int opSb(const DecodedInst & inst)
+{
+    uint32_t addr = memAddress(inst);
+    int ret = doStore(addr, regs[inst.rt] & 0xFF, BYTE_SIZE);
+    checkLLSCOverlap(addr, BYTE_SIZE);
+    return ret;
+}
+
+static int opSc(const DecodedInst & inst)
+{
+    uint32_t addr = memAddress(inst);
+    int ret = 0;
+
+    if(addr == ll_sc_addr)
+    {
+        if(ll_sc_flag)
+        {
+            //We are atomic. Store the value.
+            ret = doStore(addr, regs[inst.rt], WORD_SIZE);
+        }
+
+        regs[inst.rt] = (ll_sc_flag) ? 1 : 0;
+    }
+    else
+    {
+        regs[inst.rt] = 0;
+    }
+    ll_sc_flag = false;
+
+    return ret;
+}
+
+static int opSh(const DecodedInst & inst)
+{
+    uint32_t addr = memAddress(inst);
+    int ret = doStore(addr, regs[inst.rt] & 0xFFFF, HALF_SIZE);
+    checkLLSCOverlap(addr, HALF_SIZE);
+    return ret;
+}
+
+static int opSw(const DecodedInst & inst)
+{
+    uint32_t addr = memAddress(inst);
+    int ret = doStore(addr, regs[inst.rt], WORD_SIZE);
+    checkLLSCOverlap(addr, WORD_SIZE);
+    return ret;
+}
+
+//J-type handlers...
+static int opJ(const DecodedInst & inst)
+{
+    progCounter = ((progCounter + 4) & 0xf0000000) | inst.imm;
+    return NOINC_PC;
+}
+
+static int opJal(const DecodedInst & inst)
+{
+    regs[REG_RA] = progCounter + 8;
+    return opJ(inst);
+}
+
+static InstHandler decodeOpZeroInst(uint32_t instr)
+{
+    switch(instr & 0x3f)
+    {
+        case FUN_ADD:
+            return opAdd;
+        case FUN_ADDU:
+            return opAddu;
+        case FUN_AND:
+            return opAnd;
+        case FUN_JR:
+            return opJr;
+        case FUN_NOR:
+            return opNor;
+        case FUN_OR:
+            return opOr;
+        case FUN_SLT:
+            return opSlt;
+        case FUN_SLTU:
+            return opSltu;
+        case FUN_SLL:
+            return opSll;
+        case FUN_SRL:
+            return opSrl;
+        case FUN_SUB:
+            return opSub;
+        case FUN_SUBU:
+            return opSubu;
+    }
+
+    return opIllegal;
+}
+
+static void decodeInstruction(uint32_t instr, DecodedInst & inst)
 {
-    uint8_t opcode = (instr >> 26) & 0x3f;
-    uint8_t rs = (instr >> 21) & 0x1f;
-    uint8_t rt = (instr >> 16) & 0x1f;
     uint16_t imm = instr & 0xffff;
     //Sign extend the immediate...
     uint32_t seImm = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(imm)));
-    uint32_t zeImm = imm;
 
-    int ret = 0;
-    uint32_t addr = static_cast<uint32_t>(static_cast<int32_t>(regs[rs]) + static_cast<int32_t>(seImm));
-    uint32_t value = 0;
-    uint32_t oldPC = progCounter;
+    inst.instr = instr;
+    inst.rs = (instr >> 21) & 0x1f;
+    inst.rt = (instr >> 16) & 0x1f;
+    inst.rd = (instr >> 11) & 0x1f;
+    inst.shamt = (instr >> 6) & 0x1f;
+    inst.imm = seImm;
 
-    switch(opcode)
+    switch(getOpcode(instr))
     {
+        //Everything with a zero opcode...
+        case OP_ZERO:
+            inst.handler = decodeOpZeroInst(instr);
+            break;
         case OP_ADDI:
-            ret = doAddSub(rt, regs[rs], seImm, true, true);
+            inst.handler = opAddi;
             break;
         case OP_ADDIU:
-            ret = doAddSub(rt, regs[rs], seImm, true, false);
+            inst.handler = opAddiu;
             break;
         case OP_ANDI:
-            regs[rt] = regs[rs] & zeImm;
+            inst.handler = opAndi;
+            inst.imm = imm;
             break;
         case OP_BEQ:
-            //Note that signs don't matter when you're checking for equality :).
-            if(regs[rs] == regs[rt])
-            {
-                //MIPS multiplies immediates by 4 for branches...
-                progCounter += 4 + ((static_cast<int32_t>(seImm)) << 2);
-                //Note that if the branch is not taken, we don't need to do anything with
-                //regard to delay slots. The instruction after the branch will be executed
-                //as required by the regular straight-line execution logic.
-                ret = NOINC_PC;
-            }
+            inst.handler = opBeq;
+            //MIPS multiplies immediates by 4 for branches...
+            inst.imm = 4 + (seImm << 2);
             break;
         case OP_BNE:
-            //See also notes for BEQ above.
-            if(regs[rs] != regs[rt])
-            {
-                progCounter += 4 + ((static_cast<int32_t>(seImm)) << 2);
-                ret = NOINC_PC;
-            }
+            inst.handler = opBne;
+            inst.imm = 4 + (seImm << 2);
             break;
         case OP_LBU:
-            ret = doLoad(addr, BYTE_SIZE, rt);
+            inst.handler = opLbu;
             break;
         case OP_LHU:
-            ret = doLoad(addr, HALF_SIZE, rt);
+            inst.handler = opLhu;
             break;
         case OP_LL:
-            //Set the ll_sc_flag. It'll be cleared on any exception or when the SC succeeds,
-            //or if there's an intervening store that overlaps with the ll word in any way.
-            ll_sc_flag = true;
-            ll_sc_addr = addr;
-            ret = doLoad(addr, WORD_SIZE, rt);
+            inst.handler = opLl;
             break;
         case OP_LUI:
-            regs[rt] = static_cast<uint32_t>(imm) << 16;
+            inst.handler = opLui;
+            inst.imm = static_cast<uint32_t>(imm) << 16;
             break;
         case OP_LW:
-            ret = doLoad(addr, WORD_SIZE, rt);
+            inst.handler = opLw;
             break;
         case OP_ORI:
-            regs[rt] = regs[rs] | zeImm;
+            inst.handler = opOri;
+            inst.imm = imm;
             break;
         case OP_SLTI:
-            regs[rt] = (static_cast<int32_t>(regs[rs]) < static_cast<int32_t>(seImm)) ? 1 : 0;
+            inst.handler = opSlti;
             break;
         case OP_SLTIU:
-            regs[rt] = (regs[rs] < static_cast<uint32_t>(seImm)) ? 1 : 0;
+            inst.handler = opSltiu;
             break;
         case OP_SB:
-            ret = mem->setMemValue(addr, regs[rt] & 0xFF, BYTE_SIZE);
-            checkLLSCOverlap(addr, BYTE_SIZE);
+            inst.handler = opSb;
             break;
         case OP_SC:
-            if(addr == ll_sc_addr)
-            {
-                if(ll_sc_flag)
-                {
-                    //We are atomic. Store the value.
-                    ret = mem->setMemValue(addr, regs[rt], WORD_SIZE);
-                }
-
-                regs[rt] = (ll_sc_flag) ? 1 : 0;
-            }
-            else
-            {
-                regs[rt] = 0;
-            }
-            ll_sc_flag = false;
+            inst.handler = opSc;
             break;
         case OP_SH:
-            ret = mem->setMemValue(addr, regs[rt] & 0xFFFF, HALF_SIZE);
-            checkLLSCOverlap(addr, HALF_SIZE);
+            inst.handler = opSh;
             break;
         case OP_SW:
-            ret = mem->setMemValue(addr, regs[rt], WORD_SIZE);
-            checkLLSCOverlap(addr, WORD_SIZE);
+            inst.handler = opSw;
+            break;
+        case OP_J:
+            inst.handler = opJ;
+            inst.imm = (instr & 0x3ffffff) << 2;
+            break;
+        case OP_JAL:
+            inst.handler = opJal;
+            inst.imm = (instr & 0x3ffffff) << 2;
+            break;
+        default:
+            //Note: Since we catch illegal instructions here, the handlers
+            //don't need to check for illegal instructions.
+            inst.handler = opIllegal;
             break;
     }
+}
 
-    //Reset the zero register...
-    regs[REG_ZERO] = 0;
+//Fetches and decodes the instruction at addr. Returns NULL if it couldn't be fetched.
+//A word outside decodedInsts (an unaligned or out of range PC) is decoded into scratch.
+static const DecodedInst *decodeFetch(uint32_t addr, DecodedInst & scratch)
+{
+    DecodedInst *inst = &scratch;
+    uint32_t instr = 0;
 
-    //Did this instruction throw an exception or fail? If so, just return that
-    //and do nothing further.
-    if(ret && ret != NOINC_PC)
+    if((addr & 0x3) == 0 && addr < MEMORY_SIZE)
     {
-        return ret;
+        inst = &decodedInsts[addr >> 2];
     }
 
-    //Did this instruction modify the PC? If so, execute the instruction
-    //in the delay slot and then return the return value of the immediate
-    //instruction's execution unless the delay slot instruction throws an exception,
-    //in which case just return the exception of that delay instruction.
-    if(ret == NOINC_PC)
+    if(mem->getMemValue(addr, instr, WORD_SIZE))
     {
-        return runDelayInstruction(oldPC + 4, NOINC_PC);
+        return NULL;
     }
 
-    //The ret value must be 0 here, or something's amiss.
-    if(ret != 0)
+    decodeInstruction(instr, *inst);
+    return inst;
+}
+
+//Fetches the instruction at addr, which only goes to the memory if it wasn't decoded yet.
+static inline const DecodedInst *fetchInstruction(uint32_t addr, DecodedInst & scratch)
+{
+    traceAccess(addr, TRACE_FETCH, WORD_SIZE);
+
+    if((addr & 0x3) == 0 && addr < MEMORY_SIZE && decodedInsts[addr >> 2].handler)
     {
-        cerr << "ret was nonzero - check logic!" << endl;
+        return &decodedInsts[addr >> 2];
     }
 
-    return 0;
+    return decodeFetch(addr, scratch);
 }
 
-int handleJInst(uint32_t instr)
+static int runInstruction(const DecodedInst & inst, bool isDelayInst);
+
+static int runDelayInstruction(uint32_t delayPC)
 {
-    uint8_t opcode = (instr >> 26) & 0x3f;
-    uint32_t addr = instr & 0x3ffffff;
-    uint32_t oldPC = progCounter;
+    DecodedInst scratch;
+    const DecodedInst *delayInst = fetchInstruction(delayPC, scratch);
 
-    switch(opcode)
+    if(!delayInst)
     {
-        case OP_JAL:
-            regs[REG_RA] = progCounter + 8;
-            //fall through
-        case OP_J:
-            progCounter = ((progCounter + 4) & 0xf0000000) | (addr << 2);
-            break;
+        return -EBADF;
     }
 
+    return runInstruction(*delayInst, true);
+}
+
+//Runs an instruction, and the one in its delay slot if it modified the PC. Returns nonzero
+//only if the memory couldn't be accessed, exceptions are taken here.
+static inline int runInstruction(const DecodedInst & inst, bool isDelayInst)
+{
+    uint32_t oldPC = progCounter;
+    int ret = inst.handler(inst);
+
     //Reset the zero register...
     regs[REG_ZERO] = 0;
 
-    //Execute the instruction in the delay slot and then return the
-    //return value of the branch's execution
-    //(which is always NOINC_PC because J instrs always modify the PC)
-    //unless the delay slot instruction throws an exception,
-    //in which case just return the exception of that delay instruction.
-    return runDelayInstruction(oldPC + 4, NOINC_PC);
+    if(ret == NOINC_PC)
+    {
+        //Execute the instruction in the delay slot without incrementing the PC. If it throws
+        //an exception, it sets the PC to the exception address instead of the target.
+        return runDelayInstruction(oldPC + 4);
+    }
+
+    if(ret == OVERFLOW || ret == ILLEGAL_INST)
+    {
+        //There was an exception. Clear the LL/SC flag, set the PC to the
+        //exception address and return 0. This is because nothing
+        //special needs to be done by the calling code except to not increment
+        //the PC - it should just continue execution from what the PC is like
+        //normal. In the case of a regular (non-delay) instruction, this is exactly
+        //what runProgram does. In the case of a delay instruction, returning 0 here
+        //lets the branch before it return 0 as well, so execution continues from
+        //the exception address, which is exactly what we want.
+        //Note that this is the only function where progCounter is incremented.
+        ll_sc_flag = false;
+        progCounter = EXCEPTION_ADDR;
+        return 0;
+    }
+
+    if(!isDelayInst)
+    {
+        progCounter += 4;
+    }
+
+    return ret;
 }
 
-int runInstruction(uint32_t curInst, bool isDelayInst);
+//A basic block: straight-line code up to the first branch or jump, which ends it together
+//with its delay slot. A block runs its instructions one after the other without fetching
+//them, and remembers the block it went on to on either side of its branch, so the next
+//time it goes straight there.
+struct Block
+{
+    uint32_t pc;
+    //Copies of the decoded instructions, the branch or jump and its delay slot last.
+    vector<DecodedInst> insts;
+    //False if the block stops before an instruction that only runs one at a time
+    //instead: ll, sc, an illegal instruction, the end of the code, code that hasn't run
+    //yet, or a branch whose delay slot is one of those or another branch.
+    bool endsWithBranch;
+    Block *taken;
+    Block *notTaken;
+    //The block translated to native code, NULL if it runs through runBlock.
+    uint8_t *native;
+};
+
+//Blocks stop after this many instructions even without a branch.
+#define MAX_BLOCK_INSTS 64
+
+//The block starting at each word, or NULL if there is none yet.
+static Block *blocks[MEMORY_SIZE / 4];
+static vector<Block *> allBlocks;
+
+#ifdef JIT_NATIVE
+//Each block is also translated to x86-64 code, which works on regs and the memory's bytes in
+//place. An exit to a PC known when the block was translated is patched into a jump to the code
+//of the block there once that block has some, so a hot loop runs without leaving native code.
+//A jr goes back to runNative every time. A load or store the inline code doesn't handle (out of
+//range, over decoded code, or while the LL/SC flag is set) calls the instruction's handler.
+//
+//While native code runs, rbx points to regs, r12 to the memory's bytes, r13 to decodedInsts,
+//r14 to ll_sc_flag and r15 to codeModified. ebp holds the target of a jr across its delay slot.
+
+//Why native code returned, progCounter is where it stopped.
+enum JitExit
+{
+    //Go on with the block at progCounter.
+    JIT_LOOKUP,
+    //The same, and the exit at jitExitSite can jump straight to that block from now on.
+    JIT_LINK,
+    //The instruction jitErrInst couldn't access the memory, progCounter is where runProgram
+    //reports it.
+    JIT_ERROR
+};
 
-int runDelayInstruction(uint32_t delayPC, int succRet)
+//Both can be set smaller with -D, which test.bash does to have the code dropped between blocks.
+#ifndef JIT_BUFFER_SIZE
+#define JIT_BUFFER_SIZE (16 << 20)
+#endif
+//Well above what the MAX_BLOCK_INSTS instructions of a block and their slow paths take.
+#ifndef JIT_MAX_BLOCK_CODE
+#define JIT_MAX_BLOCK_CODE (1 << 16)
+#endif
+
+typedef int (*JitEntry)(const uint8_t *code);
+
+//NULL if no code could be mapped.
+static uint8_t *jitBuffer;
+//The code entering and leaving native code comes first, then the blocks up to jitUsed.
+static size_t jitBlocksStart;
+static size_t jitUsed;
+static JitEntry jitEnter;
+static uint8_t *jitExitCode;
+//Where the last exit was, and the instruction of a JIT_ERROR.
+static uint8_t *jitExitSite;
+static uint32_t jitErrInst;
+//Counts the times the code was dropped, so an exit is only patched while it's still there.
+static uint32_t jitGeneration;
+
+//Maps the code buffer and writes the code entering and leaving native code into it. Blocks run
+//through runBlock if the host doesn't allow code to be written.
+static void jitInit()
 {
-    uint32_t delayInst = 0;
-    int ret = mem->getMemValue(delayPC, delayInst, WORD_SIZE);
-    if(ret)
+    void *buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED)
     {
-        return ret;
+        return;
     }
 
-    ret = runInstruction(delayInst, true);
+    jitBuffer = static_cast<uint8_t *>(buffer);
+    X86Emitter e(jitBuffer, JIT_BUFFER_SIZE);
+    static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
 
-    if(ret)
+    //int jitEnter(const uint8_t *code) saves the registers the callee has to keep, leaves the stack
+    //16 byte aligned for the calls to the handlers and jumps to code.
+    for(int i = 0 ; i < 6 ; i++)
     {
-        return ret;
+        e.push(saved[i]);
+    }
+    e.aluImm8x64(ALU_SUB, RSP, 8);
+    e.movImm64(RBX, reinterpret_cast<uintptr_t>(regs));
+    e.movImm64(R12, reinterpret_cast<uintptr_t>(mem->hostBytes()));
+    e.movImm64(R13, reinterpret_cast<uintptr_t>(decodedInsts));
+    e.movImm64(R14, reinterpret_cast<uintptr_t>(&ll_sc_flag));
+    e.movImm64(R15, reinterpret_cast<uintptr_t>(&codeModified));
+    e.jmpReg(RDI);
+
+    //Every exit jumps here with the JitExit in eax, the next PC in edx, the address of the exit in
+    //rcx and the instruction of a JIT_ERROR in esi.
+    jitExitCode = e.at(e.offset());
+    e.movImm64(RDI, reinterpret_cast<uintptr_t>(&progCounter));
+    e.store32(x86Mem(RDI), RDX);
+    e.movImm64(RDI, reinterpret_cast<uintptr_t>(&jitExitSite));
+    e.store64(x86Mem(RDI), RCX);
+    e.movImm64(RDI, reinterpret_cast<uintptr_t>(&jitErrInst));
+    e.store32(x86Mem(RDI), RSI);
+    e.aluImm8x64(ALU_ADD, RSP, 8);
+    for(int i = 5 ; i >= 0 ; i--)
+    {
+        e.pop(saved[i]);
     }
+    e.ret();
 
-    return succRet;
+    jitEnter = reinterpret_cast<JitEntry>(jitBuffer);
+    jitBlocksStart = e.offset();
+    jitUsed = jitBlocksStart;
 }
 
-int runInstruction(uint32_t curInst)
+//Drops the code of every block, flushBlocks drops the blocks.
+static void jitReset()
 {
-    runInstruction(curInst, false);
+    jitUsed = jitBlocksStart;
+    jitGeneration++;
 }
+#endif
 
-int runInstruction(uint32_t curInst, bool isDelayInst)
+//Drops every block. Only done when code was overwritten, which is rare enough that
+//finding the blocks that held it isn't worth it.
+static void flushBlocks()
 {
-    int ret = 0;
+    for(size_t i = 0 ; i < allBlocks.size() ; i++)
+    {
+        delete allBlocks[i];
+    }
 
-    switch(getOpcode(curInst))
+    allBlocks.clear();
+    memset(blocks, 0, sizeof(blocks));
+    codeModified = false;
+#ifdef JIT_NATIVE
+    jitReset();
+#endif
+}
+
+#ifdef JIT_NATIVE
+static void jitRelease()
+{
+    if(jitBuffer)
     {
-        //Everything with a zero opcode...
-        case OP_ZERO:
-            ret = handleOpZeroInst(curInst);
+        flushBlocks();
+        munmap(jitBuffer, JIT_BUFFER_SIZE);
+        jitBuffer = NULL;
+    }
+}
+
+//Starts over once there isn't room for the code of another block. Only called between blocks,
+//the block running can't be dropped.
+static void jitMakeRoom()
+{
+    if(jitBuffer && JIT_BUFFER_SIZE - jitUsed < JIT_MAX_BLOCK_CODE)
+    {
+        flushBlocks();
+    }
+}
+
+//Where a block goes on after an instruction: pc, or the target of a jr in ebp.
+struct JitNext
+{
+    bool inEbp;
+    uint32_t pc;
+};
+
+//A call to the handler of an instruction, emitted after the code of the block. The jumps at jumps
+//go to it, and it goes back to resume.
+struct JitSlowPath
+{
+    vector<size_t> jumps;
+    size_t resume;
+    const DecodedInst *inst;
+    uint32_t errPC;
+    uint32_t errInst;
+    JitNext next;
+};
+
+//A block being translated.
+struct JitTranslation
+{
+    X86Emitter e;
+    vector<JitSlowPath> slowPaths;
+    //The jumps to the exception code.
+    vector<size_t> exceptions;
+
+    JitTranslation(uint8_t *code, size_t capacity) : e(code, capacity) {}
+};
+
+//Runs an instruction's handler for its slow path, like runBlock does.
+static int jitRunHandler(const DecodedInst *inst)
+{
+    int ret = inst->handler(*inst);
+    regs[REG_ZERO] = 0;
+    return ret;
+}
+
+static X86Mem jitReg(uint8_t reg)
+{
+    return x86Mem(RBX, 4 * reg);
+}
+
+//The zero register is never written, so it doesn't need resetting like in runBlock.
+static void emitSetReg(X86Emitter & e, uint8_t reg, int src)
+{
+    if(reg != REG_ZERO)
+    {
+        e.store32(jitReg(reg), src);
+    }
+}
+
+//Leaves native code for runNative to look up the next block.
+static void emitExit(X86Emitter & e, JitExit exit, JitNext next)
+{
+    if(next.inEbp)
+    {
+        e.movReg32(RDX, RBP);
+    }
+    else
+    {
+        e.movImm32(RDX, next.pc);
+    }
+
+    e.aluReg32(ALU_XOR, RCX, RCX);
+    e.movImm32(RAX, exit);
+    e.jmpTo(jitExitCode);
+}
+
+//An exit to pc that runNative can patch into a jump to the code of the block there. It starts
+//with a mov edx, which is 5 bytes like the jump.
+static void emitLinkExit(X86Emitter & e, uint32_t pc)
+{
+    uint8_t *site = e.at(e.offset());
+    e.movImm32(RDX, pc);
+    e.movImm64(RCX, reinterpret_cast<uintptr_t>(site));
+    e.movImm32(RAX, JIT_LINK);
+    e.jmpTo(jitExitCode);
+}
+
+//Leaves eax holding the address of a load or store, and jumps to the slow path if size bytes
+//from there aren't all in range.
+static void emitMemAddress(JitTranslation & t, const DecodedInst & inst, MemEntrySize size, JitSlowPath & slow)
+{
+    X86Emitter & e = t.e;
+    e.load32(RAX, jitReg(inst.rs));
+
+    if(inst.imm)
+    {
+        e.aluImm32(ALU_ADD, RAX, inst.imm);
+    }
+
+    //The flat memory turns down an access that ends at its last byte.
+    e.aluImm32(ALU_CMP, RAX, MEMORY_SIZE - size);
+    slow.jumps.push_back(e.jcc(CC_AE));
+}
+
+//Jumps to the slow path if the word holding the byte at eax plus offset was decoded, a store
+//there has to invalidate it.
+static void emitDecodedCheck(JitTranslation & t, uint32_t offset, JitSlowPath & slow)
+{
+    X86Emitter & e = t.e;
+    e.movReg32(RCX, RAX);
+
+    if(offset)
+    {
+        e.aluImm32(ALU_ADD, RCX, offset);
+    }
+
+    e.shr32(RCX, 2);
+    e.imulImm32(RCX, RCX, sizeof(DecodedInst));
+    e.cmpImm8Qword(x86Mem(R13, RCX, 1, offsetof(DecodedInst, handler)), 0);
+    slow.jumps.push_back(e.jcc(CC_NE));
+}
+
+static void emitLoad(JitTranslation & t, const DecodedInst & inst, MemEntrySize size, JitSlowPath & slow)
+{
+    X86Emitter & e = t.e;
+    X86Mem host = x86Mem(R12, RAX, 1, 0);
+    emitMemAddress(t, inst, size, slow);
+
+    switch(size)
+    {
+        case BYTE_SIZE:
+            e.loadZx8(RCX, host);
             break;
-        case OP_ADDI:
-        case OP_ADDIU:
-        case OP_ANDI:
-        case OP_BEQ:
-        case OP_BNE:
-        case OP_LBU:
-        case OP_LHU:
-        case OP_LL:
-        case OP_LUI:
-        case OP_LW:
-        case OP_ORI:
-        case OP_SLTI:
-        case OP_SLTIU:
-        case OP_SB:
-        case OP_SC:
-        case OP_SH:
-        case OP_SW:
-            ret = handleImmInst(curInst);
+        case HALF_SIZE:
+            e.loadZx16(RCX, host);
+            e.rol16by8(RCX);
             break;
-        case OP_J:
-        case OP_JAL:
-            ret = handleJInst(curInst);
+        case WORD_SIZE:
+            e.load32(RCX, host);
+            e.bswap32(RCX);
             break;
-        default:
-            //Illegal instruction. Trigger an exception.
-            //Note: Since we catch illegal instructions here, the "handle"
-            //instructions don't need to check for illegal instructions.
-            //except for the case with a 0 opcode and illegal function.
-            ret = ILLEGAL_INST;
-            cerr << "Illegal instruction at address " << "0x" << hex
-                 << setfill('0') << setw(8) << progCounter << endl;
+    }
+
+    emitSetReg(e, inst.rt, RCX);
+}
+
+static void emitStore(JitTranslation & t, const DecodedInst & inst, MemEntrySize size, JitSlowPath & slow)
+{
+    X86Emitter & e = t.e;
+    X86Mem host = x86Mem(R12, RAX, 1, 0);
+    emitMemAddress(t, inst, size, slow);
+
+    //A store has to check for an overlap with the LL word while the flag is set.
+    e.cmpImm8Byte(x86Mem(R14), 0);
+    slow.jumps.push_back(e.jcc(CC_NE));
+    emitDecodedCheck(t, 0, slow);
+    if(size != BYTE_SIZE)
+    {
+        emitDecodedCheck(t, size - 1, slow);
+    }
+
+    e.load32(RDX, jitReg(inst.rt));
+
+    switch(size)
+    {
+        case BYTE_SIZE:
+            e.store8(host, RDX);
+            break;
+        case HALF_SIZE:
+            e.rol16by8(RDX);
+            e.store16(host, RDX);
+            break;
+        case WORD_SIZE:
+            e.bswap32(RDX);
+            e.store32(host, RDX);
             break;
     }
+}
 
-    if(ret == NOINC_PC)
+//Emits an instruction that isn't a branch. Its errors are reported at errPC with errInst, and a
+//store over code leaves the block for next.
+static void emitInst(JitTranslation & t, const DecodedInst & inst, uint32_t errPC, uint32_t errInst, JitNext next)
+{
+    X86Emitter & e = t.e;
+    InstHandler h = inst.handler;
+    JitSlowPath slow;
+    slow.inst = &inst;
+    slow.errPC = errPC;
+    slow.errInst = errInst;
+    slow.next = next;
+
+    if(h == opAdd || h == opAddu || h == opSub || h == opSubu)
     {
-        //Don't increment the PC.
-        return 0;
+        e.load32(RAX, jitReg(inst.rs));
+        e.alu32((h == opAdd || h == opAddu) ? ALU_ADD : ALU_SUB, RAX, jitReg(inst.rt));
+        if(h == opAdd || h == opSub)
+        {
+            t.exceptions.push_back(e.jcc(CC_O));
+        }
+        emitSetReg(e, inst.rd, RAX);
+    }
+    else if(h == opAnd || h == opOr || h == opNor)
+    {
+        e.load32(RAX, jitReg(inst.rs));
+        e.alu32(h == opAnd ? ALU_AND : ALU_OR, RAX, jitReg(inst.rt));
+        if(h == opNor)
+        {
+            e.not32(RAX);
+        }
+        emitSetReg(e, inst.rd, RAX);
+    }
+    else if(h == opSlt || h == opSltu)
+    {
+        e.aluReg32(ALU_XOR, RCX, RCX);
+        e.load32(RAX, jitReg(inst.rs));
+        e.alu32(ALU_CMP, RAX, jitReg(inst.rt));
+        e.setcc(h == opSlt ? CC_L : CC_B, RCX);
+        emitSetReg(e, inst.rd, RCX);
+    }
+    else if(h == opSll || h == opSrl)
+    {
+        e.load32(RAX, jitReg(inst.rt));
+        if(inst.shamt && h == opSll)
+        {
+            e.shl32(RAX, inst.shamt);
+        }
+        else if(inst.shamt)
+        {
+            e.shr32(RAX, inst.shamt);
+        }
+        emitSetReg(e, inst.rd, RAX);
+    }
+    else if(h == opAddi || h == opAddiu || h == opAndi || h == opOri)
+    {
+        e.load32(RAX, jitReg(inst.rs));
+        e.aluImm32((h == opAndi) ? ALU_AND : (h == opOri) ? ALU_OR : ALU_ADD, RAX, inst.imm);
+        if(h == opAddi)
+        {
+            t.exceptions.push_back(e.jcc(CC_O));
+        }
+        emitSetReg(e, inst.rt, RAX);
+    }
+    else if(h == opSlti || h == opSltiu)
+    {
+        e.aluReg32(ALU_XOR, RCX, RCX);
+        e.load32(RAX, jitReg(inst.rs));
+        e.aluImm32(ALU_CMP, RAX, inst.imm);
+        e.setcc(h == opSlti ? CC_L : CC_B, RCX);
+        emitSetReg(e, inst.rt, RCX);
+    }
+    else if(h == opLui)
+    {
+        if(inst.rt != REG_ZERO)
+        {
+            e.storeImm32(jitReg(inst.rt), inst.imm);
+        }
+    }
+    else if(h == opLbu || h == opLhu || h == opLw)
+    {
+        emitLoad(t, inst, (h == opLbu) ? BYTE_SIZE : (h == opLhu) ? HALF_SIZE : WORD_SIZE, slow);
+    }
+    else if(h == opSb || h == opSh || h == opSw)
+    {
+        emitStore(t, inst, (h == opSb) ? BYTE_SIZE : (h == opSh) ? HALF_SIZE : WORD_SIZE, slow);
+    }
+    else
+    {
+        //Anything else only runs its handler.
+        slow.jumps.push_back(e.jmp());
+    }
+
+    if(!slow.jumps.empty())
+    {
+        slow.resume = e.offset();
+        t.slowPaths.push_back(slow);
+    }
+}
+
+//The slow paths run the handler and deal with what it returns like runBlock does.
+static void emitSlowPaths(JitTranslation & t)
+{
+    X86Emitter & e = t.e;
+
+    for(size_t i = 0 ; i < t.slowPaths.size() ; i++)
+    {
+        const JitSlowPath & slow = t.slowPaths[i];
+
+        for(size_t j = 0 ; j < slow.jumps.size() ; j++)
+        {
+            e.bind(slow.jumps[j], e.offset());
+        }
+
+        e.movImm64(RDI, reinterpret_cast<uintptr_t>(slow.inst));
+        e.movImm64(RAX, reinterpret_cast<uintptr_t>(jitRunHandler));
+        e.callReg(RAX);
+        e.test32(RAX, RAX);
+        size_t failed = e.jcc(CC_NE);
+        e.cmpImm8Byte(x86Mem(R15), 0);
+        size_t modified = e.jcc(CC_NE);
+        e.bind(e.jmp(), slow.resume);
+
+        //A store over code ends the block, what comes next may not be what it holds.
+        e.bind(modified, e.offset());
+        emitExit(e, JIT_LOOKUP, slow.next);
+
+        e.bind(failed, e.offset());
+        e.aluImm32(ALU_CMP, RAX, OVERFLOW);
+        t.exceptions.push_back(e.jcc(CC_E));
+        e.aluImm32(ALU_CMP, RAX, ILLEGAL_INST);
+        t.exceptions.push_back(e.jcc(CC_E));
+        e.movImm32(RDX, slow.errPC);
+        e.movImm32(RSI, slow.errInst);
+        e.aluReg32(ALU_XOR, RCX, RCX);
+        e.movImm32(RAX, JIT_ERROR);
+        e.jmpTo(jitExitCode);
+    }
+
+    //Exceptions are taken like in runInstruction.
+    if(!t.exceptions.empty())
+    {
+        for(size_t i = 0 ; i < t.exceptions.size() ; i++)
+        {
+            e.bind(t.exceptions[i], e.offset());
+        }
+
+        e.storeImm8(x86Mem(R14), 0);
+        emitLinkExit(e, EXCEPTION_ADDR);
+    }
+}
+
+//Translates a block to native code with the same effect as runBlock. Returns NULL if it doesn't
+//fit in what's left of the buffer.
+static uint8_t *translateBlock(const Block & block)
+{
+    if(!jitBuffer || JIT_BUFFER_SIZE - jitUsed < JIT_MAX_BLOCK_CODE)
+    {
+        return NULL;
+    }
+
+    JitTranslation t(jitBuffer + jitUsed, JIT_BUFFER_SIZE - jitUsed);
+    X86Emitter & e = t.e;
+    const DecodedInst *insts = &block.insts[0];
+    uint32_t straight = static_cast<uint32_t>(block.insts.size()) - (block.endsWithBranch ? 2 : 0);
+
+    for(uint32_t i = 0 ; i < straight ; i++)
+    {
+        uint32_t pc = block.pc + 4 * i;
+        JitNext next = {false, pc + 4};
+        emitInst(t, insts[i], pc, insts[i].instr, next);
+    }
+
+    uint32_t branchPC = block.pc + 4 * straight;
+
+    if(!block.endsWithBranch)
+    {
+        emitLinkExit(e, branchPC);
+    }
+    else if(insts[straight].handler == opJr)
+    {
+        //The target is read before the delay slot runs, which may change the register.
+        const DecodedInst & branch = insts[straight];
+        JitNext next = {true, 0};
+        e.load32(RBP, jitReg(branch.rs));
+        emitInst(t, insts[straight + 1], branchPC, branch.instr, next);
+        emitExit(e, JIT_LOOKUP, next);
+    }
+    else
+    {
+        const DecodedInst & branch = insts[straight];
+        const DecodedInst & delayInst = insts[straight + 1];
+        bool conditional = branch.handler == opBeq || branch.handler == opBne;
+        uint32_t target = 0;
+        size_t notTaken = 0;
+
+        if(conditional)
+        {
+            target = branchPC + branch.imm;
+            e.load32(RAX, jitReg(branch.rs));
+            e.alu32(ALU_CMP, RAX, jitReg(branch.rt));
+            notTaken = e.jcc(branch.handler == opBeq ? CC_NE : CC_E);
+        }
+        else
+        {
+            target = ((branchPC + 4) & 0xf0000000) | branch.imm;
+            if(branch.handler == opJal)
+            {
+                e.storeImm32(jitReg(REG_RA), branchPC + 8);
+            }
+        }
+
+        //Taken, errors in the delay slot are reported at the branch.
+        JitNext taken = {false, target};
+        emitInst(t, delayInst, branchPC, branch.instr, taken);
+        emitLinkExit(e, target);
+
+        if(conditional)
+        {
+            //Not taken, so the delay slot runs as the next instruction.
+            JitNext fallThrough = {false, branchPC + 8};
+            e.bind(notTaken, e.offset());
+            emitInst(t, delayInst, branchPC + 4, delayInst.instr, fallThrough);
+            emitLinkExit(e, branchPC + 8);
+        }
     }
 
+    emitSlowPaths(t);
+
+    if(e.full())
+    {
+        return NULL;
+    }
+
+    uint8_t *code = jitBuffer + jitUsed;
+    jitUsed += e.offset();
+    return code;
+}
+#endif
+
+static bool isBranch(const DecodedInst & inst)
+{
+    return inst.handler == opBeq || inst.handler == opBne || inst.handler == opJ ||
+           inst.handler == opJal || inst.handler == opJr;
+}
+
+//Whether a block can hold the instruction. LL/SC and illegal instructions are left to
+//runInstruction, overflows are taken by runBlock.
+static bool fitsInBlock(const DecodedInst & inst)
+{
+    return inst.instr != MAGIC_DEMARC && inst.handler != opIllegal &&
+           inst.handler != opLl && inst.handler != opSc;
+}
+
+//The decoded instruction at addr, or NULL if it hasn't been run since it was last written.
+static const DecodedInst *decodedAt(uint32_t addr)
+{
+    if(addr >= MEMORY_SIZE || !decodedInsts[addr >> 2].handler)
+    {
+        return NULL;
+    }
+
+    return &decodedInsts[addr >> 2];
+}
+
+//Returns the block starting at pc, building it first if needed, or NULL if none can start
+//there. Blocks are built from instructions that already ran one at a time, which never
+//fetches anything the program doesn't. No blocks are used while a trace is written, it
+//needs every fetch in order.
+static Block *findBlock(uint32_t pc)
+{
+    if(trace || (pc & 0x3) != 0 || pc >= MEMORY_SIZE)
+    {
+        return NULL;
+    }
+
+    if(codeModified)
+    {
+        flushBlocks();
+    }
+
+    if(blocks[pc >> 2])
+    {
+        return blocks[pc >> 2];
+    }
+
+    const DecodedInst *inst = decodedAt(pc);
+    if(!inst || !fitsInBlock(*inst))
+    {
+        return NULL;
+    }
+
+    Block *block = new Block();
+    block->pc = pc;
+    block->endsWithBranch = false;
+    block->taken = NULL;
+    block->notTaken = NULL;
+    block->native = NULL;
+
+    uint32_t addr = pc;
+
+    while(inst && fitsInBlock(*inst) && block->insts.size() < MAX_BLOCK_INSTS)
+    {
+        if(isBranch(*inst))
+        {
+            const DecodedInst *delayInst = decodedAt(addr + 4);
+
+            if(delayInst && fitsInBlock(*delayInst) && !isBranch(*delayInst))
+            {
+                block->insts.push_back(*inst);
+                block->insts.push_back(*delayInst);
+                block->endsWithBranch = true;
+            }
+            break;
+        }
+
+        block->insts.push_back(*inst);
+        addr += 4;
+        inst = decodedAt(addr);
+    }
+
+    if(block->insts.empty())
+    {
+        delete block;
+        return NULL;
+    }
+
+    blocks[pc >> 2] = block;
+    allBlocks.push_back(block);
+#ifdef JIT_NATIVE
+    block->native = translateBlock(*block);
+#endif
+    return block;
+}
+
+//Leaves a block after the instruction at pc returned ret, or overwrote code. Exceptions
+//are taken like in runInstruction.
+static int leaveBlock(int ret, uint32_t pc, uint32_t instr, uint32_t & errPC, uint32_t & errInst)
+{
     if(ret == OVERFLOW || ret == ILLEGAL_INST)
     {
-        //There was an exception. Clear the LL/SC flag, set the PC to the
-        //exception address and return 0. This is because nothing
-        //special needs to be done by the calling code except to not increment
-        //the PC - it should just continue execution from what the PC is like
-        //normal. In the case of a regular (non-delay) instruction, this is exactly
-        //what runProgram does. In the case of a delay instruction, returning 0 here
-        //causes the branch before the delay instruction to return NOINC_PC, which
-        //will result in the PC not getting incremented and execution continuing from
-        //whatever the PC is (which is now the exception address), which is exactly
-        //what we want.
-        //Note that this is the only function where progCounter is incremented
-        //(barring the nop case in runProgram).
         ll_sc_flag = false;
         progCounter = EXCEPTION_ADDR;
         return 0;
     }
 
-    if(!isDelayInst)
+    if(ret)
     {
-        progCounter += 4;
+        errPC = pc;
+        errInst = instr;
+        return ret;
     }
 
-    return ret;
+    progCounter = pc + 4;
+    return 0;
 }
 
+//Runs a block with the same effect as running its instructions one at a time. Returns
+//nonzero if the memory couldn't be accessed, with errPC and errInst set to the instruction
+//runProgram would have been running. Otherwise next is the block to go on with, or NULL if
+//it has to be looked up.
+static int runBlock(Block & block, Block *& next, uint32_t & errPC, uint32_t & errInst)
+{
+    const DecodedInst *insts = &block.insts[0];
+    uint32_t straight = static_cast<uint32_t>(block.insts.size()) - (block.endsWithBranch ? 2 : 0);
+
+    for(uint32_t i = 0 ; i < straight ; i++)
+    {
+        int ret = insts[i].handler(insts[i]);
+        regs[REG_ZERO] = 0;
+
+        //A store over code ends the block, what comes next may not be what it holds.
+        if(ret || codeModified)
+        {
+            return leaveBlock(ret, block.pc + 4 * i, insts[i].instr, errPC, errInst);
+        }
+    }
+
+    uint32_t branchPC = block.pc + 4 * straight;
+    Block **link = &block.notTaken;
+    progCounter = branchPC;
+
+    if(block.endsWithBranch)
+    {
+        const DecodedInst & branch = insts[straight];
+        const DecodedInst & delayInst = insts[straight + 1];
+
+        if(branch.handler(branch) == NOINC_PC)
+        {
+            regs[REG_ZERO] = 0;
+            int ret = delayInst.handler(delayInst);
+            regs[REG_ZERO] = 0;
+
+            if(ret == OVERFLOW)
+            {
+                ll_sc_flag = false;
+                progCounter = EXCEPTION_ADDR;
+                return 0;
+            }
+
+            if(ret)
+            {
+                //Reported like runProgram does, at the branch.
+                errPC = branchPC;
+                errInst = branch.instr;
+                return ret;
+            }
+
+            link = &block.taken;
+        }
+        else
+        {
+            //Not taken, so the delay slot runs as the next instruction.
+            regs[REG_ZERO] = 0;
+            int ret = delayInst.handler(delayInst);
+            regs[REG_ZERO] = 0;
+
+            if(ret)
+            {
+                return leaveBlock(ret, branchPC + 4, delayInst.instr, errPC, errInst);
+            }
+
+            progCounter = branchPC + 8;
+        }
+    }
+
+    if(codeModified)
+    {
+        return 0;
+    }
+
+    //jr can go somewhere else each time, so the link only holds while the PC matches.
+    if(!*link || (*link)->pc != progCounter)
+    {
+        *link = findBlock(progCounter);
+    }
+
+    next = *link;
+    return 0;
+}
+
+#ifdef JIT_NATIVE
+//Runs the native code of a block, and of the blocks it jumps on to. Returns like runBlock.
+static int runNative(Block & block, Block *& next, uint32_t & errPC, uint32_t & errInst)
+{
+    int exit = jitEnter(block.native);
+
+    if(exit == JIT_ERROR)
+    {
+        errPC = progCounter;
+        errInst = jitErrInst;
+        return -EINVAL;
+    }
+
+    //Read before making room, which may drop the code the exit was in.
+    uint32_t generation = jitGeneration;
+    jitMakeRoom();
+    next = findBlock(progCounter);
+
+    //From now on the exit goes straight to the next block, unless the code was dropped meanwhile.
+    if(exit == JIT_LINK && next && next->native && generation == jitGeneration)
+    {
+        X86Emitter::patchJump(jitExitSite, next->native);
+    }
+
+    return 0;
+}
+#endif
+
 void fillRegisterState(RegisterInfo & reg)
 {
     reg.at = regs[REG_AT];
@@ -640,36 +1631,77 @@ void fillRegisterState(RegisterInfo & reg)
     reg.ra = regs[REG_RA];
 }
 
+static void printRunError(uint32_t curInst, uint32_t curPC)
+{
+    //There was an error executing the instruction.
+    //Note that this won't give appropriate info for delayed branches...TODO: fix this...
+    cerr << "Error executing instruction " << "0x" << hex << setfill('0')
+         << setw(8) << curInst << " at address " << "0x" << curPC << endl;
+}
+
 //For delayed branches in combination with self-modifying code *shudder*, we should be
 //fine. Each instruction is fetched only once all previous instructions have finished
 //execution, so there should be no problem with stale values, etc.
 int runProgram()
 {
+    DecodedInst scratch;
+    Block *block = NULL;
+
     while(true)
     {
-        uint32_t curInst = 0;
+        //Whole blocks run wherever one can start, the instructions they can't hold run
+        //one at a time below.
+        if(!block)
+        {
+#ifdef JIT_NATIVE
+            jitMakeRoom();
+#endif
+            block = findBlock(progCounter);
+        }
+
+        if(block)
+        {
+            Block *next = NULL;
+            uint32_t errPC = 0;
+            uint32_t errInst = 0;
+
+#ifdef JIT_NATIVE
+            int ret = block->native ? runNative(*block, next, errPC, errInst) : runBlock(*block, next, errPC, errInst);
+#else
+            int ret = runBlock(*block, next, errPC, errInst);
+#endif
+
+            if(ret)
+            {
+                printRunError(errInst, errPC);
+                return -EINVAL;
+            }
+
+            block = next;
+            continue;
+        }
+
         //Store the current PC for printing out errors...
         uint32_t curPC = progCounter;
 
-        if(mem->getMemValue(progCounter, curInst, WORD_SIZE))
+        const DecodedInst *inst = fetchInstruction(progCounter, scratch);
+        if(!inst)
         {
             return -EBADF;
         }
 
         //Check for the end of the code segment.
+        uint32_t curInst = inst->instr;
         if(curInst == MAGIC_DEMARC)
         {
             break;
         }
 
-        int ret = runInstruction(curInst);
+        int ret = runInstruction(*inst, false);
 
         if(ret)
         {
-            //There was an error executing the instruction.
-            //Note that this won't give appropriate info for delayed branches...TODO: fix this...
-            cerr << "Error executing instruction " << "0x" << hex << setfill('0')
-                 << setw(8) << curInst << " at address " << "0x" << curPC << endl;
+            printRunError(curInst, curPC);
             return -EINVAL;
         }
 
@@ -682,25 +1714,27 @@ int runProgram()
         memset(&reg, 0, sizeof(RegisterInfo));
         fillRegisterState(reg);
         dumpRegisterStateInternal(reg, std::cout);
-        dumpMemoryState(mem);*/
+        mem->dumpState(0, MEM_DUMP_END);*/
 
         //The PC will be appropriately set by runInstruction.
         //We don't have to do anything here.
     }
+
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
-    if(argc != 2)
+    if(argc != 2 && argc != 3)
     {
-        cout << "Usage: ./sim <file name>" << endl;
+        cout << "Usage: ./sim <file name> [trace file]" << endl;
         return -EINVAL;
     }
 
     ifstream prog;
     prog.open(argv[1], ios::binary | ios::in);
 
-    mem = createMemoryStore();
+    mem = new FlatMemoryStore();
 
     if(initMemory(prog))
     {
@@ -717,15 +1751,42 @@ int main(int argc, char *argv[])
     progCounter = 0;
     ll_sc_flag = false;
 
+    //Every fetch, load and store goes to the trace file if one was given.
+    TraceWriter writer;
+    if(argc == 3)
+    {
+        if(writer.open(argv[2]))
+        {
+            cout << "Could not create trace file " << argv[2] << endl;
+            return -EBADF;
+        }
+        trace = &writer;
+    }
+
+#ifdef JIT_NATIVE
+    //No blocks run while a trace is written, so there is nothing to translate.
+    if(!trace)
+    {
+        jitInit();
+    }
+#endif
+
     runProgram();
 
+#ifdef JIT_NATIVE
+    jitRelease();
+#endif
+
+    trace = NULL;
+    writer.close();
+
     //Set the register values in the struct for printing...
     RegisterInfo reg;
     memset(&reg, 0, sizeof(RegisterInfo));
     fillRegisterState(reg);
 
     dumpRegisterState(reg);
-    dumpMemoryState(mem);
+    mem->dumpState(0, MEM_DUMP_END);
 
     delete mem;
     return 0;
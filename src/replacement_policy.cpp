@@ -0,0 +1,221 @@
+#include <stddef.h>
+#include "replacement_policy.h"
+#include "checkpoint.h"
+
+// largest re-reference prediction value of a 2 bit RRPV, "distant re-reference"
+#define RRPV_MAX 3
+// BRRIP inserts with a long rather than distant interval once every BRRIP_LONG_ODDS fills
+#define BRRIP_LONG_ODDS 32
+
+// xorshift32, a small repeatable generator for the random and bimodal policies
+static uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static bool isPowerOfTwo(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+// LRU
+
+LRUPolicy::LRUPolicy(uint32_t numSets, uint32_t assoc) : lastUsed((size_t)numSets * assoc, 0), clock(0), assoc(assoc) {}
+
+void LRUPolicy::touch(uint32_t set, uint32_t way) {
+    lastUsed[set * assoc + way] = ++clock;
+}
+
+void LRUPolicy::insert(uint32_t set, uint32_t way) {
+    lastUsed[set * assoc + way] = ++clock;
+}
+
+uint32_t LRUPolicy::victim(uint32_t set) {
+    uint64_t *ages = &lastUsed[set * assoc];
+    uint32_t oldest = 0;
+    for (uint32_t i = 1; i < assoc; i++) {
+        if (ages[i] < ages[oldest]) oldest = i;
+    }
+    return oldest;
+}
+
+void LRUPolicy::invalidate(uint32_t set, uint32_t way) {
+    lastUsed[set * assoc + way] = 0;
+}
+
+void LRUPolicy::save(CheckpointWriter &out) {
+    out.putVector(lastUsed);
+    out.put(clock);
+}
+
+void LRUPolicy::load(CheckpointReader &in) {
+    in.getVector(lastUsed);
+    in.get(clock);
+}
+
+// TREE PLRU
+// node n of a set's tree has children 2n+1 and 2n+2, the ways are the leaves left to right.
+// a bit of 0 means the pseudo-LRU way is in the left subtree, 1 in the right one
+
+TreePLRUPolicy::TreePLRUPolicy(uint32_t numSets, uint32_t assoc) : treeBits((size_t)numSets * (assoc - 1), 0), assoc(assoc), levels(0) {
+    while ((1u << levels) < assoc) levels++;
+}
+
+void TreePLRUPolicy::touch(uint32_t set, uint32_t way) {
+    if (levels == 0) return;
+    uint8_t *tree = &treeBits[set * (assoc - 1)];
+    uint32_t node = 0;
+    for (int level = levels - 1; level >= 0; level--) {
+        uint32_t right = (way >> level) & 1;
+        // point away from the way just used
+        tree[node] = !right;
+        node = 2 * node + 1 + right;
+    }
+}
+
+void TreePLRUPolicy::insert(uint32_t set, uint32_t way) {
+    touch(set, way);
+}
+
+uint32_t TreePLRUPolicy::victim(uint32_t set) {
+    if (levels == 0) return 0;
+    uint8_t *tree = &treeBits[set * (assoc - 1)];
+    uint32_t node = 0;
+    uint32_t way = 0;
+    for (uint32_t level = 0; level < levels; level++) {
+        uint32_t right = tree[node];
+        way = (way << 1) | right;
+        node = 2 * node + 1 + right;
+    }
+    return way;
+}
+
+void TreePLRUPolicy::save(CheckpointWriter &out) {
+    out.putVector(treeBits);
+}
+
+void TreePLRUPolicy::load(CheckpointReader &in) {
+    in.getVector(treeBits);
+}
+
+// SRRIP / BRRIP
+
+RRIPPolicy::RRIPPolicy(uint32_t numSets, uint32_t assoc, bool bimodal) : rrpv((size_t)numSets * assoc, RRPV_MAX), assoc(assoc), bimodal(bimodal), randomState(0x2545f491) {}
+
+void RRIPPolicy::touch(uint32_t set, uint32_t way) {
+    // hit priority, a reused block is predicted to be reused again soon
+    rrpv[set * assoc + way] = 0;
+}
+
+void RRIPPolicy::insert(uint32_t set, uint32_t way) {
+    if (bimodal && nextRandom(randomState) % BRRIP_LONG_ODDS != 0) {
+        rrpv[set * assoc + way] = RRPV_MAX;
+    } else {
+        rrpv[set * assoc + way] = RRPV_MAX - 1;
+    }
+}
+
+uint32_t RRIPPolicy::victim(uint32_t set) {
+    uint8_t *values = &rrpv[set * assoc];
+    // age the whole set until some block is predicted to be re-referenced in the distant future
+    while (true) {
+        for (uint32_t i = 0; i < assoc; i++) {
+            if (values[i] == RRPV_MAX) return i;
+        }
+        for (uint32_t i = 0; i < assoc; i++) {
+            values[i]++;
+        }
+    }
+}
+
+void RRIPPolicy::invalidate(uint32_t set, uint32_t way) {
+    rrpv[set * assoc + way] = RRPV_MAX;
+}
+
+void RRIPPolicy::save(CheckpointWriter &out) {
+    out.putVector(rrpv);
+    out.put(randomState);
+}
+
+void RRIPPolicy::load(CheckpointReader &in) {
+    in.getVector(rrpv);
+    in.get(randomState);
+}
+
+// FIFO
+
+FIFOPolicy::FIFOPolicy(uint32_t numSets, uint32_t assoc) : filled((size_t)numSets * assoc, 0), clock(0), assoc(assoc) {}
+
+void FIFOPolicy::touch(uint32_t set, uint32_t way) {}
+
+void FIFOPolicy::insert(uint32_t set, uint32_t way) {
+    filled[set * assoc + way] = ++clock;
+}
+
+uint32_t FIFOPolicy::victim(uint32_t set) {
+    uint64_t *ages = &filled[set * assoc];
+    uint32_t oldest = 0;
+    for (uint32_t i = 1; i < assoc; i++) {
+        if (ages[i] < ages[oldest]) oldest = i;
+    }
+    return oldest;
+}
+
+void FIFOPolicy::invalidate(uint32_t set, uint32_t way) {
+    filled[set * assoc + way] = 0;
+}
+
+void FIFOPolicy::save(CheckpointWriter &out) {
+    out.putVector(filled);
+    out.put(clock);
+}
+
+void FIFOPolicy::load(CheckpointReader &in) {
+    in.getVector(filled);
+    in.get(clock);
+}
+
+// RANDOM
+
+RandomPolicy::RandomPolicy(uint32_t numSets, uint32_t assoc) : assoc(assoc), randomState(0x9e3779b9) {}
+
+void RandomPolicy::touch(uint32_t set, uint32_t way) {}
+
+void RandomPolicy::insert(uint32_t set, uint32_t way) {}
+
+uint32_t RandomPolicy::victim(uint32_t set) {
+    return nextRandom(randomState) % assoc;
+}
+
+void RandomPolicy::save(CheckpointWriter &out) {
+    out.put(randomState);
+}
+
+void RandomPolicy::load(CheckpointReader &in) {
+    in.get(randomState);
+}
+
+bool replacementPolicySupports(ReplacementType type, uint32_t assoc) {
+    // the tree needs a leaf per way
+    return type != TREE_PLRU || isPowerOfTwo(assoc);
+}
+
+ReplacementPolicy *createReplacementPolicy(ReplacementType type, uint32_t numSets, uint32_t assoc) {
+    if (!replacementPolicySupports(type, assoc)) return NULL;
+    switch (type) {
+    case LRU:
+        return new LRUPolicy(numSets, assoc);
+    case TREE_PLRU:
+        return new TreePLRUPolicy(numSets, assoc);
+    case SRRIP:
+        return new RRIPPolicy(numSets, assoc, false);
+    case BRRIP:
+        return new RRIPPolicy(numSets, assoc, true);
+    case FIFO:
+        return new FIFOPolicy(numSets, assoc);
+    case RANDOM:
+        return new RandomPolicy(numSets, assoc);
+    }
+    return NULL;
+}
@@ -0,0 +1,115 @@
+#ifndef REPLACEMENT_POLICY_H
+#define REPLACEMENT_POLICY_H
+
+#include <inttypes.h>
+#include <vector>
+#include "CacheConfig.h"
+
+using std::vector;
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// decides which way of a full set a cache evicts.
+// the cache fills invalid ways itself, victim() is only asked once every way of a set is valid
+class ReplacementPolicy {
+    public:
+        virtual ~ReplacementPolicy() {}
+        // a hit on a valid line
+        virtual void touch(uint32_t set, uint32_t way) = 0;
+        // a new block was filled into a line
+        virtual void insert(uint32_t set, uint32_t way) = 0;
+        // the way to evict from a full set
+        virtual uint32_t victim(uint32_t set) = 0;
+        // a line was invalidated without being replaced
+        virtual void invalidate(uint32_t set, uint32_t way) {}
+        // what the policy has learned, for a checkpoint
+        virtual void save(CheckpointWriter &out) = 0;
+        virtual void load(CheckpointReader &in) = 0;
+};
+
+// true LRU, each line remembers when it was last used
+class LRUPolicy : public ReplacementPolicy {
+    private:
+        vector<uint64_t> lastUsed;
+        uint64_t clock;
+        uint32_t assoc;
+    public:
+        LRUPolicy(uint32_t numSets, uint32_t assoc);
+        void touch(uint32_t set, uint32_t way);
+        void insert(uint32_t set, uint32_t way);
+        uint32_t victim(uint32_t set);
+        void invalidate(uint32_t set, uint32_t way);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// tree pseudo-LRU, assoc - 1 bits per set each pointing at the less recently used half below it
+class TreePLRUPolicy : public ReplacementPolicy {
+    private:
+        vector<uint8_t> treeBits;
+        uint32_t assoc, levels;
+    public:
+        TreePLRUPolicy(uint32_t numSets, uint32_t assoc);
+        void touch(uint32_t set, uint32_t way);
+        void insert(uint32_t set, uint32_t way);
+        uint32_t victim(uint32_t set);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// re-reference interval prediction with 2 bit RRPVs (Jaleel et al., ISCA 2010).
+// SRRIP inserts with a long re-reference interval, BRRIP inserts with a distant one
+// and only occasionally a long one, which keeps scanning blocks from thrashing the set
+class RRIPPolicy : public ReplacementPolicy {
+    private:
+        vector<uint8_t> rrpv;
+        uint32_t assoc;
+        bool bimodal;
+        uint32_t randomState;
+    public:
+        RRIPPolicy(uint32_t numSets, uint32_t assoc, bool bimodal);
+        void touch(uint32_t set, uint32_t way);
+        void insert(uint32_t set, uint32_t way);
+        uint32_t victim(uint32_t set);
+        void invalidate(uint32_t set, uint32_t way);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// first in first out, each line remembers when it was filled
+class FIFOPolicy : public ReplacementPolicy {
+    private:
+        vector<uint64_t> filled;
+        uint64_t clock;
+        uint32_t assoc;
+    public:
+        FIFOPolicy(uint32_t numSets, uint32_t assoc);
+        void touch(uint32_t set, uint32_t way);
+        void insert(uint32_t set, uint32_t way);
+        uint32_t victim(uint32_t set);
+        void invalidate(uint32_t set, uint32_t way);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// evicts a pseudo-random way, seeded so runs are repeatable
+class RandomPolicy : public ReplacementPolicy {
+    private:
+        uint32_t assoc;
+        uint32_t randomState;
+    public:
+        RandomPolicy(uint32_t numSets, uint32_t assoc);
+        void touch(uint32_t set, uint32_t way);
+        void insert(uint32_t set, uint32_t way);
+        uint32_t victim(uint32_t set);
+        void save(CheckpointWriter &out);
+        void load(CheckpointReader &in);
+};
+
+// false if the policy can't manage sets of assoc ways
+bool replacementPolicySupports(ReplacementType type, uint32_t assoc);
+// returns NULL if the policy can't manage sets of assoc ways
+ReplacementPolicy *createReplacementPolicy(ReplacementType type, uint32_t numSets, uint32_t assoc);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <inttypes.h>
+#include <ostream>
+#include "CacheConfig.h"
+#include "BranchConfig.h"
+#include "SuperscalarConfig.h"
+#include "OutOfOrderConfig.h"
+#include "SamplingConfig.h"
+
+//MemoryStore.h, DriverFunctions.h and RegisterInfo.h can only be included once.
+class MemoryStore;
+class MemoryImage;
+struct PipeState;
+struct SimulationStats;
+struct RegisterInfo;
+
+//One simulated machine, the pipeline with its registers and caches. Simulators share no state, so any
+//number of them can run at once, each on its own thread. Unlike the functions in DriverFunctions.h,
+//which drive a single simulator, none of these write files.
+class Simulator
+{
+    public:
+        Simulator();
+        ~Simulator();
+        //Builds the caches in front of mainMem and resets the pipeline, like initSimulator. l2Config and
+        //l3Config are NULL for levels that aren't used, an L3 needs an L2. image is mainMem as a MemoryImage,
+        //NULL for a store that isn't one.
+        int init(CacheConfig & icConfig, CacheConfig & dcConfig, CacheConfig *l2Config, CacheConfig *l3Config,
+                 MemoryStore *mainMem, MemoryImage *image = NULL);
+        //See enableStackProfiling, enableTraceCapture, enableBranchPrediction, enableSuperscalar,
+        //enableOutOfOrder and enableSampling.
+        int enableStackProfiling(uint32_t maxSets, uint32_t maxWays);
+        int enableTraceCapture(const char *path);
+        int enableBranchPrediction(BranchPredictorConfig & config);
+        int enableSuperscalar(SuperscalarConfig & config);
+        int enableOutOfOrder(OutOfOrderConfig & config);
+        int enableSampling(SamplingConfig & config);
+        //See saveCheckpoint and restoreCheckpoint.
+        int saveCheckpoint(const char *path);
+        int restoreCheckpoint(const char *path);
+        //Runs until the program halts or cycles have passed. Returns 1 once halted, 0 otherwise.
+        int runCycles(uint32_t cycles);
+        int runTillHalt();
+        int getPipeState(PipeState & state);
+        int getStats(SimulationStats & stats);
+        int getRegisterState(RegisterInfo & reg);
+        //The stats printSimStats leaves out, for the parts of the hierarchy that are configured.
+        int printExtendedStats(SimulationStats & stats, std::ostream & out);
+        //Prints the CPI stack of stats, the cycles of each cause and what they add to the CPI.
+        int printCpiStack(SimulationStats & stats, std::ostream & out);
+        //Prints the stack profiles, returns -EINVAL unless enableStackProfiling was called.
+        int printStackProfile(std::ostream & out);
+        //Closes the trace and writes every dirty block back to main memory. The caches are freed, the
+        //registers can still be read.
+        int finalize();
+    private:
+        struct Machine;
+        Machine *machine;
+        Simulator(const Simulator &);
+        Simulator & operator=(const Simulator &);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include <iomanip>
+#include "stack_profile.h"
+
+StackProfile::StackProfile(uint32_t blockSize, uint32_t maxSets, uint32_t maxWays) : blockSize(blockSize), maxSets(maxSets), maxWays(maxWays), levels(0), accesses(0) {
+    while ((1u << levels) <= maxSets) {
+        stacks.push_back(vector<uint32_t>((size_t)(1u << levels) * maxWays, 0));
+        distances.push_back(vector<uint64_t>(maxWays, 0));
+        levels++;
+    }
+}
+
+void StackProfile::access(uint32_t address, uint32_t size) {
+    uint32_t first = address / blockSize;
+    uint32_t last = (address + size - 1) / blockSize;
+    for (uint32_t block = first; block <= last; block++) {
+        accessBlock(block);
+    }
+    accesses += last - first + 1;
+}
+
+void StackProfile::accessBlock(uint32_t block) {
+    for (uint32_t level = 0; level < levels; level++) {
+        uint32_t set = block & ((1u << level) - 1);
+        uint32_t *stack = &stacks[level][(size_t)set * maxWays];
+        uint32_t depth = 0;
+        while (depth < maxWays && stack[depth] != block + 1) depth++;
+        if (depth < maxWays) {
+            distances[level][depth]++;
+        } else {
+            // not in the stack, the last block falls off it
+            depth = maxWays - 1;
+        }
+        // move the block to the top
+        for (uint32_t i = depth; i > 0; i--) {
+            stack[i] = stack[i - 1];
+        }
+        stack[0] = block + 1;
+    }
+}
+
+uint64_t StackProfile::getAccesses() {
+    return accesses;
+}
+
+uint64_t StackProfile::getHits(uint32_t sets, uint32_t ways) {
+    uint32_t level = 0;
+    while ((1u << level) < sets) level++;
+    uint64_t hits = 0;
+    for (uint32_t depth = 0; depth < ways && depth < maxWays; depth++) {
+        hits += distances[level][depth];
+    }
+    return hits;
+}
+
+void StackProfile::print(std::ostream &out, const char *name) {
+    out << name << ", " << blockSize << " byte blocks, " << accesses << " accesses" << std::endl;
+    out << std::left << std::setw(10) << "Size" << std::setw(6) << "Ways" << std::setw(6) << "Sets"
+        << std::setw(12) << "Hits" << "Misses" << std::endl;
+    for (uint64_t blocks = 1; blocks <= (uint64_t)maxSets * maxWays; blocks *= 2) {
+        for (uint32_t ways = 1; ways <= maxWays; ways *= 2) {
+            if (blocks < ways || blocks / ways > maxSets) continue;
+            uint32_t sets = blocks / ways;
+            uint64_t hits = getHits(sets, ways);
+            out << std::setw(10) << blocks * blockSize << std::setw(6) << ways << std::setw(6) << sets
+                << std::setw(12) << hits << accesses - hits << std::endl;
+        }
+    }
+}
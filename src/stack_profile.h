@@ -0,0 +1,36 @@
+#ifndef STACK_PROFILE_H
+#define STACK_PROFILE_H
+
+#include <inttypes.h>
+#include <ostream>
+#include <vector>
+
+using std::vector;
+
+// one pass LRU stack distance profile of an access stream (Mattson et al., 1970). an access hits in an LRU
+// cache with S sets and A ways exactly when fewer than A other blocks of its set were used since its block
+// was, so one histogram of those distances per set count gives the hits of every associativity at once
+class StackProfile {
+    private:
+        uint32_t blockSize, maxSets, maxWays;
+        // set counts 1, 2, 4 ... maxSets
+        uint32_t levels;
+        // per set count, every set's LRU stack of block numbers + 1, most recent first. blocks deeper than
+        // maxWays miss at every associativity profiled, so the stacks stop there
+        vector<vector<uint32_t>> stacks;
+        // per set count, the accesses found at each depth of their set's stack
+        vector<vector<uint64_t>> distances;
+        uint64_t accesses;
+        void accessBlock(uint32_t block);
+    public:
+        // maxSets and maxWays have to be powers of two
+        StackProfile(uint32_t blockSize, uint32_t maxSets, uint32_t maxWays);
+        // every block touched by size bytes at address counts as an access
+        void access(uint32_t address, uint32_t size);
+        uint64_t getAccesses();
+        uint64_t getHits(uint32_t sets, uint32_t ways);
+        // one line per geometry, ordered by size and then ways
+        void print(std::ostream &out, const char *name);
+};
+
+#endif
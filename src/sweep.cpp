@@ -0,0 +1,199 @@
+#include <iostream>
+#include <fstream>
+#include <errno.h>
+#include "MemoryStore.h"
+#include "DriverFunctions.h"
+#include "cache_sim.h"
+#include "paged_memory.h"
+#include "simulator.h"
+#include "sweep.h"
+#include "thread_pool.h"
+
+// how a run ended
+enum RunStatus
+{
+    RUN_FAILED,
+    RUN_HALTED,
+    RUN_CYCLE_LIMIT
+};
+
+// one program on one grid point
+struct SweepRun
+{
+    const std::string *program;
+    // the program loaded into memory, NULL if it couldn't be. every run starts on a snapshot of it
+    const PagedMemoryStore *image;
+    CacheConfig config;
+    RunStatus status;
+    SimulationStats stats;
+};
+
+static const char *typeName(CacheType type)
+{
+    switch (type) {
+    case DIRECT_MAPPED:
+        return "direct_mapped";
+    case TWO_WAY_SET_ASSOC:
+        return "two_way";
+    case SET_ASSOC:
+        return "set_assoc";
+    case FULLY_ASSOC:
+        return "fully_assoc";
+    }
+    return "unknown";
+}
+
+static uint32_t waysOf(CacheConfig &config)
+{
+    switch (config.type) {
+    case DIRECT_MAPPED:
+        return 1;
+    case TWO_WAY_SET_ASSOC:
+        return 2;
+    case SET_ASSOC:
+        return config.associativity;
+    case FULLY_ASSOC:
+        break;
+    }
+    return config.cacheSize / config.blockSize;
+}
+
+// copies the program into memory from address 0, like the drivers do
+static int loadProgram(const std::string &path, MemoryStore *mem)
+{
+    std::ifstream prog(path, std::ios::binary | std::ios::in);
+    if (!prog) return -EBADF;
+    char chunk[4096];
+    uint32_t addr = 0;
+    while (prog.read(chunk, sizeof(chunk)) || prog.gcount() > 0) {
+        uint32_t size = static_cast<uint32_t>(prog.gcount()) & ~0x3u;
+        if (size == 0) break;
+        if (mem->writeBlock(addr, reinterpret_cast<uint8_t *>(chunk), size)) return -EINVAL;
+        addr += size;
+    }
+    return 0;
+}
+
+// runs on a worker thread, every run has a memory and simulator of its own. the memory shares the pages of
+// the program's image until the run writes them
+static void simulate(SweepRun &run, uint32_t maxCycles)
+{
+    if (!run.image) return;
+    PagedMemoryStore *mem = run.image->snapshot();
+    Simulator simulator;
+    CacheConfig icConfig = run.config;
+    CacheConfig dcConfig = run.config;
+    if (simulator.init(icConfig, dcConfig, NULL, NULL, mem, mem) == 0) {
+        if (maxCycles) {
+            run.status = simulator.runCycles(maxCycles) ? RUN_HALTED : RUN_CYCLE_LIMIT;
+        } else {
+            simulator.runTillHalt();
+            run.status = RUN_HALTED;
+        }
+        simulator.getStats(run.stats);
+    }
+    delete mem;
+}
+
+// quotes a field that would otherwise break the row
+static std::string csvField(const std::string &field)
+{
+    if (field.find_first_of(",\"\n") == std::string::npos) return field;
+    std::string quoted = "\"";
+    for (char c : field) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeRow(std::ostream &out, SweepRun &run)
+{
+    static const char *statusNames[] = {"failed", "halted", "cycle_limit"};
+    SimulationStats &s = run.stats;
+    out << csvField(*run.program) << ',' << run.config.cacheSize << ',' << run.config.blockSize << ','
+        << typeName(run.config.type) << ',' << waysOf(run.config) << ',' << run.config.missLatency << ','
+        << statusNames[run.status] << ',' << s.totalCycles << ',' << s.icHits << ',' << s.icMisses << ','
+        << s.dcHits << ',' << s.dcMisses << ',' << s.l2Hits << ',' << s.l2Misses << ',' << s.l3Hits << ','
+        << s.l3Misses << ',' << s.dcMergedMisses << ',' << s.mshrFullStalls << ',' << s.missCycles << ','
+        << s.outstandingMisses << ',' << s.icPrefetches << ',' << s.icUsefulPrefetches << ','
+        << s.icLatePrefetches << ',' << s.icPollutingPrefetches << ',' << s.dcPrefetches << ','
+        << s.dcUsefulPrefetches << ',' << s.dcLatePrefetches << ',' << s.dcPollutingPrefetches << ','
+        << s.bufferedWrites << ',' << s.coalescedWrites << ',' << s.writeBufferStalls << ',' << s.branches << ','
+        << s.mispredicts << ',' << s.mispredictCycles << ',' << s.instructions << ',' << s.dependencySplits << ','
+        << s.structuralSplits << ',' << s.robFullStalls << ',' << s.iqFullStalls << ',' << s.lsqFullStalls << ','
+        << s.squashedInstructions << ',' << s.sampleUnits << ',' << s.sampledCpi << ',' << s.sampledCpiError << ','
+        << s.baseCycles << ',' << s.icacheStallCycles << ',' << s.dcacheStallCycles << ',' << s.loadUseStallCycles << ','
+        << s.branchStallCycles << ',' << s.mispredictStallCycles << ',' << s.exceptionStallCycles << ','
+        << s.otherStallCycles << '\n';
+}
+
+int runSweep(SweepGrid &grid, std::vector<std::string> &programs, const char *csvPath, unsigned threads,
+             uint32_t maxCycles)
+{
+    for (const std::string &program : programs) {
+        if (!std::ifstream(program)) {
+            std::cerr << "Could not read " << program << std::endl;
+            return -EBADF;
+        }
+    }
+    std::ofstream out(csvPath);
+    if (!out) return -EBADF;
+
+    // each program is read once, however many points it runs on
+    std::vector<PagedMemoryStore *> images;
+    for (const std::string &program : programs) {
+        PagedMemoryStore *image = new PagedMemoryStore();
+        if (loadProgram(program, image)) {
+            delete image;
+            image = NULL;
+        }
+        images.push_back(image);
+    }
+
+    // geometries a cache can't be built from are left out before any run starts, Cache::checkConfig says why
+    std::vector<CacheConfig> configs;
+    for (uint32_t cacheSize : grid.cacheSizes)
+        for (uint32_t blockSize : grid.blockSizes)
+            for (CacheType type : grid.types) {
+                CacheConfig config = grid.base;
+                config.cacheSize = cacheSize;
+                config.blockSize = blockSize;
+                config.type = type;
+                if (Cache::checkConfig(config)) continue;
+                for (uint32_t missLatency : grid.missLatencies) {
+                    config.missLatency = missLatency;
+                    configs.push_back(config);
+                }
+            }
+
+    std::vector<SweepRun> points;
+    for (size_t i = 0; i < programs.size(); i++)
+        for (CacheConfig &config : configs)
+            points.push_back(SweepRun{&programs[i], images[i], config, RUN_FAILED, SimulationStats{}});
+
+    WorkStealingPool pool(threads);
+    for (SweepRun &run : points) {
+        SweepRun *point = &run;
+        pool.submit([point, maxCycles] { simulate(*point, maxCycles); });
+    }
+    pool.run();
+    for (PagedMemoryStore *image : images) delete image;
+
+    int failed = 0;
+
+    out << "program,cache_size,block_size,type,ways,miss_latency,status,total_cycles,ic_hits,ic_misses,"
+           "dc_hits,dc_misses,l2_hits,l2_misses,l3_hits,l3_misses,dc_merged_misses,mshr_full_stalls,"
+           "miss_cycles,outstanding_misses,ic_prefetches,ic_useful_prefetches,ic_late_prefetches,"
+           "ic_polluting_prefetches,dc_prefetches,dc_useful_prefetches,dc_late_prefetches,"
+           "dc_polluting_prefetches,buffered_writes,coalesced_writes,write_buffer_stalls,branches,mispredicts,"
+           "mispredict_cycles,instructions,dependency_splits,structural_splits,rob_full_stalls,iq_full_stalls,"
+           "lsq_full_stalls,squashed_instructions,sample_units,sampled_cpi,sampled_cpi_error,base_cycles,"
+           "icache_stall_cycles,dcache_stall_cycles,load_use_stall_cycles,branch_stall_cycles,"
+           "mispredict_stall_cycles,exception_stall_cycles,other_stall_cycles\n";
+    for (SweepRun &run : points) {
+        writeRow(out, run);
+        if (run.status == RUN_FAILED) failed++;
+    }
+    return failed;
+}
@@ -0,0 +1,30 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include "CacheConfig.h"
+
+//The cache geometries of a sweep, every combination of the values below. A point uses the same config
+//for the I-cache and the D-cache, the fields the grid doesn't vary come from base.
+struct SweepGrid
+{
+    CacheConfig base;
+    std::vector<uint32_t> cacheSizes;
+    std::vector<uint32_t> blockSizes;
+    std::vector<CacheType> types;
+    std::vector<uint32_t> missLatencies;
+};
+
+//Runs every program on every point of the grid with threads workers (0 is one per host core) and writes
+//the SimulationStats of each run as a row of the CSV at csvPath, ordered by program and then grid point.
+//Every run is a Simulator of its own, none of them write files. Each program is read once into a
+//PagedMemoryStore, and every run starts on a snapshot of it that shares its pages until the run writes
+//them. Points a cache can't be built from, such as fewer blocks than ways or a number of sets that isn't a
+//power of two, are left out. A run is stopped after maxCycles, 0 runs every program until it halts.
+//Returns the number of runs that failed, or -EBADF if a program can't be read or the CSV can't be written.
+int runSweep(SweepGrid & grid, std::vector<std::string> & programs, const char *csvPath, unsigned threads,
+             uint32_t maxCycles);
+
+#endif
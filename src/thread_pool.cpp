@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <thread>
+#include "thread_pool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : queues(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), next(0), queued(0), pending(0) {}
+
+unsigned WorkStealingPool::getThreads() {
+    return queues.size();
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    Queue &queue = queues[next++ % queues.size()];
+    pending++;
+    queued++;
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    std::lock_guard<std::mutex> guard(idleLock);
+    idle.notify_one();
+}
+
+bool WorkStealingPool::takeTask(unsigned worker, std::function<void()> &task) {
+    // the own queue first, then the others starting with the next worker so thieves don't all go for the same one
+    for (unsigned i = 0; i < queues.size(); i++) {
+        Queue &queue = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty()) continue;
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::work(unsigned worker) {
+    std::function<void()> task;
+    while (true) {
+        if (takeTask(worker, task)) {
+            task();
+            task = nullptr;
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> guard(idleLock);
+                idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleLock);
+        idle.wait(lock, [this] { return queued > 0 || pending == 0; });
+        if (pending == 0) return;
+    }
+}
+
+void WorkStealingPool::run() {
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < queues.size(); i++) {
+        workers.emplace_back(&WorkStealingPool::work, this, i);
+    }
+    // the calling thread is worker 0
+    work(0);
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+}
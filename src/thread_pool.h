@@ -0,0 +1,42 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// runs independent tasks on a fixed set of threads. every worker has its own queue and takes its newest
+// task first, a worker whose queue is empty steals the oldest task of another one. tasks that take very
+// different times then still spread evenly, without the workers contending on one shared queue
+class WorkStealingPool {
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+        std::vector<Queue> queues;
+        // queue the next submitted task goes to
+        std::atomic<unsigned> next;
+        // tasks waiting in the queues, and tasks submitted and not finished yet
+        std::atomic<size_t> queued;
+        std::atomic<size_t> pending;
+        // a worker with nothing to take sleeps here until a task is submitted or the last one finishes,
+        // so it doesn't take a core from the tasks still running
+        std::mutex idleLock;
+        std::condition_variable idle;
+        bool takeTask(unsigned worker, std::function<void()> &task);
+        void work(unsigned worker);
+    public:
+        // threads 0 means one per host core
+        WorkStealingPool(unsigned threads);
+        unsigned getThreads();
+        // tasks are dealt to the workers round robin, a running task may submit more
+        void submit(std::function<void()> task);
+        // runs every submitted task on the workers and returns once they are all done
+        void run();
+};
+
+#endif
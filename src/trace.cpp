@@ -0,0 +1,59 @@
+#include <string.h>
+#include <algorithm>
+#include <errno.h>
+#include "trace.h"
+
+// bytes written per flush and read per refill
+#define TRACE_BUFFER_SIZE (TRACE_RECORD_SIZE * 65536)
+
+TraceWriter::TraceWriter() : buffer(TRACE_BUFFER_SIZE), used(0) {}
+
+int TraceWriter::open(const char *path) {
+    file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file) return -EBADF;
+    file.write(TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    used = 0;
+    return 0;
+}
+
+void TraceWriter::flush() {
+    file.write((const char *) buffer.data(), used);
+    used = 0;
+}
+
+int TraceWriter::close() {
+    if (!file.is_open()) return 0;
+    flush();
+    bool failed = !file;
+    file.close();
+    return failed ? -EIO : 0;
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+TraceReader::TraceReader() : buffer(TRACE_BUFFER_SIZE) {}
+
+int TraceReader::open(const char *path) {
+    file.open(path, std::ios::binary | std::ios::in);
+    char magic[TRACE_MAGIC_SIZE];
+    if (!file || !file.read(magic, TRACE_MAGIC_SIZE) || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        return -EBADF;
+    }
+    return 0;
+}
+
+size_t TraceReader::read(TraceRecord *records, size_t max) {
+    size_t wanted = std::min(max, buffer.size() / TRACE_RECORD_SIZE);
+    file.read((char *) buffer.data(), wanted * TRACE_RECORD_SIZE);
+    // a partly written last record is dropped
+    size_t count = file.gcount() / TRACE_RECORD_SIZE;
+    const uint8_t *in = buffer.data();
+    for (size_t i = 0; i < count; i++, in += TRACE_RECORD_SIZE) {
+        records[i].address = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+        records[i].kind = (TraceKind) (in[4] & 0x3);
+        records[i].size = (in[4] >> 2) & 0x7;
+    }
+    return count;
+}
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+#include <fstream>
+#include <vector>
+
+using std::vector;
+
+// a trace file is TRACE_MAGIC followed by TRACE_RECORD_SIZE bytes per access: the address, little endian,
+// then a byte holding the kind of access in bits 0-1 and its size in bytes in bits 2-4
+#define TRACE_MAGIC "MTR1"
+#define TRACE_MAGIC_SIZE 4
+#define TRACE_RECORD_SIZE 5
+
+enum TraceKind
+{
+    TRACE_FETCH,
+    TRACE_LOAD,
+    TRACE_STORE
+};
+
+struct TraceRecord
+{
+    uint32_t address;
+    TraceKind kind;
+    // bytes accessed, 1, 2 or 4
+    uint32_t size;
+};
+
+// appends records to a trace file, a buffer at a time
+class TraceWriter {
+    private:
+        std::ofstream file;
+        vector<uint8_t> buffer;
+        size_t used;
+        void flush();
+    public:
+        TraceWriter();
+        // returns -EBADF if the file can't be created
+        int open(const char *path);
+        void record(uint32_t address, TraceKind kind, uint32_t size) {
+            if (used + TRACE_RECORD_SIZE > buffer.size()) flush();
+            uint8_t *out = &buffer[used];
+            out[0] = (uint8_t) address;
+            out[1] = (uint8_t) (address >> 8);
+            out[2] = (uint8_t) (address >> 16);
+            out[3] = (uint8_t) (address >> 24);
+            out[4] = (uint8_t) (kind | (size << 2));
+            used += TRACE_RECORD_SIZE;
+        }
+        // writes out what is still buffered, returns -EIO if any write failed
+        int close();
+        ~TraceWriter();
+};
+
+// reads the records of a trace file in order
+class TraceReader {
+    private:
+        std::ifstream file;
+        vector<uint8_t> buffer;
+    public:
+        TraceReader();
+        // returns -EBADF if the file can't be read or isn't a trace
+        int open(const char *path);
+        // fills up to max records, returns how many. 0 once the trace is done
+        size_t read(TraceRecord *records, size_t max);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <errno.h>
+#include "MemoryStore.h"
+#include "DriverFunctions.h"
+#include "cache_sim.h"
+#include "trace.h"
+#include "trace_replay.h"
+
+// records decoded per read of the trace
+#define REPLAY_BATCH 4096
+
+// the trace has no data, so the caches are backed by a memory that doesn't keep any. fills and
+// write backs then cost next to nothing, which is most of the time a replay would otherwise spend
+class NullMemory : public MemoryStore {
+    public:
+        int getMemValue(uint32_t address, uint32_t & value, MemEntrySize size) {
+            value = 0;
+            return 0;
+        }
+        int setMemValue(uint32_t address, uint32_t value, MemEntrySize size) { return 0; }
+        int printMemory(uint32_t startAddress, uint32_t endAddress) { return 0; }
+};
+
+// one access, retried until it is done. the cycle moves on by the stall each attempt reports
+static void replayAccess(Cache *cache, const TraceRecord &record, uint32_t &cycle) {
+    uint32_t value = 0;
+    MemEntrySize size = (MemEntrySize) record.size;
+    int delay;
+    do {
+        if (cache->isNonBlocking()) {
+            delay = record.kind == TRACE_STORE ? cache->issueStore(record.address, 0, size, cycle)
+                                               : cache->issueLoad(record.address, value, size, cycle);
+            // the replay doesn't track when loaded values are used, so only a full MSHR or write buffer waits
+            delay = (delay == MSHR_FULL || delay == WRITE_BUFFER_FULL) ? 1 : 0;
+        } else if (record.kind == TRACE_STORE) {
+            delay = cache->setCacheValue(record.address, 0, size, cycle);
+        } else {
+            delay = cache->getCacheValue(record.address, value, size, cycle);
+        }
+        cycle += delay;
+    } while (delay);
+}
+
+int replayTrace(const char *path, CacheConfig &icConfig, CacheConfig &dcConfig, CacheConfig *l2Config,
+                CacheConfig *l3Config, ReplayStats &stats)
+{
+    CacheConfig *shared[] = {l2Config, l3Config};
+    for (CacheConfig *config : shared) {
+        if (config && (config->blockSize != icConfig.blockSize || config->blockSize != dcConfig.blockSize)) {
+            std::cerr << "All cache levels need the same block size" << std::endl;
+            return -EINVAL;
+        }
+    }
+    if (l3Config && !l2Config) return -EINVAL;
+    CacheConfig *levels[] = {&icConfig, &dcConfig, l2Config, l3Config};
+    for (CacheConfig *config : levels) {
+        if (config && Cache::checkConfig(*config)) return -EINVAL;
+    }
+
+    TraceReader reader;
+    if (reader.open(path)) {
+        std::cerr << "Could not read trace " << path << std::endl;
+        return -EBADF;
+    }
+
+    NullMemory memory;
+    MemoryStore *mainMem = &memory;
+    Cache icache{icConfig, mainMem};
+    Cache dcache{dcConfig, mainMem};
+    Cache *l2cache = l2Config ? new Cache{*l2Config, mainMem} : NULL;
+    Cache *l3cache = l3Config ? new Cache{*l3Config, mainMem} : NULL;
+    if (l2cache) {
+        icache.setNextLevel(l2cache);
+        dcache.setNextLevel(l2cache);
+    }
+    if (l3cache) {
+        l2cache->setNextLevel(l3cache);
+    }
+
+    stats = ReplayStats{};
+    uint32_t cycle = 0;
+    vector<TraceRecord> records(REPLAY_BATCH);
+    size_t count;
+    while ((count = reader.read(records.data(), records.size())) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const TraceRecord &record = records[i];
+            switch (record.kind) {
+            case TRACE_FETCH:
+                stats.fetches++;
+                replayAccess(&icache, record, cycle);
+                break;
+            case TRACE_LOAD:
+                stats.loads++;
+                replayAccess(&dcache, record, cycle);
+                break;
+            default:
+                stats.stores++;
+                replayAccess(&dcache, record, cycle);
+                break;
+            }
+            cycle++;
+        }
+    }
+
+    stats.cycles = cycle;
+    stats.icHits = icache.getHits();
+    stats.icMisses = icache.getMisses();
+    stats.dcHits = dcache.getHits();
+    stats.dcMisses = dcache.getMisses();
+    if (l2cache) {
+        stats.l2Hits = l2cache->getHits();
+        stats.l2Misses = l2cache->getMisses();
+    }
+    if (l3cache) {
+        stats.l3Hits = l3cache->getHits();
+        stats.l3Misses = l3cache->getMisses();
+    }
+    delete l2cache;
+    delete l3cache;
+    return 0;
+}
+
+int printReplayStats(ReplayStats &stats)
+{
+    std::ofstream out("replay_stats.out");
+    if (!out) return -EBADF;
+    out << std::left;
+    out << std::setw(20) << "Fetches:" << stats.fetches << std::endl;
+    out << std::setw(20) << "Loads:" << stats.loads << std::endl;
+    out << std::setw(20) << "Stores:" << stats.stores << std::endl;
+    out << std::setw(20) << "Total cycles:" << stats.cycles << std::endl;
+    out << std::setw(20) << "I-cache hits:" << stats.icHits << std::endl;
+    out << std::setw(20) << "I-cache misses:" << stats.icMisses << std::endl;
+    out << std::setw(20) << "D-cache hits:" << stats.dcHits << std::endl;
+    out << std::setw(20) << "D-cache misses:" << stats.dcMisses << std::endl;
+    if (stats.l2Hits || stats.l2Misses) {
+        out << std::setw(20) << "L2 hits:" << stats.l2Hits << std::endl;
+        out << std::setw(20) << "L2 misses:" << stats.l2Misses << std::endl;
+    }
+    if (stats.l3Hits || stats.l3Misses) {
+        out << std::setw(20) << "L3 hits:" << stats.l3Hits << std::endl;
+        out << std::setw(20) << "L3 misses:" << stats.l3Misses << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <inttypes.h>
+#include "CacheConfig.h"
+
+struct ReplayStats
+{
+    uint64_t fetches;
+    uint64_t loads;
+    uint64_t stores;
+    //Cycles the replay took, one per access plus the cycles spent waiting for misses.
+    uint64_t cycles;
+    uint32_t icHits;
+    uint32_t icMisses;
+    uint32_t dcHits;
+    uint32_t dcMisses;
+    uint32_t l2Hits;
+    uint32_t l2Misses;
+    uint32_t l3Hits;
+    uint32_t l3Misses;
+};
+
+//Runs the accesses of the trace at path through caches built from the configs, without the pipeline.
+//Fetches go to the I-cache and loads and stores to the D-cache, one access a cycle, and a miss waits for
+//its block like a stalled pipeline would. l2Config and l3Config may be NULL, the block sizes follow the
+//same rules as initSimulator. Returns -EBADF if the trace can't be read.
+int replayTrace(const char *path, CacheConfig & icConfig, CacheConfig & dcConfig, CacheConfig *l2Config,
+                CacheConfig *l3Config, ReplayStats & stats);
+//Writes stats to replay_stats.out, in the format of sim_stats.out.
+int printReplayStats(ReplayStats & stats);
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef X86_EMITTER_H
+#define X86_EMITTER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+// x86-64 general purpose registers, numbered as they are encoded
+enum X86Reg
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// condition codes, the low nibble of jcc and setcc
+enum X86Cond
+{
+    CC_O = 0x0,
+    CC_B = 0x2,
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xc
+};
+
+// the group 1 operations, which share their encodings apart from this number
+enum X86AluOp
+{
+    ALU_ADD = 0,
+    ALU_OR = 1,
+    ALU_AND = 4,
+    ALU_SUB = 5,
+    ALU_XOR = 6,
+    ALU_CMP = 7
+};
+
+// a memory operand, base + index * scale + disp. index is -1 when there is none
+struct X86Mem {
+    int base;
+    int index;
+    uint8_t scale;
+    int32_t disp;
+};
+
+static inline X86Mem x86Mem(int base, int32_t disp = 0) {
+    X86Mem m = {base, -1, 1, disp};
+    return m;
+}
+
+static inline X86Mem x86Mem(int base, int index, uint8_t scale, int32_t disp) {
+    X86Mem m = {base, index, scale, disp};
+    return m;
+}
+
+// writes x86-64 machine code into a buffer, only the forms the translator needs. a write past the end
+// of the buffer is dropped and marks the emitter full, the code is then unusable but nothing else got
+// overwritten. jumps within the code are emitted with a rel32 to fill in once the target is known
+class X86Emitter {
+    private:
+        uint8_t *code;
+        size_t capacity;
+        size_t used;
+
+        void rex(bool wide, int reg, int index, int base) {
+            uint8_t bits = (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+            if (bits) byte(0x40 | bits);
+        }
+        void modrmReg(int reg, int rm) {
+            byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+        }
+        void modrmMem(int reg, const X86Mem &m) {
+            uint8_t scaleBits = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+            // rbp and r13 as a base always take a displacement, rsp and r12 always take a SIB byte
+            uint8_t mod = (m.disp == 0 && (m.base & 7) != RBP) ? 0 : (m.disp >= -128 && m.disp < 128) ? 1 : 2;
+            if (m.index >= 0) {
+                byte((mod << 6) | ((reg & 7) << 3) | 4);
+                byte((scaleBits << 6) | ((m.index & 7) << 3) | (m.base & 7));
+            } else if ((m.base & 7) == RSP) {
+                byte((mod << 6) | ((reg & 7) << 3) | 4);
+                byte(0x24);
+            } else {
+                byte((mod << 6) | ((reg & 7) << 3) | (m.base & 7));
+            }
+            if (mod == 1) byte((uint8_t) m.disp);
+            if (mod == 2) dword((uint32_t) m.disp);
+        }
+        // an instruction with a memory operand, reg being a register or an opcode extension
+        void opMem(bool wide, const uint8_t *opcode, int opcodeSize, int reg, const X86Mem &m) {
+            rex(wide, reg, m.index >= 0 ? m.index : 0, m.base);
+            for (int i = 0; i < opcodeSize; i++) byte(opcode[i]);
+            modrmMem(reg, m);
+        }
+        void opReg(bool wide, const uint8_t *opcode, int opcodeSize, int reg, int rm) {
+            rex(wide, reg, 0, rm);
+            for (int i = 0; i < opcodeSize; i++) byte(opcode[i]);
+            modrmReg(reg, rm);
+        }
+
+    public:
+        X86Emitter(uint8_t *code, size_t capacity) : code(code), capacity(capacity), used(0) {}
+
+        size_t offset() const { return used; }
+        uint8_t *at(size_t offset) const { return code + offset; }
+        bool full() const { return used > capacity; }
+
+        void byte(uint8_t value) {
+            if (used < capacity) code[used] = value;
+            used++;
+        }
+        void dword(uint32_t value) {
+            for (int i = 0; i < 4; i++) byte((uint8_t) (value >> (8 * i)));
+        }
+        void qword(uint64_t value) {
+            dword((uint32_t) value);
+            dword((uint32_t) (value >> 32));
+        }
+
+        // mov r32, imm32 is always 5 bytes, as long as reg is one of the first eight
+        void movImm32(int reg, uint32_t value) {
+            rex(false, 0, 0, reg);
+            byte(0xb8 | (reg & 7));
+            dword(value);
+        }
+        void movImm64(int reg, uint64_t value) {
+            rex(true, 0, 0, reg);
+            byte(0xb8 | (reg & 7));
+            qword(value);
+        }
+        void movReg32(int dst, int src) {
+            static const uint8_t op[] = {0x89};
+            opReg(false, op, 1, src, dst);
+        }
+        void movReg64(int dst, int src) {
+            static const uint8_t op[] = {0x89};
+            opReg(true, op, 1, src, dst);
+        }
+
+        void load32(int dst, const X86Mem &m) {
+            static const uint8_t op[] = {0x8b};
+            opMem(false, op, 1, dst, m);
+        }
+        void loadZx8(int dst, const X86Mem &m) {
+            static const uint8_t op[] = {0x0f, 0xb6};
+            opMem(false, op, 2, dst, m);
+        }
+        void loadZx16(int dst, const X86Mem &m) {
+            static const uint8_t op[] = {0x0f, 0xb7};
+            opMem(false, op, 2, dst, m);
+        }
+        void store32(const X86Mem &m, int src) {
+            static const uint8_t op[] = {0x89};
+            opMem(false, op, 1, src, m);
+        }
+        void store64(const X86Mem &m, int src) {
+            static const uint8_t op[] = {0x89};
+            opMem(true, op, 1, src, m);
+        }
+        // src is one of rax, rcx, rdx and rbx, whose low bytes need no REX prefix
+        void store16(const X86Mem &m, int src) {
+            static const uint8_t op[] = {0x89};
+            byte(0x66);
+            opMem(false, op, 1, src, m);
+        }
+        void store8(const X86Mem &m, int src) {
+            static const uint8_t op[] = {0x88};
+            opMem(false, op, 1, src, m);
+        }
+        void storeImm32(const X86Mem &m, uint32_t value) {
+            static const uint8_t op[] = {0xc7};
+            opMem(false, op, 1, 0, m);
+            dword(value);
+        }
+        void storeImm8(const X86Mem &m, uint8_t value) {
+            static const uint8_t op[] = {0xc6};
+            opMem(false, op, 1, 0, m);
+            byte(value);
+        }
+
+        // dst = dst op [m]
+        void alu32(X86AluOp aluOp, int dst, const X86Mem &m) {
+            uint8_t op[] = {(uint8_t) ((aluOp << 3) | 3)};
+            opMem(false, op, 1, dst, m);
+        }
+        void aluReg32(X86AluOp aluOp, int dst, int src) {
+            uint8_t op[] = {(uint8_t) ((aluOp << 3) | 1)};
+            opReg(false, op, 1, src, dst);
+        }
+        void aluImm32(X86AluOp aluOp, int dst, uint32_t value) {
+            static const uint8_t op[] = {0x81};
+            opReg(false, op, 1, aluOp, dst);
+            dword(value);
+        }
+        void aluImm8x64(X86AluOp aluOp, int dst, int8_t value) {
+            static const uint8_t op[] = {0x83};
+            opReg(true, op, 1, aluOp, dst);
+            byte((uint8_t) value);
+        }
+        void cmpImm8Byte(const X86Mem &m, uint8_t value) {
+            static const uint8_t op[] = {0x80};
+            opMem(false, op, 1, ALU_CMP, m);
+            byte(value);
+        }
+        void cmpImm8Qword(const X86Mem &m, int8_t value) {
+            static const uint8_t op[] = {0x83};
+            opMem(true, op, 1, ALU_CMP, m);
+            byte((uint8_t) value);
+        }
+        void test32(int a, int b) {
+            static const uint8_t op[] = {0x85};
+            opReg(false, op, 1, b, a);
+        }
+        void imulImm32(int dst, int src, uint32_t value) {
+            static const uint8_t op[] = {0x69};
+            opReg(false, op, 1, dst, src);
+            dword(value);
+        }
+        void not32(int reg) {
+            static const uint8_t op[] = {0xf7};
+            opReg(false, op, 1, 2, reg);
+        }
+        void shl32(int reg, uint8_t count) {
+            static const uint8_t op[] = {0xc1};
+            opReg(false, op, 1, 4, reg);
+            byte(count);
+        }
+        void shr32(int reg, uint8_t count) {
+            static const uint8_t op[] = {0xc1};
+            opReg(false, op, 1, 5, reg);
+            byte(count);
+        }
+        // swaps the two low bytes
+        void rol16by8(int reg) {
+            static const uint8_t op[] = {0xc1};
+            byte(0x66);
+            opReg(false, op, 1, 0, reg);
+            byte(8);
+        }
+        void bswap32(int reg) {
+            rex(false, 0, 0, reg);
+            byte(0x0f);
+            byte(0xc8 | (reg & 7));
+        }
+        // reg is one of rax, rcx, rdx and rbx
+        void setcc(X86Cond cond, int reg) {
+            uint8_t op[] = {0x0f, (uint8_t) (0x90 | cond)};
+            opReg(false, op, 2, 0, reg);
+        }
+
+        void push(int reg) {
+            rex(false, 0, 0, reg);
+            byte(0x50 | (reg & 7));
+        }
+        void pop(int reg) {
+            rex(false, 0, 0, reg);
+            byte(0x58 | (reg & 7));
+        }
+        void callReg(int reg) {
+            static const uint8_t op[] = {0xff};
+            opReg(false, op, 1, 2, reg);
+        }
+        void jmpReg(int reg) {
+            static const uint8_t op[] = {0xff};
+            opReg(false, op, 1, 4, reg);
+        }
+        void ret() {
+            byte(0xc3);
+        }
+
+        // a jump or conditional jump whose rel32 is filled in by bind. returns where the rel32 is
+        size_t jcc(X86Cond cond) {
+            byte(0x0f);
+            byte(0x80 | cond);
+            dword(0);
+            return used - 4;
+        }
+        size_t jmp() {
+            byte(0xe9);
+            dword(0);
+            return used - 4;
+        }
+        // points the rel32 at fixup to target, an offset in the same code
+        void bind(size_t fixup, size_t target) {
+            if (fixup + 4 > capacity) return;
+            int32_t rel = (int32_t) (target - (fixup + 4));
+            memcpy(code + fixup, &rel, 4);
+        }
+        // a jump to code anywhere within 2 GB
+        void jmpTo(const uint8_t *target) {
+            byte(0xe9);
+            dword((uint32_t) (target - (code + used + 4)));
+        }
+
+        // overwrites the 5 bytes at site with a jump to target
+        static void patchJump(uint8_t *site, const uint8_t *target) {
+            int32_t rel = (int32_t) (target - (site + 5));
+            site[0] = 0xe9;
+            memcpy(site + 1, &rel, 4);
+        }
+};
+
+#endif
@@ -12,3 +12,45 @@ done
 
 diff -y fib_mem_state.out test/fib_mem_state.out
 diff -y store_mem_state.out test/store_mem_state.out
+
+# The other drivers, test/<name>_driver.cpp built as ./<name>_sim: each has to end with the registers
+# the functional simulator gives and with the same memory as ./sim
+for driver in l2 nonblocking prefetch writethrough writebuffer predictor superscalar ooo sampling paged
+do
+    for value in feed_end add_immediate and_immediate r store branch j midterm fib load_use invalid_instruction arithmetic_exception
+    do
+        ./${driver}_sim $value.bin > /dev/null
+        diff -q reg_state.out test/${value}_reg_state.out > /dev/null || echo "$driver: reg_state of $value differs"
+        diff -q mem_state.out ${value}_mem_state.out > /dev/null || echo "$driver: mem_state of $value differs"
+    done
+done
+
+# test/cpi_driver.cpp built as ./cpi_sim: on every core the CPI stack has to add up to the cycles, charge
+# base cycles only for instructions and as many cycles to mispredicts as the stats count
+for value in feed_end branch j midterm fib load_use arithmetic_exception miss
+do
+    echo cpi $value
+    ./cpi_sim $value.bin || echo "CPI stack of $value doesn't match the stats"
+done
+
+# test/sweep_driver.cpp built as ./sweep: its grid has a size whose number of sets isn't a power of two,
+# those points are left out and the rest still run and write their rows
+echo sweep
+./sweep store.bin midterm.bin > /dev/null || echo "sweep failed"
+grep -q ",1536,64,fully_assoc,24,5,halted," sweep.csv || echo "sweep.csv has no row for the 1536 byte cache"
+
+# test/checkpoint_driver.cpp built as ./checkpoint_sim: a run restored from a checkpoint has to write
+# the same outputs as the run without one
+for value in feed_end fib load_use midterm miss store
+do
+    echo checkpoint $value
+    ./checkpoint_sim $value.bin || echo "restored run of $value differs"
+done
+
+# src/project1_sim.cpp built with a small code buffer as ./p1sim_small (see README), which drops the
+# native code between the two blocks of jit_flush
+echo jit_flush
+bin/mips-linux-gnu-as test/jit_flush.asm -o jit_flush.elf
+bin/mips-linux-gnu-objcopy jit_flush.elf -j .text -O binary jit_flush.bin
+./p1sim_small jit_flush.bin > /dev/null || echo "p1sim_small failed on jit_flush"
+diff -y reg_state.out test/jit_flush_reg_state.out
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdio.h>
+#include <errno.h>
+#include "../src/MemoryStore.h"
+#include "../src/RegisterInfo.h"
+#include "../src/EndianHelpers.h"
+#include "../src/DriverFunctions.h"
+
+using namespace std;
+
+static MemoryStore *mem;
+
+//The files a run writes, which the restored run has to reproduce byte for byte. The stats and
+//pipeline state are appended to, so they are removed before the first run and moved away
+//between the runs like the others.
+static const char *outputFiles[] = {"sim_stats.out", "reg_state.out", "mem_state.out", "cpi_stack.out",
+                                    "pipe_state.out"};
+
+int initMemory(ifstream & inputProg)
+{
+    if(inputProg && mem)
+    {
+        char chunk[4096];
+        uint32_t addr = 0;
+
+        //The program is stored big endian, which is already the memory's byte order,
+        //so the file is copied in a chunk at a time. Like before, a trailing partial
+        //word is ignored.
+        while(inputProg.read(chunk, sizeof(chunk)) || inputProg.gcount() > 0)
+        {
+            uint32_t size = static_cast<uint32_t>(inputProg.gcount()) & ~0x3u;
+            if(size == 0)
+            {
+                break;
+            }
+
+            int ret = mem->writeBlock(addr, reinterpret_cast<uint8_t *>(chunk), size);
+
+            if(ret)
+            {
+                cout << "Could not set memory value!" << endl;
+                return -EINVAL;
+            }
+
+            addr += size;
+        }
+    }
+    else
+    {
+        cout << "Invalid file stream or memory image passed, could not initialise memory values" << endl;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+//The caches and predictor of both runs.
+static int setUpSimulator()
+{
+    CacheConfig icConfig;
+    icConfig.cacheSize = 1024;
+    icConfig.blockSize = 64;
+    icConfig.type = DIRECT_MAPPED;
+    icConfig.missLatency = 5;
+    CacheConfig dcConfig = icConfig;
+
+    int ret = initSimulator(icConfig, dcConfig, mem);
+    if(ret)
+    {
+        return ret;
+    }
+
+    //Branches resolve in EX and fetch follows a tournament predictor, a BTB and a return
+    //address stack.
+    BranchPredictorConfig bpConfig;
+    bpConfig.type = TOURNAMENT;
+    return enableBranchPrediction(bpConfig);
+}
+
+//Loads the program into a new memory and sets a simulator up on it, with the same configs
+//every time.
+static int startRun(const char *path)
+{
+    ifstream prog;
+    prog.open(path, ios::binary | ios::in);
+
+    mem = createMemoryStore();
+
+    if(initMemory(prog))
+    {
+        return -EBADF;
+    }
+
+    return setUpSimulator();
+}
+
+static string readFile(const string & path)
+{
+    ifstream file(path.c_str(), ios::binary | ios::in);
+    ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        cout << "Usage: ./cycle_sim <file name>" << endl;
+        return -EINVAL;
+    }
+
+    //Left over outputs of an earlier run would end up in front of the ones appended here.
+    for(const char *file : outputFiles)
+    {
+        remove(file);
+    }
+
+    //First the run without a checkpoint, whose outputs are kept aside to compare with. It
+    //stops after the same 10 cycles as the other, runTillHalt always runs at least one more.
+    if(startRun(argv[1]))
+    {
+        return -EBADF;
+    }
+
+    runCycles(10);
+    runTillHalt();
+    //The state at the end, to check that a truncated checkpoint of it can't be half restored.
+    saveCheckpoint("checkpoint_end.bin");
+    finalizeSimulator();
+    delete mem;
+
+    for(const char *file : outputFiles)
+    {
+        rename(file, (string(file) + ".ref").c_str());
+    }
+
+    //Then the same run, saved after 10 cycles and loaded back into a new simulator on an
+    //empty memory, which has to go on exactly as the first one did.
+    if(startRun(argv[1]))
+    {
+        return -EBADF;
+    }
+
+    runCycles(10);
+
+    saveCheckpoint("checkpoint.bin");
+    delete mem;
+    mem = createMemoryStore();
+    if(setUpSimulator() || restoreCheckpoint("checkpoint.bin"))
+    {
+        cout << "Could not restore the checkpoint" << endl;
+        return -EBADF;
+    }
+
+    //The end state cut off half way has to be refused without touching what was restored.
+    string end = readFile("checkpoint_end.bin");
+    ofstream cut("checkpoint_cut.bin", ios::binary | ios::out | ios::trunc);
+    cut.write(end.data(), end.size() / 2);
+    cut.close();
+    int cutRet = restoreCheckpoint("checkpoint_cut.bin");
+    remove("checkpoint_cut.bin");
+    remove("checkpoint_end.bin");
+    remove("checkpoint.bin");
+    if(cutRet != -EIO)
+    {
+        cout << "Restoring a truncated checkpoint returned " << cutRet << " instead of " << -EIO << endl;
+        return -EINVAL;
+    }
+
+    runTillHalt();
+
+    finalizeSimulator();
+
+    delete mem;
+
+    int mismatches = 0;
+    for(const char *file : outputFiles)
+    {
+        string reference = string(file) + ".ref";
+        if(readFile(file) != readFile(reference))
+        {
+            cout << "The restored run wrote a different " << file << " than the run without a checkpoint" << endl;
+            mismatches++;
+        }
+        remove(reference.c_str());
+    }
+
+    return mismatches ? -EINVAL : 0;
+}
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <errno.h>
+#include "../src/MemoryStore.h"
+#include "../src/RegisterInfo.h"
+#include "../src/EndianHelpers.h"
+#include "../src/DriverFunctions.h"
+
+using namespace std;
+
+static MemoryStore *mem;
+
+//The cores the program runs on, each in a simulator of its own.
+enum Core
+{
+    SCALAR,
+    PREDICTED,
+    SUPERSCALAR,
+    OUT_OF_ORDER,
+    OUT_OF_ORDER_PREDICTED,
+    CORES
+};
+
+static const char *coreNames[] = {"scalar", "predicted", "superscalar", "out-of-order", "predicted out-of-order"};
+
+int initMemory(ifstream & inputProg)
+{
+    if(inputProg && mem)
+    {
+        char chunk[4096];
+        uint32_t addr = 0;
+
+        //The program is stored big endian, which is already the memory's byte order,
+        //so the file is copied in a chunk at a time. Like before, a trailing partial
+        //word is ignored.
+        while(inputProg.read(chunk, sizeof(chunk)) || inputProg.gcount() > 0)
+        {
+            uint32_t size = static_cast<uint32_t>(inputProg.gcount()) & ~0x3u;
+            if(size == 0)
+            {
+                break;
+            }
+
+            int ret = mem->writeBlock(addr, reinterpret_cast<uint8_t *>(chunk), size);
+
+            if(ret)
+            {
+                cout << "Could not set memory value!" << endl;
+                return -EINVAL;
+            }
+
+            addr += size;
+        }
+    }
+    else
+    {
+        cout << "Invalid file stream or memory image passed, could not initialise memory values" << endl;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+//Loads the program into a new memory and sets a simulator up on it for core, with the caches
+//and predictor of the other drivers.
+static int startRun(const char *path, Core core)
+{
+    ifstream prog;
+    prog.open(path, ios::binary | ios::in);
+
+    mem = createMemoryStore();
+
+    if(initMemory(prog))
+    {
+        return -EBADF;
+    }
+
+    CacheConfig icConfig;
+    icConfig.cacheSize = 1024;
+    icConfig.blockSize = 64;
+    icConfig.type = DIRECT_MAPPED;
+    icConfig.missLatency = 5;
+    CacheConfig dcConfig = icConfig;
+
+    int ret = initSimulator(icConfig, dcConfig, mem);
+    if(ret)
+    {
+        return ret;
+    }
+
+    if(core == PREDICTED || core == OUT_OF_ORDER_PREDICTED)
+    {
+        BranchPredictorConfig bpConfig;
+        bpConfig.type = TOURNAMENT;
+        ret = enableBranchPrediction(bpConfig);
+    }
+    if(!ret && core == SUPERSCALAR)
+    {
+        SuperscalarConfig wideConfig;
+        ret = enableSuperscalar(wideConfig);
+    }
+    if(!ret && (core == OUT_OF_ORDER || core == OUT_OF_ORDER_PREDICTED))
+    {
+        OutOfOrderConfig oooConfig;
+        ret = enableOutOfOrder(oooConfig);
+    }
+    return ret;
+}
+
+//The CPI stack of a run has to agree with the counters next to it: its causes add up to the
+//cycles, the base cycles are the cycles instructions retired in, and what it charges to
+//mispredicts are the cycles the predictor stats say they cost.
+static int checkStack(const SimulationStats & s, Core core)
+{
+    int mismatches = 0;
+    uint32_t sum = s.baseCycles + s.icacheStallCycles + s.dcacheStallCycles + s.loadUseStallCycles +
+                   s.branchStallCycles + s.mispredictStallCycles + s.exceptionStallCycles + s.otherStallCycles;
+    if(sum != s.totalCycles)
+    {
+        cout << coreNames[core] << ": the CPI stack adds up to " << sum << " cycles, not " << s.totalCycles << endl;
+        mismatches++;
+    }
+
+    //Only the scalar pipeline retires one instruction per base cycle, the others up to their width.
+    bool oneWide = core == SCALAR || core == PREDICTED;
+    if(oneWide ? s.baseCycles != s.instructions : s.baseCycles > s.instructions)
+    {
+        cout << coreNames[core] << ": " << s.baseCycles << " base cycles for " << s.instructions << " instructions" << endl;
+        mismatches++;
+    }
+
+    //The superscalar pipeline has no predictor, its stats don't count mispredicts.
+    if(core != SCALAR && core != SUPERSCALAR && s.mispredictStallCycles != s.mispredictCycles)
+    {
+        cout << coreNames[core] << ": " << s.mispredictStallCycles << " cycles charged to mispredicts, the stats say "
+             << s.mispredictCycles << endl;
+        mismatches++;
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        cout << "Usage: ./cycle_sim <file name>" << endl;
+        return -EINVAL;
+    }
+
+    int mismatches = 0;
+    for(int core = SCALAR; core < CORES; core++)
+    {
+        if(startRun(argv[1], static_cast<Core>(core)))
+        {
+            cout << "Could not set up the " << coreNames[core] << " simulator" << endl;
+            return -EBADF;
+        }
+
+        runTillHalt();
+
+        SimulationStats stats;
+        getSimulationStats(stats);
+        mismatches += checkStack(stats, static_cast<Core>(core));
+
+        delete mem;
+    }
+
+    return mismatches ? -EINVAL : 0;
+}
@@ -15,13 +15,21 @@ int initMemory(ifstream & inputProg)
 {
     if(inputProg && mem)
     {
-        uint32_t curVal = 0;
+        char chunk[4096];
         uint32_t addr = 0;
 
-        while(inputProg.read((char *)(&curVal), sizeof(uint32_t)))
+        //The program is stored big endian, which is already the memory's byte order,
+        //so the file is copied in a chunk at a time. Like before, a trailing partial
+        //word is ignored.
+        while(inputProg.read(chunk, sizeof(chunk)) || inputProg.gcount() > 0)
         {
-            curVal = ConvertWordToBigEndian(curVal);
-            int ret = mem->setMemValue(addr, curVal, WORD_SIZE);
+            uint32_t size = static_cast<uint32_t>(inputProg.gcount()) & ~0x3u;
+            if(size == 0)
+            {
+                break;
+            }
+
+            int ret = mem->writeBlock(addr, reinterpret_cast<uint8_t *>(chunk), size);
 
             if(ret)
             {
@@ -29,8 +37,7 @@ int initMemory(ifstream & inputProg)
                 return -EINVAL;
             }
 
-            //We're reading 4 bytes each time...
-            addr += 4;
+            addr += size;
         }
     }
     else
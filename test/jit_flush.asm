@@ -0,0 +1,112 @@
+.set noreorder
+# Two blocks too long to share a small code buffer, the first going on to the second. With
+# p1sim_small (see test.bash) the code is dropped between them, so the first one's exit
+# must not be patched into the second one's code.
+main:       addi   $s2, $zero, 3        # run both blocks 3 times
+first:      addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            addi   $t2, $t2, 1
+            addi   $t3, $t3, 1
+            addi   $t0, $t0, 1
+            addi   $t1, $t1, 1
+            beq    $zero, $zero, second
+            addi   $s0, $s0, 7          # delay slot
+            addi   $s1, $s1, 1          # skipped
+second:     addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $t6, $t6, 2
+            addi   $t7, $t7, 2
+            addi   $t4, $t4, 2
+            addi   $t5, $t5, 2
+            addi   $s2, $s2, -1
+            bne    $s2, $zero, first
+            addi   $s3, $s3, 1          # delay slot
+.word 0xfeedfeed
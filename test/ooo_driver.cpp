@@ -0,0 +1,102 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <errno.h>
+#include "../src/MemoryStore.h"
+#include "../src/RegisterInfo.h"
+#include "../src/EndianHelpers.h"
+#include "../src/DriverFunctions.h"
+
+using namespace std;
+
+static MemoryStore *mem;
+
+int initMemory(ifstream & inputProg)
+{
+    if(inputProg && mem)
+    {
+        char chunk[4096];
+        uint32_t addr = 0;
+
+        //The program is stored big endian, which is already the memory's byte order,
+        //so the file is copied in a chunk at a time. Like before, a trailing partial
+        //word is ignored.
+        while(inputProg.read(chunk, sizeof(chunk)) || inputProg.gcount() > 0)
+        {
+            uint32_t size = static_cast<uint32_t>(inputProg.gcount()) & ~0x3u;
+            if(size == 0)
+            {
+                break;
+            }
+
+            int ret = mem->writeBlock(addr, reinterpret_cast<uint8_t *>(chunk), size);
+
+            if(ret)
+            {
+                cout << "Could not set memory value!" << endl;
+                return -EINVAL;
+            }
+
+            addr += size;
+        }
+    }
+    else
+    {
+        cout << "Invalid file stream or memory image passed, could not initialise memory values" << endl;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        cout << "Usage: ./cycle_sim <file name>" << endl;
+        return -EINVAL;
+    }
+
+    ifstream prog;
+    prog.open(argv[1], ios::binary | ios::in);
+
+    mem = createMemoryStore();
+
+    if(initMemory(prog))
+    {
+        return -EBADF;
+    }
+
+    CacheConfig icConfig;
+    icConfig.cacheSize = 1024;
+    icConfig.blockSize = 64;
+    icConfig.type = DIRECT_MAPPED;
+    icConfig.missLatency = 5;
+    CacheConfig dcConfig = icConfig;
+
+    initSimulator(icConfig, dcConfig, mem);
+
+    //A 4-wide out-of-order core fetching past branches with a tournament predictor.
+    BranchPredictorConfig bpConfig;
+    bpConfig.type = TOURNAMENT;
+    enableBranchPrediction(bpConfig);
+
+    OutOfOrderConfig oooConfig;
+    oooConfig.width = 4;
+    oooConfig.issueWidth = 4;
+    oooConfig.memOpsPerCycle = 1;
+    oooConfig.commitWidth = 4;
+    oooConfig.robSize = 64;
+    oooConfig.iqSize = 32;
+    oooConfig.lsqSize = 16;
+    enableOutOfOrder(oooConfig);
+
+    runCycles(10);
+
+    runTillHalt();
+
+    finalizeSimulator();
+
+    delete mem;
+    return 0;
+}
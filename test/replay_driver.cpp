@@ -0,0 +1,37 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <errno.h>
+#include "../src/MemoryStore.h"
+#include "../src/RegisterInfo.h"
+#include "../src/EndianHelpers.h"
+#include "../src/DriverFunctions.h"
+#include "../src/trace_replay.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        cout << "Usage: ./replay <trace file>" << endl;
+        return -EINVAL;
+    }
+
+    CacheConfig icConfig;
+    icConfig.cacheSize = 1024;
+    icConfig.blockSize = 64;
+    icConfig.type = DIRECT_MAPPED;
+    icConfig.missLatency = 5;
+    CacheConfig dcConfig = icConfig;
+
+    ReplayStats stats;
+    int ret = replayTrace(argv[1], icConfig, dcConfig, NULL, NULL, stats);
+    if(ret)
+    {
+        return ret;
+    }
+
+    printReplayStats(stats);
+    return 0;
+}
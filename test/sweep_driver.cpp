@@ -0,0 +1,35 @@
+#include <iostream>
+#include <errno.h>
+#include "../src/MemoryStore.h"
+#include "../src/DriverFunctions.h"
+#include "../src/sweep.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        cout << "Usage: ./sweep <file name> [<file name> ...]" << endl;
+        return -EINVAL;
+    }
+
+    vector<string> programs(argv + 1, argv + argc);
+
+    //Every L1 from 1 KB to 4 KB with 32 or 64 byte blocks, direct-mapped, two-way and fully
+    //associative, in front of a memory 5 or 10 cycles away. 1.5 KB has a number of sets that
+    //isn't a power of two, so only its fully associative points run.
+    SweepGrid grid;
+    grid.cacheSizes = {1024, 1536, 2048, 4096};
+    grid.blockSizes = {32, 64};
+    grid.types = {DIRECT_MAPPED, TWO_WAY_SET_ASSOC, FULLY_ASSOC};
+    grid.missLatencies = {5, 10};
+
+    //One worker per host core.
+    int ret = runSweep(grid, programs, "sweep.csv", 0, 0);
+    if(ret > 0)
+    {
+        cout << "Failed runs: " << ret << endl;
+    }
+    return ret;
+}